@@ -0,0 +1,164 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <plaid.h>
+
+#include "shaders.hpp"
+#include "workload.h"
+
+/// 所有负载共用的渲染目标
+struct bench_target {
+  plaid::render_pass render_pass;
+  plaid::frame_buffer frame_buffer;
+  std::vector<std::uint32_t> color;
+  std::vector<float> depth;
+};
+
+/// 创建一个颜色附件加一个深度附件的渲染通道
+/// @param tiled 为真时深度附件不写回，作为瞬态附件使渲染走分块路径
+void initialize_target(bench_target &target, std::uint32_t width, std::uint32_t height, bool tiled) {
+  plaid::attachment_reference color_ref{0, plaid::format::BGRA8u};
+  plaid::attachment_reference depth_ref{1, plaid::format::R32f};
+  plaid::subpass_description subpass{
+      .color_attachments_count = 1,
+      .color_attachments = &color_ref,
+      .depth_stencil_attachment = &depth_ref,
+  };
+  plaid::attachment_description attachments[]{
+      {
+          .load_op = plaid::attachment_load_op::clear,
+          .store_op = plaid::attachment_store_op::store,
+      },
+      {
+          .stencil_load_op = plaid::attachment_load_op::clear,
+          .stencil_store_op = tiled ? plaid::attachment_store_op::dont_care : plaid::attachment_store_op::store,
+      },
+  };
+  target.render_pass = plaid::render_pass(plaid::render_pass::create_info{
+      .attachments_count = 2,
+      .subpasses_count = 1,
+      .attachments = attachments,
+      .subpasses = &subpass,
+  });
+
+  target.color.assign(width * height, 0);
+  if (!tiled) {
+    target.depth.assign(width * height, 0);
+  }
+  std::byte *addresses[]{
+      reinterpret_cast<std::byte *>(target.color.data()),
+      tiled ? nullptr : reinterpret_cast<std::byte *>(target.depth.data()),
+  };
+  target.frame_buffer = plaid::frame_buffer(2, addresses, width, height);
+}
+
+/// @param mode 不需要分块渲染时绘制的执行方式
+void render_frame(bench_target &target, workload &load, std::uint32_t frame, plaid::render_mode mode) {
+  static constexpr plaid::clear_value clear_values[]{
+      {.color{.u{0, 0, 0, 0}}},
+      {.depth_stencil{.depth = 1.f}},
+  };
+  plaid::render_pass::state state({
+      .render_pass = target.render_pass,
+      .frame_buffer = target.frame_buffer,
+      .clear_values_count = 2,
+      .clear_values = clear_values,
+      .mode = mode,
+  });
+  load.render(state, frame);
+  state.end();
+}
+
+int main(int argc, const char *argv[]) {
+  std::ios::sync_with_stdio(false);
+
+  std::uint32_t width = 1280, height = 720, frames = 10;
+  bool tiled = false, lanes = true;
+  auto mode = plaid::render_mode::immediate;
+  std::vector<const char *> filter;
+  for (auto it = argv + 1, ed = argv + argc; it != ed; ++it) {
+    auto str = *it;
+    if (str[0] == '-') {
+      if (str[1] == 'w' && str[2] == '=') {
+        width = std::atoi(str + 3);
+      } else if (str[1] == 'h' && str[2] == '=') {
+        height = std::atoi(str + 3);
+      } else if (str[1] == 'n' && str[2] == '=') {
+        frames = (std::max)(1, std::atoi(str + 3));
+      } else if (str[1] == 'm' && str[2] == '=') {
+        // 渲染模式 immediate/tiled/sort_last
+        tiled = std::strcmp(str + 3, "tiled") == 0;
+        if (std::strcmp(str + 3, "sort_last") == 0) {
+          mode = plaid::render_mode::sort_last;
+        }
+      } else if (str[1] == 'e' && str[2] == '=') {
+        // 片元着色器执行方式 lanes/scalar
+        lanes = std::strcmp(str + 3, "scalar") != 0;
+      } else {
+        std::cerr << "Unknown param: " << str << '\n';
+        return 1;
+      }
+    } else {
+      filter.push_back(str);
+    }
+  }
+
+  bench_target target;
+  initialize_target(target, width, height, tiled);
+  auto workloads = create_workloads(target.render_pass, float(width) / height, lanes);
+
+  // 每个负载输出一行 JSON
+  std::cout << std::fixed << std::setprecision(6);
+  for (auto &load : workloads) {
+    if (!filter.empty() && std::none_of(filter.begin(), filter.end(), [&](const char *name) {
+          return std::strcmp(name, load->name()) == 0;
+        })) {
+      continue;
+    }
+
+    // 标定：统计片元数，同时预热缓存
+    bench_shaders::fragments_counter = 0;
+    bench_shaders::counting_fragments = true;
+    for (std::uint32_t f = 0; f != frames; ++f) {
+      render_frame(target, *load, f, mode);
+    }
+    bench_shaders::counting_fragments = false;
+    auto fragments = bench_shaders::fragments_counter.load();
+
+    using clock = std::chrono::steady_clock;
+    double total_ms = 0, min_ms = 0;
+    for (std::uint32_t f = 0; f != frames; ++f) {
+      auto start = clock::now();
+      render_frame(target, *load, f, mode);
+      double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+      total_ms += ms;
+      min_ms = f ? (std::min)(min_ms, ms) : ms;
+    }
+
+    auto seconds = total_ms / 1000;
+    auto triangles = load->triangles() * frames;
+    std::cout << "{\"workload\":\"" << load->name() << '"'
+              << ",\"mode\":\""
+              << (tiled ? "tiled" : mode == plaid::render_mode::sort_last ? "sort_last" : "immediate") << '"'
+              << ",\"execution\":\"" << (lanes ? "lanes" : "scalar") << '"'
+              << ",\"width\":" << width
+              << ",\"height\":" << height
+              << ",\"frames\":" << frames
+              << ",\"triangles_per_frame\":" << load->triangles()
+              << ",\"fragments_per_frame\":" << fragments / frames
+              << ",\"ms_per_frame\":" << total_ms / frames
+              << ",\"min_ms_per_frame\":" << min_ms
+              << ",\"mtris_per_s\":" << triangles / seconds / 1e6
+              << ",\"mpix_per_s\":" << fragments / seconds / 1e6
+              << "}\n";
+    std::cout.flush();
+  }
+
+  return 0;
+}
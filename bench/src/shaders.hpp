@@ -0,0 +1,73 @@
+#pragma once
+#ifndef PLAID_BENCH_SHADERS_HPP_
+#define PLAID_BENCH_SHADERS_HPP_
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+#include <plaid/shader.h>
+
+namespace bench_shaders {
+
+/// 为真时片元着色器统计执行次数，只在标定帧中开启，计时帧不受影响
+inline bool counting_fragments = false;
+inline std::atomic<std::uint64_t> fragments_counter = 0;
+
+/// 以统一的 MVP 矩阵变换顶点，顶点颜色由位置与色调决定
+struct transform_vert : plaid::vertex_shader {
+
+  binding<0>::uniform<plaid::mat4> mvp;
+  binding<1>::uniform<plaid::vec4> tint;
+
+  location<0>::in<plaid::vec4> pos;
+
+  location<1>::out<plaid::vec4> color;
+
+  void main() {
+    auto p = get(pos);
+    *gl_position = get(mvp) * p;
+    get(color) = get(tint) + plaid::vec4{p.x, p.y, p.z, 0} * .25f;
+  }
+};
+
+/// 按实例偏移和缩放同一个网格
+struct instanced_vert : plaid::vertex_shader {
+
+  binding<0>::uniform<plaid::mat4> view_projection;
+
+  location<0>::in<plaid::vec4> pos;
+  /// xyz 为实例位置，w 为缩放
+  location<1>::in<plaid::vec4> placement;
+  location<2>::in<plaid::vec4> tint;
+
+  location<1>::out<plaid::vec4> color;
+
+  void main() {
+    auto p = get(pos);
+    auto at = get(placement);
+    plaid::vec4 world{p.x * at.w + at.x, p.y * at.w + at.y, p.z * at.w + at.z, 1};
+    *gl_position = get(view_projection) * world;
+    get(color) = get(tint) + plaid::vec4{p.x, p.y, p.z, 0} * .25f;
+  }
+};
+
+/// 直接输出插值得到的颜色，以 float 或 floatx8 实例化，分别逐个或按通道执行
+template <class Float>
+struct color_frag : plaid::fragment_shader {
+
+  location<1>::in<plaid::vec<Float, 4>> color;
+
+  location<0>::out<plaid::vec<Float, 4>> final_color;
+
+  void main() {
+    [[unlikely]] if (counting_fragments) {
+      fragments_counter.fetch_add(std::popcount(gl_lane_mask), std::memory_order_relaxed);
+    }
+    get(final_color) = get(color);
+  }
+};
+
+} // namespace bench_shaders
+
+#endif // PLAID_BENCH_SHADERS_HPP_
@@ -0,0 +1,36 @@
+#pragma once
+#ifndef PLAID_BENCH_WORKLOAD_H_
+#define PLAID_BENCH_WORKLOAD_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <plaid.h>
+
+/// 一个可重复的合成负载，相同帧号总是提交完全相同的绘制
+class workload {
+public:
+
+  virtual ~workload() = default;
+
+  /// 负载名称，用于筛选与输出
+  [[nodiscard]] virtual const char *name() const noexcept = 0;
+
+  /// 每帧提交的三角形数目，不包括裁剪产生的三角形
+  [[nodiscard]] virtual std::uint64_t triangles() const noexcept = 0;
+
+  /// 在已经开始的渲染通道中提交一帧的绘制
+  /// @param state 渲染通道状态
+  /// @param frame 帧号，用于驱动随时间变化的负载
+  virtual void render(plaid::render_pass::state &state, std::uint32_t frame) = 0;
+};
+
+/// 按固定顺序创建所有负载
+/// @param render_pass 负载管道所属的渲染通道，第 0 号子通道有一个颜色附件和一个深度附件
+/// @param aspect 帧缓冲区宽高比
+/// @param lanes 为真时片元着色器按通道执行，否则逐个调用
+[[nodiscard]] std::vector<std::unique_ptr<workload>>
+create_workloads(const plaid::render_pass &render_pass, float aspect, bool lanes);
+
+#endif // PLAID_BENCH_WORKLOAD_H_
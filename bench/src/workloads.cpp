@@ -0,0 +1,425 @@
+#include <cmath>
+
+#include <numbers>
+
+#include <plaid/pipeline_cache.h>
+
+#include "shaders.hpp"
+#include "workload.h"
+
+using namespace plaid;
+
+namespace {
+
+/// 片元着色器是否按通道执行，由 [create_workloads] 设置
+bool fragment_lanes = true;
+
+/// 所有负载共用的管道缓存，着色器与顶点格式相同的负载共享同一份编译结果
+pipeline_cache pipelines;
+
+/// 固定种子的线性同余随机数，保证每次运行的场景相同
+class random_stream {
+public:
+
+  explicit random_stream(std::uint32_t seed) noexcept : state_(seed) {}
+
+  /// 返回 [lo, hi) 之间的随机数
+  float next(float lo, float hi) noexcept {
+    state_ = state_ * 1664525u + 1013904223u;
+    return lo + (hi - lo) * static_cast<float>(state_ >> 8) / (1u << 24);
+  }
+
+private:
+
+  std::uint32_t state_;
+};
+
+constexpr mat4 identity = scale(1.f);
+
+/// 观察 +z 方向的透视投影，深度映射到 [0, 1]，屏幕 y 轴向下
+mat4 perspective(float fovy, float aspect, float near, float far) {
+  auto f = 1 / std::tan(fovy / 2);
+  return {{
+      {f / aspect, 0, 0, 0},
+      {0, -f, 0, 0},
+      {0, 0, far / (far - near), -far * near / (far - near)},
+      {0, 0, 1, 0},
+  }};
+}
+
+/// 位于 eye 处、向 +z 方向看并向下俯视 pitch 弧度的相机
+mat4 look_down(const vec3 &eye, float pitch) {
+  auto s = std::sin(pitch), c = std::cos(pitch);
+  mat4 rotate{{
+      {1, 0, 0, 0},
+      {0, c, s, 0},
+      {0, -s, c, 0},
+      {0, 0, 0, 1},
+  }};
+  return rotate * translate(-eye);
+}
+
+/// 单个 vec4 位置属性的管道
+graphics_pipeline create_pipeline(
+    const render_pass &render_pass, const shader_module &vert, cull_mode cull,
+    std::uint8_t bindings_count = 1, std::uint8_t attributes_count = 1,
+    const vertex_input_binding_description *bindings = nullptr,
+    const vertex_input_attribute_description *attributes = nullptr
+) {
+  constexpr vertex_input_binding_description position_binding{
+      .binding = 0,
+      .input_rate = vertex_input_rate::vertex,
+      .stride = sizeof(vec4),
+  };
+  constexpr vertex_input_attribute_description position_attribute{
+      .location = 0,
+      .binding = 0,
+      .offset = 0,
+  };
+
+  const auto frag = fragment_lanes ? dsl_shader_module::load<bench_shaders::color_frag>()
+                                    : dsl_shader_module::load<&bench_shaders::color_frag<float>::main>();
+  return pipelines.create(graphics_pipeline::create_info{
+      .vertex_input_state{
+          .bindings_count = bindings_count,
+          .attributes_count = attributes_count,
+          .bindings = bindings ? bindings : &position_binding,
+          .attributes = attributes ? attributes : &position_attribute,
+      },
+      .input_assembly_state{
+          .topology = primitive_topology::triangle_list,
+      },
+      .shader_stage{
+          .vertex_shader = vert,
+          .fragment_shader = frag,
+      },
+      .rasterization_state{
+          .cull_mode = cull,
+      },
+      .render_pass = render_pass,
+  });
+}
+
+graphics_pipeline create_transform_pipeline(const render_pass &render_pass, cull_mode cull) {
+  const auto vert = dsl_shader_module::load<&bench_shaders::transform_vert::main>();
+  return create_pipeline(render_pass, vert, cull);
+}
+
+/// 在 NDC 中按行列添加一个矩形的两个三角形
+void push_quad(std::vector<vec4> &out, float l, float t, float r, float b, float z) {
+  out.push_back({l, t, z, 1});
+  out.push_back({r, t, z, 1});
+  out.push_back({r, b, z, 1});
+  out.push_back({l, t, z, 1});
+  out.push_back({r, b, z, 1});
+  out.push_back({l, b, z, 1});
+}
+
+/// 填满整个屏幕的矩形，几乎只有片元处理的开销
+class fullscreen_quad : public workload {
+public:
+
+  explicit fullscreen_quad(const render_pass &render_pass)
+      : pipeline_(create_transform_pipeline(render_pass, cull_modes::none)) {
+    push_quad(vertices_, -1, -1, 1, 1, .5f);
+  }
+
+  const char *name() const noexcept override { return "fullscreen_quad"; }
+
+  std::uint64_t triangles() const noexcept override { return 2; }
+
+  void render(render_pass::state &state, std::uint32_t) override {
+    state.bind_descriptor_set(0, reinterpret_cast<const std::byte *>(&identity));
+    state.bind_descriptor_set(1, reinterpret_cast<const std::byte *>(&tint_));
+    state.bind_vertex_buffer(0, reinterpret_cast<const std::byte *>(vertices_.data()));
+    state.draw(pipeline_, vertices_.size(), 1, 0, 0);
+  }
+
+private:
+
+  static constexpr vec4 tint_{.2f, .4f, .6f, 1};
+
+  graphics_pipeline pipeline_;
+  std::vector<vec4> vertices_;
+};
+
+/// 铺满屏幕的一百万个三角形，每个只覆盖一两个像素，考验三角形建立的开销
+class tiny_triangles : public workload {
+public:
+
+  explicit tiny_triangles(const render_pass &render_pass)
+      : pipeline_(create_transform_pipeline(render_pass, cull_modes::none)) {
+    vertices_.reserve(columns * rows * 6);
+    for (std::uint32_t y = 0; y != rows; ++y) {
+      for (std::uint32_t x = 0; x != columns; ++x) {
+        auto l = -1 + 2.f * x / columns, r = -1 + 2.f * (x + 1) / columns;
+        auto t = -1 + 2.f * y / rows, b = -1 + 2.f * (y + 1) / rows;
+        push_quad(vertices_, l, t, r, b, .25f + .5f * (x ^ y) / (columns + rows));
+      }
+    }
+  }
+
+  const char *name() const noexcept override { return "tiny_triangles"; }
+
+  std::uint64_t triangles() const noexcept override { return columns * rows * 2; }
+
+  void render(render_pass::state &state, std::uint32_t) override {
+    state.bind_descriptor_set(0, reinterpret_cast<const std::byte *>(&identity));
+    state.bind_descriptor_set(1, reinterpret_cast<const std::byte *>(&tint_));
+    state.bind_vertex_buffer(0, reinterpret_cast<const std::byte *>(vertices_.data()));
+    state.draw(pipeline_, vertices_.size(), 1, 0, 0);
+  }
+
+private:
+
+  static constexpr std::uint32_t columns = 1000;
+  static constexpr std::uint32_t rows = 500;
+  static constexpr vec4 tint_{.6f, .3f, .2f, 1};
+
+  graphics_pipeline pipeline_;
+  std::vector<vec4> vertices_;
+};
+
+/// 从远到近叠放的全屏矩形，每层都能通过深度测试，每个像素被着色 layers 次
+class overdraw_stack : public workload {
+public:
+
+  explicit overdraw_stack(const render_pass &render_pass)
+      : pipeline_(create_transform_pipeline(render_pass, cull_modes::none)) {
+    push_quad(vertices_, -1, -1, 1, 1, 0);
+    for (std::uint32_t i = 0; i != layers; ++i) {
+      auto z = 1 - (i + 1.f) / (layers + 1);
+      layers_[i].transform = {{
+          {1, 0, 0, 0},
+          {0, 1, 0, 0},
+          {0, 0, 1, z},
+          {0, 0, 0, 1},
+      }};
+      auto k = float(i) / layers;
+      layers_[i].tint = {k, 1 - k, .5f, 1};
+    }
+  }
+
+  const char *name() const noexcept override { return "overdraw_stack"; }
+
+  std::uint64_t triangles() const noexcept override { return layers * 2; }
+
+  void render(render_pass::state &state, std::uint32_t) override {
+    state.bind_vertex_buffer(0, reinterpret_cast<const std::byte *>(vertices_.data()));
+    for (auto &layer : layers_) {
+      state.bind_descriptor_set(0, reinterpret_cast<const std::byte *>(&layer.transform));
+      state.bind_descriptor_set(1, reinterpret_cast<const std::byte *>(&layer.tint));
+      state.draw(pipeline_, vertices_.size(), 1, 0, 0);
+    }
+  }
+
+private:
+
+  static constexpr std::uint32_t layers = 32;
+
+  struct layer {
+    mat4 transform;
+    vec4 tint;
+  };
+
+  graphics_pipeline pipeline_;
+  std::vector<vec4> vertices_;
+  layer layers_[layers];
+};
+
+/// 用实例化绘制的大量立方体，从斜上方俯视
+class instanced_crowd : public workload {
+public:
+
+  instanced_crowd(const render_pass &render_pass, float aspect) {
+    constexpr vertex_input_binding_description bindings[]{
+        {
+            .binding = 0,
+            .input_rate = vertex_input_rate::vertex,
+            .stride = sizeof(vec4),
+        },
+        {
+            .binding = 1,
+            .input_rate = vertex_input_rate::instance,
+            .stride = sizeof(instance),
+        },
+    };
+    constexpr vertex_input_attribute_description attributes[]{
+        {.location = 0, .binding = 0, .offset = 0},
+        {.location = 1, .binding = 1, .offset = offsetof(instance, placement)},
+        {.location = 2, .binding = 1, .offset = offsetof(instance, tint)},
+    };
+    const auto vert = dsl_shader_module::load<&bench_shaders::instanced_vert::main>();
+    pipeline_ = create_pipeline(render_pass, vert, cull_modes::back, 2, 3, bindings, attributes);
+
+    // 立方体的 6 个面，每个面的四个顶点从外侧看按同一方向环绕
+    constexpr vec4 corners[]{
+        {-1, -1, -1, 1}, {1, -1, -1, 1}, {1, 1, -1, 1}, {-1, 1, -1, 1},
+        {-1, -1, 1, 1}, {1, -1, 1, 1}, {1, 1, 1, 1}, {-1, 1, 1, 1},
+    };
+    constexpr std::uint8_t faces[][4]{
+        {0, 3, 2, 1}, {4, 5, 6, 7}, {0, 1, 5, 4},
+        {3, 7, 6, 2}, {0, 4, 7, 3}, {1, 2, 6, 5},
+    };
+    for (auto &face : faces) {
+      for (auto i : {0, 1, 2, 0, 2, 3}) {
+        mesh_.push_back(corners[face[i]]);
+      }
+    }
+
+    random_stream random(29);
+    instances_.reserve(side * side);
+    for (std::uint32_t z = 0; z != side; ++z) {
+      for (std::uint32_t x = 0; x != side; ++x) {
+        instances_.push_back({
+            .placement = {
+                (x - side / 2.f) * 1.5f + random.next(-.3f, .3f),
+                random.next(0, .5f),
+                z * 1.5f + 4,
+                random.next(.3f, .6f),
+            },
+            .tint = {random.next(0, 1), random.next(0, 1), random.next(0, 1), 1},
+        });
+      }
+    }
+
+    view_projection_ = perspective(std::numbers::pi_v<float> / 3, aspect, .5f, 300) *
+                       look_down({0, 12, -6}, std::numbers::pi_v<float> / 7);
+  }
+
+  const char *name() const noexcept override { return "instanced_crowd"; }
+
+  std::uint64_t triangles() const noexcept override { return mesh_.size() / 3 * instances_.size(); }
+
+  void render(render_pass::state &state, std::uint32_t) override {
+    state.bind_descriptor_set(0, reinterpret_cast<const std::byte *>(&view_projection_));
+    state.bind_vertex_buffer(0, reinterpret_cast<const std::byte *>(mesh_.data()));
+    state.bind_vertex_buffer(1, reinterpret_cast<const std::byte *>(instances_.data()));
+    state.draw(pipeline_, mesh_.size(), instances_.size(), 0, 0);
+  }
+
+private:
+
+  static constexpr std::uint32_t side = 128;
+
+  struct instance {
+    vec4 placement;
+    vec4 tint;
+  };
+
+  graphics_pipeline pipeline_;
+  mat4 view_projection_;
+  std::vector<vec4> mesh_;
+  std::vector<instance> instances_;
+};
+
+/// 相机穿过一片随机分布的大三角形，大量三角形与近平面和侧面相交而需要裁剪
+class near_plane_sweep : public workload {
+public:
+
+  near_plane_sweep(const render_pass &render_pass, float aspect)
+      : pipeline_(create_transform_pipeline(render_pass, cull_modes::none)),
+        projection_(perspective(std::numbers::pi_v<float> / 2, aspect, .1f, 100)) {
+    random_stream random(31);
+    vertices_.reserve(count * 3);
+    for (std::uint32_t i = 0; i != count; ++i) {
+      vec3 center{random.next(-8, 8), random.next(-5, 5), random.next(0, depth)};
+      for (int k = 0; k != 3; ++k) {
+        vertices_.push_back({
+            center.x + random.next(-3, 3),
+            center.y + random.next(-3, 3),
+            center.z + random.next(-3, 3),
+            1,
+        });
+      }
+    }
+  }
+
+  const char *name() const noexcept override { return "near_plane_sweep"; }
+
+  std::uint64_t triangles() const noexcept override { return count; }
+
+  void render(render_pass::state &state, std::uint32_t frame) override {
+    // 相机沿 z 轴匀速前进，走完场景后回到起点
+    auto z = std::fmod(frame * .75f, depth);
+    mvp_ = projection_ * translate(vec3{0, 0, -z});
+    state.bind_descriptor_set(0, reinterpret_cast<const std::byte *>(&mvp_));
+    state.bind_descriptor_set(1, reinterpret_cast<const std::byte *>(&tint_));
+    state.bind_vertex_buffer(0, reinterpret_cast<const std::byte *>(vertices_.data()));
+    state.draw(pipeline_, vertices_.size(), 1, 0, 0);
+  }
+
+private:
+
+  static constexpr std::uint32_t count = 8192;
+  static constexpr float depth = 48;
+  static constexpr vec4 tint_{.3f, .5f, .3f, 1};
+
+  graphics_pipeline pipeline_;
+  mat4 projection_;
+  mat4 mvp_;
+  std::vector<vec4> vertices_;
+};
+
+/// 每次绘制只有两个三角形，并且都绑定各自的描述符，考验每次绘制的固定开销
+class many_draws : public workload {
+public:
+
+  explicit many_draws(const render_pass &render_pass)
+      : pipeline_(create_transform_pipeline(render_pass, cull_modes::none)) {
+    push_quad(vertices_, -1, -1, 1, 1, 0);
+    random_stream random(37);
+    objects_.reserve(side * side);
+    for (std::uint32_t y = 0; y != side; ++y) {
+      for (std::uint32_t x = 0; x != side; ++x) {
+        auto cell = 2.f / side;
+        vec3 center{-1 + cell * (x + .5f), -1 + cell * (y + .5f), random.next(.1f, .9f)};
+        objects_.push_back({
+            .transform = translate(center) * scale(vec3{cell * .45f, cell * .45f, 1}),
+            .tint = {random.next(0, 1), random.next(0, 1), random.next(0, 1), 1},
+        });
+      }
+    }
+  }
+
+  const char *name() const noexcept override { return "many_draws"; }
+
+  std::uint64_t triangles() const noexcept override { return objects_.size() * 2; }
+
+  void render(render_pass::state &state, std::uint32_t) override {
+    state.bind_vertex_buffer(0, reinterpret_cast<const std::byte *>(vertices_.data()));
+    for (auto &object : objects_) {
+      state.bind_descriptor_set(0, reinterpret_cast<const std::byte *>(&object.transform));
+      state.bind_descriptor_set(1, reinterpret_cast<const std::byte *>(&object.tint));
+      state.draw(pipeline_, vertices_.size(), 1, 0, 0);
+    }
+  }
+
+private:
+
+  static constexpr std::uint32_t side = 64;
+
+  struct object {
+    mat4 transform;
+    vec4 tint;
+  };
+
+  graphics_pipeline pipeline_;
+  std::vector<vec4> vertices_;
+  std::vector<object> objects_;
+};
+
+} // namespace
+
+std::vector<std::unique_ptr<workload>>
+create_workloads(const render_pass &render_pass, float aspect, bool lanes) {
+  fragment_lanes = lanes;
+  std::vector<std::unique_ptr<workload>> workloads;
+  workloads.push_back(std::make_unique<fullscreen_quad>(render_pass));
+  workloads.push_back(std::make_unique<tiny_triangles>(render_pass));
+  workloads.push_back(std::make_unique<overdraw_stack>(render_pass));
+  workloads.push_back(std::make_unique<instanced_crowd>(render_pass, aspect));
+  workloads.push_back(std::make_unique<near_plane_sweep>(render_pass, aspect));
+  workloads.push_back(std::make_unique<many_draws>(render_pass));
+  return workloads;
+}
@@ -3,6 +3,7 @@
 #define PLAID_H_
 
 // 数学库
+#include <plaid/lanes.h>
 #include <plaid/mat.h>
 #include <plaid/transition.h>
 #include <plaid/vec.h>
@@ -10,8 +11,11 @@
 // 基础功能
 #include <plaid/frame_buffer.h>
 #include <plaid/pipeline.h>
+#include <plaid/pipeline_cache.h>
 #include <plaid/render_pass.h>
 #include <plaid/shader.h>
+#include <plaid/statistics.h>
+#include <plaid/trace.h>
 
 #include <plaid/format.h>
 #include <plaid/utility.h>
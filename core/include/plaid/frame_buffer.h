@@ -17,7 +17,7 @@ public:
 
   /// \brief 创建一个帧缓冲区
   /// \param attachments_count 附件的总数目
-  /// \param attachments 所有附件的指针数组
+  /// \param attachments 所有附件的指针数组，瞬态附件 (见 render_pass::transient) 的指针可以为空
   /// \param width 帧缓冲区的宽度
   /// \param height 帧缓冲区的高度
   frame_buffer(
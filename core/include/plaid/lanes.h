@@ -0,0 +1,198 @@
+/// 按通道执行着色器时使用的 8 通道类型
+/// 所有运算都是逐通道的定长循环，由编译器按目标平台生成 SSE、AVX 等向量指令，
+/// 标量版本的同名函数使同一份着色器代码可以分别以 float 和 floatx8 实例化
+
+#pragma once
+#ifndef PLAID_LANES_H_
+#define PLAID_LANES_H_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "vec.h"
+
+namespace plaid {
+
+/// 一次按通道执行的调用数
+inline constexpr std::size_t lanes_count = 8;
+
+/// 逐通道比较的结果，每个通道为全 0 或全 1
+struct alignas(32) maskx8 {
+  std::int32_t v[lanes_count];
+
+  /// 按位组成的掩码，第 i 位对应第 i 个通道
+  [[nodiscard]] constexpr std::uint32_t bits() const noexcept {
+    std::uint32_t res = 0;
+    for (std::size_t i = 0; i != lanes_count; ++i) {
+      res |= (v[i] ? 1u : 0u) << i;
+    }
+    return res;
+  }
+
+  [[nodiscard]] friend constexpr maskx8 operator&(const maskx8 &a, const maskx8 &b) noexcept {
+    maskx8 res;
+    for (std::size_t i = 0; i != lanes_count; ++i) {
+      res.v[i] = a.v[i] & b.v[i];
+    }
+    return res;
+  }
+
+  [[nodiscard]] friend constexpr maskx8 operator|(const maskx8 &a, const maskx8 &b) noexcept {
+    maskx8 res;
+    for (std::size_t i = 0; i != lanes_count; ++i) {
+      res.v[i] = a.v[i] | b.v[i];
+    }
+    return res;
+  }
+
+  [[nodiscard]] friend constexpr maskx8 operator!(const maskx8 &a) noexcept {
+    maskx8 res;
+    for (std::size_t i = 0; i != lanes_count; ++i) {
+      res.v[i] = ~a.v[i];
+    }
+    return res;
+  }
+};
+
+/// 8 个通道的单精度浮点数，可以从 float 隐式广播
+struct alignas(32) floatx8 {
+  float v[lanes_count];
+
+  floatx8() = default;
+
+  constexpr floatx8(float s) noexcept {
+    for (auto &x : v) {
+      x = s;
+    }
+  }
+
+  [[nodiscard]] constexpr float &operator[](std::size_t i) noexcept { return v[i]; }
+
+  [[nodiscard]] constexpr const float &operator[](std::size_t i) const noexcept { return v[i]; }
+
+  [[nodiscard]] friend constexpr floatx8 operator-(const floatx8 &a) noexcept {
+    floatx8 res;
+    for (std::size_t i = 0; i != lanes_count; ++i) {
+      res.v[i] = -a.v[i];
+    }
+    return res;
+  }
+
+#define PLAID_LANES_ARITHMETIC(op)                                                            \
+  [[nodiscard]] friend constexpr floatx8 operator op(const floatx8 &a, const floatx8 &b) noexcept { \
+    floatx8 res;                                                                              \
+    for (std::size_t i = 0; i != lanes_count; ++i) {                                          \
+      res.v[i] = a.v[i] op b.v[i];                                                            \
+    }                                                                                         \
+    return res;                                                                               \
+  }                                                                                           \
+  friend constexpr floatx8 &operator op##=(floatx8 &a, const floatx8 &b) noexcept {          \
+    for (std::size_t i = 0; i != lanes_count; ++i) {                                          \
+      a.v[i] = a.v[i] op b.v[i];                                                              \
+    }                                                                                         \
+    return a;                                                                                 \
+  }
+
+  PLAID_LANES_ARITHMETIC(+)
+  PLAID_LANES_ARITHMETIC(-)
+  PLAID_LANES_ARITHMETIC(*)
+  PLAID_LANES_ARITHMETIC(/)
+#undef PLAID_LANES_ARITHMETIC
+
+#define PLAID_LANES_COMPARE(op)                                                               \
+  [[nodiscard]] friend constexpr maskx8 operator op(const floatx8 &a, const floatx8 &b) noexcept { \
+    maskx8 res;                                                                               \
+    for (std::size_t i = 0; i != lanes_count; ++i) {                                          \
+      res.v[i] = a.v[i] op b.v[i] ? -1 : 0;                                                   \
+    }                                                                                         \
+    return res;                                                                               \
+  }
+
+  PLAID_LANES_COMPARE(<)
+  PLAID_LANES_COMPARE(<=)
+  PLAID_LANES_COMPARE(>)
+  PLAID_LANES_COMPARE(>=)
+  PLAID_LANES_COMPARE(==)
+  PLAID_LANES_COMPARE(!=)
+#undef PLAID_LANES_COMPARE
+};
+
+using vec2x8 = vec<floatx8, 2>;
+using vec3x8 = vec<floatx8, 3>;
+using vec4x8 = vec<floatx8, 4>;
+
+/// 按掩码逐通道选择，掩码为真的通道取 a，否则取 b
+[[nodiscard]] constexpr floatx8 select(const maskx8 &m, const floatx8 &a, const floatx8 &b) noexcept {
+  floatx8 res;
+  for (std::size_t i = 0; i != lanes_count; ++i) {
+    res.v[i] = m.v[i] ? a.v[i] : b.v[i];
+  }
+  return res;
+}
+
+[[nodiscard]] constexpr float select(bool m, float a, float b) noexcept {
+  return m ? a : b;
+}
+
+/// 是否存在为真的通道
+[[nodiscard]] constexpr bool any(const maskx8 &m) noexcept {
+  return m.bits() != 0;
+}
+
+[[nodiscard]] constexpr bool any(bool m) noexcept {
+  return m;
+}
+
+/// 是否所有通道都为真
+[[nodiscard]] constexpr bool all(const maskx8 &m) noexcept {
+  return m.bits() == (1u << lanes_count) - 1;
+}
+
+[[nodiscard]] constexpr bool all(bool m) noexcept {
+  return m;
+}
+
+[[nodiscard]] constexpr floatx8 (min)(const floatx8 &a, const floatx8 &b) noexcept {
+  floatx8 res;
+  for (std::size_t i = 0; i != lanes_count; ++i) {
+    res.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i];
+  }
+  return res;
+}
+
+[[nodiscard]] constexpr float (min)(float a, float b) noexcept {
+  return a < b ? a : b;
+}
+
+[[nodiscard]] constexpr floatx8 (max)(const floatx8 &a, const floatx8 &b) noexcept {
+  floatx8 res;
+  for (std::size_t i = 0; i != lanes_count; ++i) {
+    res.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i];
+  }
+  return res;
+}
+
+[[nodiscard]] constexpr float (max)(float a, float b) noexcept {
+  return a > b ? a : b;
+}
+
+[[nodiscard]] constexpr floatx8 clamp(const floatx8 &x, const floatx8 &lo, const floatx8 &hi) noexcept {
+  return (min)((max)(x, lo), hi);
+}
+
+[[nodiscard]] constexpr float clamp(float x, float lo, float hi) noexcept {
+  return (min)((max)(x, lo), hi);
+}
+
+[[nodiscard]] inline floatx8 sqrt(const floatx8 &a) noexcept {
+  floatx8 res;
+  for (std::size_t i = 0; i != lanes_count; ++i) {
+    res.v[i] = std::sqrt(a.v[i]);
+  }
+  return res;
+}
+
+} // namespace plaid
+
+#endif // PLAID_LANES_H_
@@ -5,21 +5,29 @@
 #ifndef PLAID_PIPELINE_H_
 #define PLAID_PIPELINE_H_
 
+#include <memory>
+
 #include "utility.h"
 
 // 前向声明
 namespace plaid {
+class pipeline_cache;
 class render_pass;
-class shader_module;
+struct shader_module;
 enum class primitive_topology : std::uint8_t;
 }
 
 namespace plaid {
 
-/// 图形管道缓存
+/// 编译完成的图形管道
 class graphics_pipeline_cache;
 
-/// 图形管道缓存的包装，可移动不可复制，所有图形管道缓存的创建在内部管理
+/// 可以在派生管道中单独改变的光栅化状态
+struct pipeline_rasterization;
+
+/// 图形管道的句柄
+/// 编译完成的管道与光栅化状态都是不可变的，由 [pipeline_cache] 创建的管道之间可以共享，
+/// 复制句柄只增加引用计数，推迟到子通道结束的绘制也以此保证管道在使用期间有效
 class graphics_pipeline {
 public:
 
@@ -27,34 +35,41 @@ public:
   struct create_info;
 
   /// 创建一个空的管道指针
-  graphics_pipeline() : cache_(nullptr) {}
-
-  graphics_pipeline(const graphics_pipeline_cache &cache);
+  graphics_pipeline() = default;
 
-  /// 根据参数创建管道
+  /// 根据参数创建管道，不经过管道缓存
   /// @param info 图形管道参数
   explicit graphics_pipeline(const create_info &info);
 
-  graphics_pipeline(const graphics_pipeline &) = delete;
+  graphics_pipeline(const graphics_pipeline &) = default;
 
-  graphics_pipeline(graphics_pipeline &&) noexcept;
+  graphics_pipeline(graphics_pipeline &&) noexcept = default;
 
-  ~graphics_pipeline();
+  ~graphics_pipeline() = default;
 
-  graphics_pipeline &operator=(graphics_pipeline &&) noexcept;
+  graphics_pipeline &operator=(const graphics_pipeline &) = default;
 
-  /// 转换为管道缓存
-  [[nodiscard]] inline operator
-  graphics_pipeline_cache &() noexcept {
+  graphics_pipeline &operator=(graphics_pipeline &&) noexcept = default;
+
+  /// 编译完成的管道
+  [[nodiscard]] const graphics_pipeline_cache &cache() const noexcept {
     return *cache_;
   }
 
+  /// 光栅化状态
+  [[nodiscard]] const pipeline_rasterization &rasterization() const noexcept {
+    return *rasterization_;
+  }
+
   /// 获取顶点装配状态
-  [[nodiscard]] const primitive_topology &vertex_assembly() noexcept;
+  [[nodiscard]] const primitive_topology &vertex_assembly() const noexcept;
 
 private:
 
-  graphics_pipeline_cache *cache_;
+  friend class pipeline_cache;
+
+  std::shared_ptr<const graphics_pipeline_cache> cache_;
+  std::shared_ptr<const pipeline_rasterization> rasterization_;
 };
 
 /// 指定管道从顶点缓冲区读入新数据的频率
@@ -94,6 +109,13 @@ enum class primitive_topology : std::uint8_t {
   triangle_strip,
 };
 
+/// 索引缓冲区中索引的类型
+enum class index_type : std::uint8_t {
+  /// 顶点数不超过 65535 时使用，索引占用的内存与带宽减半
+  uint16,
+  uint32,
+};
+
 /// 描述视口
 struct viewport {
   /// 视口左上角在颜色附件中的位置
@@ -104,6 +126,15 @@ struct viewport {
   float min_depth, max_depth;
 };
 
+/// 深度偏移，偏移量为 constant_factor * r + slope_factor * m，
+/// 其中 r 为三角形深度处可分辨的最小深度差，m 为深度关于屏幕坐标的最大斜率
+struct depth_bias {
+  float constant_factor;
+  /// 偏移量的上限 (为负时是下限)，为 0 时不限制
+  float clamp;
+  float slope_factor;
+};
+
 /// 多边形的绘制模式
 enum class polygon_mode : std::uint8_t {
   fill,
@@ -138,6 +169,9 @@ struct graphics_pipeline::create_info {
   /// 顶点输入装配模式
   struct input_assembly_state {
     primitive_topology topology;
+    /// 为真时，索引绘制中所有位都为 1 的索引 (0xFFFF 或 0xFFFFFFFF) 结束当前图元，
+    /// 三角形带从下一个索引重新开始，三角形列表丢弃尚未凑满三个顶点的三角形
+    bool primitive_restart_enable;
   };
 
   /// 着色器规格
@@ -150,11 +184,13 @@ struct graphics_pipeline::create_info {
   struct rasterization_state {
     bool depth_clamp;
     bool rasterizer_discard;
-    polygon_mode polygon_mode;
-    cull_mode cull_mode;
+    plaid::polygon_mode polygon_mode;
+    plaid::cull_mode cull_mode;
+    /// 全部为 0 时不进行深度偏移
+    plaid::depth_bias depth_bias;
   };
 
-  /// 视口状态
+  /// 视口状态，目前只使用第一个视口与裁剪矩形，没有指定时使用整个帧缓冲区
   struct viewport_state {
     std::uint8_t viewports_count;
     std::uint8_t scissors_count;
@@ -167,7 +203,7 @@ struct graphics_pipeline::create_info {
   shader_stages shader_stage;
   rasterization_state rasterization_state;
   viewport_state viewport_state;
-  const render_pass &render_pass;
+  const plaid::render_pass &render_pass;
   std::uint8_t subpass;
 };
 
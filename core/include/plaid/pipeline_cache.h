@@ -0,0 +1,55 @@
+/// 图形管道缓存
+/// 参数相同的管道只编译一次，得到的管道共享同一份不可变的编译结果；
+/// 只改变光栅化状态的派生管道不需要重新编译
+
+#pragma once
+#ifndef PLAID_PIPELINE_CACHE_H_
+#define PLAID_PIPELINE_CACHE_H_
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "pipeline.h"
+
+namespace plaid {
+
+/// 按创建参数去重的管道缓存，可以在多个线程中同时使用
+/// 缓存销毁之后，已经创建的管道仍然有效
+class pipeline_cache {
+public:
+
+  pipeline_cache() = default;
+
+  pipeline_cache(const pipeline_cache &) = delete;
+
+  /// 创建图形管道，编译结果相同的参数只在第一次调用时编译
+  /// 光栅化状态与视口状态不参与比较，每个管道保留自己的一份
+  /// @param info 图形管道参数
+  [[nodiscard]] graphics_pipeline create(const graphics_pipeline::create_info &info);
+
+  /// 创建只改变光栅化状态的派生管道，与基础管道共享编译结果
+  /// @param base 基础管道
+  /// @param state 派生管道的光栅化状态
+  [[nodiscard]] static graphics_pipeline derive(
+      const graphics_pipeline &base, const struct graphics_pipeline::create_info::rasterization_state &state
+  );
+
+  /// 缓存中编译结果的个数
+  [[nodiscard]] std::size_t size() const;
+
+  /// 清空缓存，已经创建的管道不受影响
+  void clear();
+
+private:
+
+  mutable std::mutex mutex_;
+  /// 以编译结果所依赖的参数序列化得到的字节串为键
+  std::unordered_map<std::string, std::shared_ptr<const graphics_pipeline_cache>> pipelines_;
+};
+
+} // namespace plaid
+
+#endif // PLAID_PIPELINE_CACHE_H_
@@ -4,12 +4,20 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
 #include "format.h"
+#include "mat.h"
+#include "pipeline.h"
+#include "statistics.h"
+#include "utility.h"
 
 namespace plaid {
 class frame_buffer;
-class graphics_pipeline;
+class pipeline_context;
+class sort_last_renderer;
+class tile_binner;
+struct attachment_view;
 } // namespace plaid
 
 namespace plaid {
@@ -44,7 +52,7 @@ struct attachment_reference {
   /// 指明附件在帧缓冲区中的编号
   std::uint8_t id;
   /// 指明附件格式
-  format format;
+  plaid::format format;
 };
 
 /// 描述一个渲染子通道
@@ -61,9 +69,20 @@ struct subpass_description {
   const attachment_reference *depth_stencil_attachment;
 };
 
+using dependency_flag = std::uint8_t;
+
+/// 子通道依赖的位掩码
+struct dependency_flags {
+  static constexpr dependency_flag none = 0;
+  /// 依赖只发生在同一像素内，目标子通道只会读取源子通道在相同位置写入的内容，
+  /// 满足这个条件的相邻子通道将被合并，以分块的方式在缓存中完成渲染
+  static constexpr dependency_flag by_region = 1;
+};
+
 struct subpass_dependency {
   std::uint8_t src_subpass;
   std::uint8_t dst_subpass;
+  dependency_flag flags;
 };
 
 /// 记录一个多通道渲染
@@ -77,7 +96,9 @@ public:
       : attachments_count_(0),
         subpasses_count_(0),
         attachments_(nullptr),
-        subpasses_(nullptr) {}
+        subpasses_(nullptr),
+        attachment_usages_(nullptr),
+        merged_last_(nullptr) {}
 
   /// 根据参数创建多通道渲染
   /// @param info 创建参数
@@ -103,15 +124,42 @@ public:
     return subpasses_[index];
   }
 
+  /// 判断附件是否为瞬态附件。瞬态附件只在一个子通道组内被引用，既不加载也不写回，
+  /// 渲染时只存在于分块内存中，帧缓冲区中对应的附件指针可以为空
+  /// @param attachment 附件编号
+  [[nodiscard]] bool transient(std::uint8_t attachment) const;
+
   /// 记录渲染通道状态
   class state;
 
 private:
 
+  /// 附件在渲染通道中被引用的子通道范围
+  struct attachment_usage {
+    std::uint8_t first_subpass;
+    std::uint8_t last_subpass;
+    /// 是否被作为深度/模板附件引用，此时采用 stencil_load_op 与 stencil_store_op
+    bool depth_stencil;
+  };
+
+  /// 判断附件的内容能否只保存在分块内存中，即附件只在子通道组 [first, last] 内被引用，
+  /// 既不需要加载之前的内容，也不需要写回
+  [[nodiscard]] bool tile_resident(std::uint8_t attachment, std::uint8_t first, std::uint8_t last) const;
+
+  /// 判断子通道组 [first, last] 是否需要分块渲染，多个子通道合并或者存在瞬态附件时都需要
+  [[nodiscard]] bool tiled(std::uint8_t first, std::uint8_t last) const;
+
   std::uint8_t attachments_count_;
   std::uint8_t subpasses_count_;
   const attachment_description *attachments_;
   const subpass_description *subpasses_;
+  /// 每个附件被引用的子通道范围
+  const attachment_usage *attachment_usages_;
+  /// 每个子通道所在的合并组中，最后一个子通道的编号
+  const std::uint8_t *merged_last_;
+
+  friend class sort_last_renderer;
+  friend class tile_binner;
 };
 
 struct render_pass::create_info {
@@ -140,56 +188,249 @@ struct clear_value {
   depth_stencil depth_stencil;
 };
 
+/// 实例包围球，绘制时在执行顶点着色器之前跳过完全位于视锥之外的实例
+struct instance_bounds {
+  /// 第 i 个实例的包围球从 spheres + i * stride 开始，依次为球心的 x, y, z 与半径，为空时不剔除
+  const std::byte *spheres;
+  /// 相邻两个包围球之间的字节数
+  std::uint32_t stride;
+  /// 把包围球所在的空间变换到裁剪空间的矩阵，应当与顶点着色器使用的变换一致
+  mat4 clip_transform;
+};
+
+/// 网格簇 (meshlet)：索引缓冲区中连续的一段三角形列表，以及整体剔除用的包围体，
+/// 包围体与顶点位置在同一个空间中
+struct cluster {
+  /// 第一个索引在索引缓冲区中的位置
+  std::uint32_t first_index;
+  /// 索引数，是 3 的倍数
+  std::uint32_t indices_count;
+  /// 包含所有三角形的包围球
+  vec3 center;
+  float radius;
+  /// 所有三角形的法线 (cross(b - a, c - a) 的方向) 与 cone_axis 的夹角余弦都不小于 cone_cos，
+  /// cone_cos 不大于 0 时不做背面剔除
+  vec3 cone_axis;
+  float cone_cos;
+};
+
+/// 间接绘制中一次绘制的参数，与 [render_pass::state::draw] 的参数一一对应
+struct draw_indirect_command {
+  std::uint32_t vertices_count;
+  std::uint32_t instances_count;
+  std::uint32_t first_vertex;
+  std::uint32_t first_instance;
+};
+
+/// 间接索引绘制中一次绘制的参数，与 [render_pass::state::draw_indexed] 的参数一一对应
+struct draw_indexed_indirect_command {
+  std::uint32_t indices_count;
+  std::uint32_t instances_count;
+  std::uint32_t first_index;
+  std::int32_t vertex_offset;
+  std::uint32_t first_instance;
+};
+
+/// 不需要分块渲染的子通道中绘制的执行方式
+enum class render_mode : std::uint8_t {
+  /// 每次绘制在提交时立即渲染到帧缓冲区
+  immediate = 0,
+  /// 绘制先被记录，子通道结束时按提交顺序分给多个线程，各自渲染到私有的颜色与深度附件，
+  /// 最后逐像素比较深度合成到帧缓冲区 (sort-last)。只对有深度附件的子通道生效，
+  /// 绘制引用的内存在子通道结束之前都不能改变
+  sort_last = 1,
+};
+
 class render_pass::state {
 public:
 
   struct begin_info {
-    const render_pass &render_pass;
-    const frame_buffer &frame_buffer;
+    const plaid::render_pass &render_pass;
+    const plaid::frame_buffer &frame_buffer;
     std::uint8_t clear_values_count;
     const clear_value *clear_values;
+    /// 不需要分块渲染的子通道中绘制的执行方式，需要分块渲染的子通道组总是分块渲染
+    render_mode mode = render_mode::immediate;
   };
 
   state(const begin_info &);
 
+  state(const state &) = delete;
+
+  /// 销毁状态，不渲染任何内容：尚未提交的分块渲染与 sort-last 渲染被丢弃，
+  /// 需要结果时应当先调用 [end] 或者越过最后一个子通道的 [next_subpass]
+  ~state();
+
   /// 绑定描述符集
   void bind_descriptor_set(std::uint8_t binding, const std::byte *);
 
   /// 绑定顶点缓冲区
   void bind_vertex_buffer(std::uint8_t binding, const std::byte *);
 
+  /// 绑定索引缓冲区，[draw_indexed] 与 [draw_indexed_indirect] 从中读取索引
+  /// @param buffer 第一个索引的地址，按索引类型对齐
+  /// @param type 索引类型
+  void bind_index_buffer(const std::byte *buffer, index_type type);
+
+  /// 绑定实例包围球，之后的绘制按实例编号读取包围球并剔除视锥之外的实例
+  void bind_instance_bounds(const instance_bounds &);
+
   /// 根据当前渲染通道状态，绘制一帧
   void draw(
-      graphics_pipeline &,
+      const graphics_pipeline &,
       std::uint32_t vertices_count, std::uint32_t instances_count,
       std::uint32_t first_vertex, std::uint32_t first_instance
   );
 
   /// 根据当前渲染通道状态和索引缓冲区，绘制一帧
   void draw_indexed(
-      graphics_pipeline &,
+      const graphics_pipeline &,
       std::uint32_t indices_count, std::uint32_t instances_count,
       std::uint32_t first_index, std::int32_t vertex_offset,
       std::uint32_t first_instance
   );
 
-  /// 移动状态到下一个渲染子通道
+  /// 依次执行内存中的多组绘制参数，绘制状态只准备一次，统计中算作一次绘制
+  /// @param commands 第一组 [draw_indirect_command] 的地址，不要求对齐
+  /// @param draws_count 绘制参数的组数
+  /// @param stride 相邻两组参数之间的字节数
+  void draw_indirect(
+      const graphics_pipeline &, const std::byte *commands, std::uint32_t draws_count,
+      std::uint32_t stride = sizeof(draw_indirect_command)
+  );
+
+  /// 依次执行内存中的多组索引绘制参数，绘制状态只准备一次，统计中算作一次绘制
+  /// @param commands 第一组 [draw_indexed_indirect_command] 的地址，不要求对齐
+  /// @param draws_count 绘制参数的组数
+  /// @param stride 相邻两组参数之间的字节数
+  void draw_indexed_indirect(
+      const graphics_pipeline &, const std::byte *commands, std::uint32_t draws_count,
+      std::uint32_t stride = sizeof(draw_indexed_indirect_command)
+  );
+
+  /// 先剔除位于视锥之外以及所有三角形都会被面剔除的网格簇，再用剩下的簇做一次索引绘制，
+  /// 被剔除的簇不读取也不变换任何顶点，只支持三角形列表
+  /// @param clusters 网格簇数组
+  /// @param clusters_count 网格簇个数
+  /// @param clip_transform 把包围体所在的空间变换到裁剪空间的矩阵，应当与顶点着色器使用的变换一致
+  /// @param vertex_offset 加到每个索引上的偏移
+  void draw_clusters(
+      const graphics_pipeline &, const cluster *clusters, std::uint32_t clusters_count,
+      const mat4 &clip_transform, std::int32_t vertex_offset = 0
+  );
+
+  /// 设置视口，之后的绘制不再使用管道中的视口，直到调用 [reset_dynamic_state]
+  void set_viewport(const viewport &);
+
+  /// 设置裁剪矩形，之后的绘制只写入矩形之内的像素
+  void set_scissor(const rect2d &);
+
+  /// 设置面剔除模式，覆盖管道中的值
+  void set_cull_mode(cull_mode);
+
+  /// 设置深度偏移，覆盖管道中的值
+  void set_depth_bias(const depth_bias &);
+
+  /// 清除所有动态设置的状态，之后的绘制恢复使用管道中的值
+  void reset_dynamic_state() noexcept;
+
+  /// 移动状态到下一个渲染子通道，越过最后一个子通道时与 [end] 相同
   void next_subpass();
 
+  /// 结束渲染通道，完成所有尚未提交的分块渲染与 sort-last 渲染。
+  /// 结束之后的绘制与 [next_subpass] 会抛出异常，重复调用 end 没有影响，
+  /// 再次渲染需要重新创建状态
+  void end();
+
+#ifdef PLAID_PIPELINE_STATISTICS
+  /// 渲染通道中已经提交的绘制次数
+  [[nodiscard]] std::uint32_t draws_count() const noexcept;
+
+  /// 获取一次绘制的统计，分块渲染的绘制在子通道组结束 (或 end) 之后光栅化阶段的计数才完整，
+  /// sort-last 渲染的绘制在子通道结束之后所有计数才完整
+  /// @param draw 绘制在渲染通道中的提交顺序
+  [[nodiscard]] const pipeline_statistics &draw_statistics(std::uint32_t draw) const;
+
+  /// 渲染通道中所有绘制的统计之和
+  [[nodiscard]] pipeline_statistics statistics() const;
+#endif
+
 private:
 
+  /// 创建在 parent 的当前子通道中渲染到另一个帧缓冲区的状态，不清除任何附件，
+  /// sort-last 渲染时每个线程使用一个
+  state(const state &parent, const plaid::frame_buffer &frame_buffer);
+
+  /// 进入当前子通道，按需清除附件或者开始记录分块渲染
+  void begin_subpass();
+
+  /// 完成当前子通道 (组) 中尚未提交的分块渲染或 sort-last 渲染
+  void flush();
+
+  /// 获取整个帧缓冲区上的附件视图，在当前子通道之后不再被使用且不需要写回的颜色附件视图为空
+  /// @param views 接收视图的数组，以附件编号为下标
+  void frame_views(attachment_view *views) const;
+
+  /// 清除在指定子通道中第一次被引用，并且需要清除的附件
+  /// @param subpass 子通道编号
+  /// @param views 以附件编号为下标的视图数组
+  /// @param area 需要清除的区域
+  void clear_attachments(std::uint8_t subpass, const attachment_view *views, const rect2d &area) const;
+
+  const render_pass *render_pass_;
   const attachment_description *attachment_descriptions_;
   const subpass_description *first_subpass_;
   const subpass_description *current_subpass_;
   const subpass_description *last_subpass_;
   const std::byte *descriptor_set_[1 << 8];
   const std::byte *vertex_buffer_[1 << 8];
+  const std::byte *index_buffer_;
+  index_type index_type_;
   const frame_buffer *frame_buffer_;
 
   std::uint8_t clear_values_count_;
   const clear_value *clear_values_;
 
+  /// 动态状态位，置位的状态在绘制时覆盖管道中的值
+  static constexpr std::uint8_t dynamic_viewport = 1;
+  static constexpr std::uint8_t dynamic_scissor = 2;
+  static constexpr std::uint8_t dynamic_cull_mode = 4;
+  static constexpr std::uint8_t dynamic_depth_bias = 8;
+  std::uint8_t dynamic_state_;
+  viewport viewport_;
+  rect2d scissor_;
+  cull_mode cull_mode_;
+  depth_bias depth_bias_;
+
+  /// 实例包围球，为空时不剔除
+  const std::byte *instance_bounds_;
+  std::uint32_t instance_bounds_stride_;
+  /// 包围球所在空间中视锥的六个平面，xyz 为单位法线，指向视锥内侧
+  vec4 instance_planes_[6];
+
+  /// 网格簇剔除之后剩下的绘制参数，保留内存供之后的绘制使用
+  std::vector<draw_indexed_indirect_command> cluster_commands_;
+
+  /// 当前子通道组被合并时，记录所有图元直到子通道组结束再分块渲染
+  tile_binner *binner_;
+  /// 不需要分块渲染的子通道中绘制的执行方式
+  render_mode mode_;
+  /// 以 sort-last 方式渲染当前子通道时，记录所有绘制直到子通道结束
+  sort_last_renderer *sort_last_;
+  /// 管道执行时的可变状态，不同线程使用各自的渲染通道状态即可同时使用同一个管道
+  pipeline_context *context_;
+  /// 多线程绘制实例时每个工作线程的上下文，第一次需要时才创建
+  mutable pipeline_context *worker_contexts_;
+  mutable std::uint32_t worker_contexts_count_;
+
+#ifdef PLAID_PIPELINE_STATISTICS
+  /// 每次绘制的统计，绘制和分块渲染时由管道累加
+  mutable std::vector<pipeline_statistics> draw_statistics_;
+#endif
+
   friend class graphics_pipeline_cache;
+  friend class sort_last_renderer;
+  friend class tile_binner;
 };
 
 } // namespace plaid
@@ -8,8 +8,11 @@
 #include "format.h"
 
 #ifdef PLAID_SHADER_DSL
+#include <array>
 #include <type_traits>
+#include <utility>
 
+#include "lanes.h"
 #include "mat.h"
 #include "vec.h"
 #endif
@@ -27,40 +30,64 @@ using const_memory_array = const_memory[N];
 
 /// 定义一个着色器输入/输出变量的规格
 struct shader_stage_variable_description {
-  /// 变量插值函数
-  using interpolation_function = void(
-      const const_memory_array<3> &src,
-      const float (&weight)[3],
-      memory dst
-  );
-
   /// 属性的格式
-  format format;
+  plaid::format format;
   /// 属性的编号
   std::uint8_t location;
   /// 属性的字节大小
   std::uint32_t size;
   /// 属性的字节对齐大小
   std::uint32_t align;
-  /// 属性插值函数，只对片元着色器输入有效
-  interpolation_function *interpolation;
+  /// 属性由连续的 float 分量组成时的分量数，只对片元着色器输入有效
+  /// 这些分量逐个进行透视校正插值，为 0 时不插值，直接使用三角形第一个顶点的值
+  std::uint32_t components;
+  /// 属性在输入块或输出块中的字节偏移
+  std::uint32_t offset;
+};
+
+/// 定义一个着色器常量的规格
+struct shader_uniform_description {
+  /// 绑定点编号
+  std::uint8_t binding;
+  /// 为真时常量块中只保存描述符的地址，用于大小未知或者过大的常量
+  bool indirect;
+  /// 复制到常量块中的字节数
+  std::uint32_t size;
+  /// 常量的字节对齐大小
+  std::uint32_t align;
+  /// 常量在常量块中的字节偏移
+  std::uint32_t offset;
 };
 
 /// 定义一个着色器内所有变量的规格
+/// 输入、输出与常量各自位于一块连续内存，变量按照描述中的偏移存放
 struct shader_variables_meta {
   std::uint8_t inputs_count;
   std::uint8_t outputs_count;
-  shader_stage_variable_description *inputs;
-  shader_stage_variable_description *outputs;
+  std::uint8_t uniforms_count;
+  /// 输入块的字节大小
+  std::uint32_t inputs_size;
+  /// 输出块的字节大小
+  std::uint32_t outputs_size;
+  /// 常量块的字节大小
+  std::uint32_t uniforms_size;
+  /// 三块内存共同的字节对齐大小
+  std::uint32_t align;
+  const shader_stage_variable_description *inputs;
+  const shader_stage_variable_description *outputs;
+  const shader_uniform_description *uniforms;
 };
 
 /// 保存着色器信息，管道对象可以据此为属性分配内存
 struct shader_module {
   /// 着色器入口函数
+  /// @param uniform 常量块
+  /// @param input 输入块
+  /// @param output 输出块
   using entry_function = void(
-      const const_memory_array<1 << 8> &uniform,
-      const const_memory_array<1 << 8> &input,
-      const memory_array<1 << 8> &output,
+      const_memory uniform,
+      const_memory input,
+      memory output,
       memory *mutable_builtin
   );
 
@@ -68,10 +95,159 @@ struct shader_module {
 
   shader_variables_meta variables_meta;
   entry_function *entry;
+  /// 一次执行 [lanes_count] 个调用的入口函数，为空时只能逐个调用 [entry]
+  /// 输入输出的每个 float 分量在内存中连续存放所有通道的值，因此变量的偏移是 [variables_meta]
+  /// 中的 [lanes_count] 倍，常量块不变，目前只对片元着色器有效
+  entry_function *lanes_entry = nullptr;
+  /// 只计算裁剪空间坐标的入口函数，与 [entry] 使用相同的输入块与常量块，不需要写入输出块，
+  /// 计算结果应当与 [entry] 相同，目前只对顶点着色器有效
+  /// 不为空时管道先对每个顶点只执行它，三角形通过裁剪与面剔除之后才对它的顶点执行 [entry]，
+  /// 适合输出很多或者计算量大的顶点着色器
+  entry_function *position_entry = nullptr;
 };
 
 #ifdef PLAID_SHADER_DSL
 
+// 匹配不同类型变量的 format，没有对应格式的类型只能作为顶点着色器输出
+template <class>
+struct attribute_format_matcher {
+  static constexpr auto format = plaid::format::undefined;
+};
+
+template <>
+struct attribute_format_matcher<vec2> {
+  static constexpr auto format = plaid::format::RG32f;
+};
+
+template <>
+struct attribute_format_matcher<vec3> {
+  static constexpr auto format = plaid::format::RGB32f;
+};
+
+template <>
+struct attribute_format_matcher<vec4> {
+  static constexpr auto format = plaid::format::RGBA32f;
+};
+
+// 计算变量包含的 float 分量数，不是由 float 组成的类型不能插值，结果为 0
+template <class Tp>
+struct interpolation_components : std::integral_constant<std::uint32_t, 0> {};
+
+template <>
+struct interpolation_components<float> : std::integral_constant<std::uint32_t, 1> {};
+
+template <std::size_t N>
+struct interpolation_components<vec<float, N>>
+    : std::integral_constant<std::uint32_t, sizeof(vec<float, N>) / sizeof(float)> {};
+
+template <std::size_t N, std::size_t M>
+struct interpolation_components<mat<float, N, M>>
+    : std::integral_constant<std::uint32_t, sizeof(mat<float, N, M>) / sizeof(float)> {};
+
+template <class Tp, std::size_t N>
+struct interpolation_components<Tp[N]>
+    : std::integral_constant<std::uint32_t, interpolation_components<Tp>::value * N> {};
+
+/// 在编译期收集着色器类的所有成员并排布输入块、输出块与常量块
+/// 着色器类会以它构造两次：第一次每个成员登记自己的规格，排布完成之后，
+/// 第二次成员按照相同的构造顺序取回自己的偏移
+class shader_layout_builder {
+public:
+  /// 超过这个字节数的常量不复制到常量块，只保存描述符的地址
+  static constexpr std::uint32_t uniform_copy_limit = 256;
+
+  /// 片元着色器可以插值的输入位于输入块开头，这部分的长度取整到这个字节数，
+  /// 使管道可以按 8 个 float 一组进行插值
+  static constexpr std::uint32_t varyings_align = 32;
+
+  constexpr std::uint32_t input(const shader_stage_variable_description &desc) noexcept {
+    return add(inputs, inputs_count, next_input, desc);
+  }
+
+  constexpr std::uint32_t output(const shader_stage_variable_description &desc) noexcept {
+    return add(outputs, outputs_count, next_output, desc);
+  }
+
+  constexpr std::uint32_t uniform(const shader_uniform_description &desc) noexcept {
+    return add(uniforms, uniforms_count, next_uniform, desc);
+  }
+
+  /// 计算每个变量的偏移以及各块的大小
+  /// @param fragment 是否为片元着色器，此时可以插值的输入排在其它输入之前
+  constexpr void arrange(bool fragment) noexcept {
+    if (fragment) {
+      inputs_size = place(inputs, inputs_count, 0, [](auto &d) { return d.components != 0; });
+      inputs_size = round_up(inputs_size, varyings_align);
+      inputs_size = place(inputs, inputs_count, inputs_size, [](auto &d) { return d.components == 0; });
+    } else {
+      inputs_size = place(inputs, inputs_count, 0, [](auto &) { return true; });
+    }
+    outputs_size = place(outputs, outputs_count, 0, [](auto &) { return true; });
+    uniforms_size = place(uniforms, uniforms_count, 0, [](auto &) { return true; });
+    inputs_size = round_up(inputs_size, align);
+    outputs_size = round_up(outputs_size, align);
+    uniforms_size = round_up(uniforms_size, align);
+    arranged = true;
+  }
+
+  shader_stage_variable_description inputs[1 << 8]{};
+  shader_stage_variable_description outputs[1 << 8]{};
+  shader_uniform_description uniforms[1 << 8]{};
+  std::uint32_t inputs_count = 0;
+  std::uint32_t outputs_count = 0;
+  std::uint32_t uniforms_count = 0;
+  std::uint32_t inputs_size = 0;
+  std::uint32_t outputs_size = 0;
+  std::uint32_t uniforms_size = 0;
+  std::uint32_t align = 1;
+
+private:
+  static constexpr std::uint32_t round_up(std::uint32_t n, std::uint32_t al) noexcept {
+    return (n + al - 1) / al * al;
+  }
+
+  template <class Desc>
+  constexpr std::uint32_t add(Desc *list, std::uint32_t &count, std::uint32_t &next, const Desc &desc) noexcept {
+    if (arranged) {
+      return list[next++].offset;
+    }
+    list[count++] = desc;
+    return 0;
+  }
+
+  /// 把满足条件的变量从 [offset] 开始依次放入块中，返回块的末尾
+  /// 按对齐从大到小排列，相同对齐的变量保持声明顺序，变量之间不会产生填充
+  template <class Desc>
+  constexpr std::uint32_t place(Desc *list, std::uint32_t count, std::uint32_t offset, auto &&selected) noexcept {
+    std::uint32_t order[1 << 8]{};
+    std::uint32_t n = 0;
+    for (std::uint32_t i = 0; i != count; ++i) {
+      if (!selected(list[i])) {
+        continue;
+      }
+      auto j = n++;
+      for (; j && list[order[j - 1]].align < list[i].align; --j) {
+        order[j] = order[j - 1];
+      }
+      order[j] = i;
+    }
+    for (std::uint32_t k = 0; k != n; ++k) {
+      auto &desc = list[order[k]];
+      offset = round_up(offset, desc.align);
+      desc.offset = offset;
+      offset += desc.size;
+      align = align < desc.align ? desc.align : align;
+    }
+    return offset;
+  }
+
+  /// 为真时各块已经排布完成，之后构造的成员依次取回偏移
+  bool arranged = false;
+  std::uint32_t next_input = 0;
+  std::uint32_t next_output = 0;
+  std::uint32_t next_uniform = 0;
+};
+
 /// 使用 DSL 能以接近 GLSL 等着色器语言的书写方式来完成着色器的编写
 /// 并自动生成对应的 [shader_module]
 class shader {
@@ -85,12 +261,16 @@ public:
   template <std::uint8_t>
   struct binding;
 
+  /// 输入附件语法糖，只能在片元着色器中使用
+  template <std::uint8_t>
+  struct input_attachment;
+
   /// 用来生成着色器类的入口函数
   template <class Tp, void (Tp::*Entry)()>
   static void entry(
-      const const_memory_array<1 << 8> &uniform,
-      const const_memory_array<1 << 8> &input,
-      const memory_array<1 << 8> &output,
+      const_memory uniform,
+      const_memory input,
+      memory output,
       memory *mutable_builtin
   );
 
@@ -101,9 +281,9 @@ public:
 
 private:
 
-  const const_memory_array<1 << 8> *uniform;
-  const const_memory_array<1 << 8> *input;
-  const memory_array<1 << 8> *output;
+  const_memory uniform;
+  const_memory input;
+  memory output;
 };
 
 /// 顶点着色器基类
@@ -114,23 +294,105 @@ struct vertex_shader : shader {
 /// 片元着色器基类
 struct fragment_shader : shader {
   vec3 *gl_fragcoord;
+  /// 当前像素位置上各个输入附件的内容，下标对应子通道中输入附件的顺序
+  const const_memory *subpass_inputs;
+  /// 有效通道的掩码，第 i 位对应第 i 个通道，逐个调用时恒为 1
+  /// 按通道执行时没有片元的通道 (片元不足 [lanes_count] 个，或者整行执行时行中未覆盖、未通过深度测试的像素) 同样会执行，
+  /// 它们的输出将被丢弃
+  std::uint32_t gl_lane_mask;
+
+  /// 以指定的浮点类型读取片元坐标，同时以 float 与 floatx8 实例化的着色器使用
+  template <class Float>
+  [[nodiscard]] const vec<Float, 3> &frag_coord() const noexcept {
+    return *reinterpret_cast<const vec<Float, 3> *>(gl_fragcoord);
+  }
+};
+
+/// 着色器类在编译期计算出的内存布局
+template <class Tp>
+class shader_layout {
+private:
+  /// 不断增加构造参数，因为所有的 in/out/uniform 都能接受一个 shader_layout_builder & 作为构造参数
+  /// 所以当不能再构造的时候，参数的数量就是着色器成员的数量
+  template <class... Args>
+  static consteval std::size_t members_count() {
+    if constexpr (requires { Tp{{}, std::declval<Args &>()..., std::declval<shader_layout_builder &>()}; }) {
+      return members_count<Args..., shader_layout_builder>();
+    } else {
+      return sizeof...(Args);
+    }
+  }
+
+  static constexpr Tp construct(shader_layout_builder &builder) {
+    return [&]<std::size_t... I>(std::index_sequence<I...>) {
+      return Tp{{}, (static_cast<void>(I), builder)...};
+    }(std::make_index_sequence<members_count()>{});
+  }
+
+  static constexpr shader_layout_builder collect() {
+    shader_layout_builder builder;
+    construct(builder);
+    builder.arrange(std::is_base_of_v<fragment_shader, Tp>);
+    return builder;
+  }
+
+  template <auto Member, std::size_t N>
+  static constexpr auto copy() {
+    std::array<std::remove_cvref_t<decltype((builder.*Member)[0])>, N> res{};
+    for (std::size_t i = 0; i != N; ++i) {
+      res[i] = (builder.*Member)[i];
+    }
+    return res;
+  }
+
+public:
+  /// 排布完成的所有变量
+  static constexpr shader_layout_builder builder = collect();
+
+  static constexpr auto inputs = copy<&shader_layout_builder::inputs, builder.inputs_count>();
+  static constexpr auto outputs = copy<&shader_layout_builder::outputs, builder.outputs_count>();
+  static constexpr auto uniforms = copy<&shader_layout_builder::uniforms, builder.uniforms_count>();
+
+  /// 每个成员都保存着自己偏移的着色器对象，入口函数从它复制出着色器，
+  /// 访问变量时的偏移都是编译期常量
+  static constexpr Tp prototype = [] {
+    auto res = builder;
+    return construct(res);
+  }();
+
+  static constexpr shader_variables_meta meta() noexcept {
+    return {
+        .inputs_count = static_cast<std::uint8_t>(builder.inputs_count),
+        .outputs_count = static_cast<std::uint8_t>(builder.outputs_count),
+        .uniforms_count = static_cast<std::uint8_t>(builder.uniforms_count),
+        .inputs_size = builder.inputs_size,
+        .outputs_size = builder.outputs_size,
+        .uniforms_size = builder.uniforms_size,
+        .align = builder.align,
+        .inputs = inputs.data(),
+        .outputs = outputs.data(),
+        .uniforms = uniforms.data(),
+    };
+  }
 };
 
 template <class Tp, void (Tp::*Entry)()>
 void shader::entry(
-    const const_memory_array<1 << 8> &uniform,
-    const const_memory_array<1 << 8> &input,
-    const memory_array<1 << 8> &output,
+    const_memory uniform,
+    const_memory input,
+    memory output,
     memory *mutable_builtin
 ) {
-  Tp shader;
-  shader.uniform = &uniform;
-  shader.input = &input;
-  shader.output = &output;
+  Tp shader = shader_layout<Tp>::prototype;
+  shader.uniform = uniform;
+  shader.input = input;
+  shader.output = output;
   if constexpr (std::is_base_of_v<vertex_shader, Tp>) {
     shader.gl_position = reinterpret_cast<vec4 *>(mutable_builtin[0]);
   } else if constexpr (std::is_base_of_v<fragment_shader, Tp>) {
     shader.gl_fragcoord = reinterpret_cast<vec3 *>(mutable_builtin[0]);
+    shader.subpass_inputs = reinterpret_cast<const const_memory *>(mutable_builtin[1]);
+    shader.gl_lane_mask = *reinterpret_cast<const std::uint32_t *>(mutable_builtin[2]);
   }
   (shader.*Entry)();
 }
@@ -150,83 +412,82 @@ public:
     return inst;
   }
 
-  dsl_shader_module() = default;
-
-  dsl_shader_module(const dsl_shader_module &) = delete;
-
-  dsl_shader_module(dsl_shader_module &&mov) noexcept {
-    attributes_description_memory = mov.attributes_description_memory;
-    entry = mov.entry;
-    variables_meta = mov.variables_meta;
-    mov.entry = nullptr;
-    mov.attributes_description_memory = nullptr;
+  /// 由以浮点类型为参数的片元着色器类模板同时生成逐个调用和按通道执行的入口，
+  /// 变量规格取自以 float 实例化的着色器，以 floatx8 实例化时变量的每个分量都变为 8 个通道
+  template <template <class> class Shader>
+  static dsl_shader_module load() {
+    static_assert(
+        std::is_base_of_v<fragment_shader, Shader<float>>,
+        "only fragment shaders can be executed in lanes"
+    );
+    static_assert(
+        lanes_layout_matches<Shader<float>, Shader<floatx8>>(),
+        "variables of a lanes shader must be made of float components"
+    );
+    auto inst = load<&Shader<float>::main>();
+    inst.lanes_entry = shader::entry<Shader<floatx8>, &Shader<floatx8>::main>;
+    return inst;
   }
 
-  ~dsl_shader_module() {
-    if (attributes_description_memory) {
-      delete attributes_description_memory;
-    }
+  /// 生成带有只计算位置的入口的顶点着色器模块，两个入口是同一个着色器类的成员函数，
+  /// Position 只需要写入 gl_position
+  template <auto Entry, auto Position>
+  static dsl_shader_module load() {
+    using shader_type = typename constructor<Entry>::shader_type;
+    static_assert(
+        std::is_base_of_v<vertex_shader, shader_type>,
+        "only vertex shaders can have a position entry"
+    );
+    static_assert(
+        std::is_same_v<shader_type, typename constructor<Position>::shader_type>,
+        "the position entry must belong to the same shader"
+    );
+    auto inst = load<Entry>();
+    inst.position_entry = shader::entry<shader_type, Position>;
+    return inst;
   }
 
 private:
-  /// 记录堆内存指针
-  shader_stage_variable_description *attributes_description_memory;
-};
-
-template <class Tp, void (Tp::*Entry)(void)>
-class dsl_shader_module::constructor<Entry> {
-private:
-  static bool generate_variables_meta(dsl_shader_module &p, auto &&...args) {
-    // 不断构造，因为所有的 in/out/uniform 都能接受一个dsl_shader_module & 作为构造参数
-    // 所以当不能再构造的时候，arg的数量就是着色器成员的数量
-    constexpr auto constructiable = requires { Tp{{}, args...}; };
-    if constexpr (constructiable) {
-      // 再增加一个参数就不能构造了，说明递归到这一层时参数已经能够填满所有的成员
-      if (!generate_variables_meta(p, p, args...)) {
-        // 注意这些数组并不在堆内存上
-        shader_stage_variable_description inputs[256];
-        shader_stage_variable_description outputs[256];
-        p.variables_meta = {
-            .inputs_count = 0,
-            .outputs_count = 0,
-            .inputs = inputs,
-            .outputs = outputs,
-        };
-        {
-          Tp shader{{}, args...};
-        }
-
-        const auto count = p.variables_meta.inputs_count + p.variables_meta.outputs_count;
-        if (count == 0) {
-          p.variables_meta.inputs = p.variables_meta.outputs = nullptr;
-          p.attributes_description_memory = nullptr;
-          return true;
-        }
-
-        // 为着色器属性描述分配内存
-        p.attributes_description_memory = new shader_stage_variable_description[count];
-
-        // 拷贝栈上数组的数据到堆内存
-        auto dst = p.attributes_description_memory;
-        auto src = p.variables_meta.inputs;
-        p.variables_meta.inputs = dst;
-        for (auto ed = dst + p.variables_meta.inputs_count; dst != ed; ++dst, ++src) {
-          *dst = *src;
-        }
-
-        src = p.variables_meta.outputs;
-        p.variables_meta.outputs = dst;
-        for (auto ed = dst + p.variables_meta.outputs_count; dst != ed; ++dst, ++src) {
-          *dst = *src;
-        }
+  /// 按通道执行的着色器中，输入与输出的偏移应该恰好是逐个调用时的 [lanes_count] 倍，
+  /// 常量的布局则完全相同，含有不能插值的输入时管道不会按通道执行，不必检查输入
+  template <class Scalar, class Lanes>
+  static consteval bool lanes_layout_matches() {
+    using scalar = shader_layout<Scalar>;
+    using lanes = shader_layout<Lanes>;
+    if (scalar::inputs.size() != lanes::inputs.size() || scalar::outputs.size() != lanes::outputs.size() ||
+        scalar::uniforms.size() != lanes::uniforms.size()) {
+      return false;
+    }
+    auto interpolated = true;
+    for (auto &in : scalar::inputs) {
+      interpolated = interpolated && in.components != 0;
+    }
+    for (std::size_t i = 0; interpolated && i != scalar::inputs.size(); ++i) {
+      if (lanes::inputs[i].offset != scalar::inputs[i].offset * lanes_count) {
+        return false;
+      }
+    }
+    for (std::size_t i = 0; i != scalar::outputs.size(); ++i) {
+      if (lanes::outputs[i].offset != scalar::outputs[i].offset * lanes_count) {
+        return false;
+      }
+    }
+    for (std::size_t i = 0; i != scalar::uniforms.size(); ++i) {
+      if (lanes::uniforms[i].offset != scalar::uniforms[i].offset) {
+        return false;
       }
     }
-    return constructiable;
+    return true;
   }
+};
 
+template <class Tp, void (Tp::*Entry)(void)>
+class dsl_shader_module::constructor<Entry> {
 public:
+  using shader_type = Tp;
+
   static void construct(dsl_shader_module &m) {
-    generate_variables_meta(m);
+    m.variables_meta = shader_layout<Tp>::meta();
     m.entry = shader::entry<Tp, Entry>;
   }
 };
@@ -235,108 +496,104 @@ template <std::uint8_t Loc>
 struct shader::location {
   template <class Tp>
   class in {
-  private:
-    template <class MTp>
-    static inline void interpolation(
-        const const_memory_array<3> &src, const float (&weight)[3], std::byte *dst
-    ) {
-      constexpr auto n = std::extent_v<Tp>;
-      // 如果是数组类型就递归进行插值
-      if constexpr (n >= 2) {
-        using element_t = std::remove_extent_t<Tp>;
-        constexpr auto stride = sizeof(element_t);
-        const std::byte *arr_src[] = {src[0], src[1], src[2]};
-
-        for (std::size_t i = 0; i != n; ++i) {
-          interpolation<element_t>(arr_src, weight, dst);
-          for (auto &p : arr_src) p += stride;
-          dst += stride;
-        }
-      } else {
-        using typed_array = const Tp *const[3];
-        auto &typed = reinterpret_cast<const typed_array &>(src);
-        *reinterpret_cast<Tp *>(dst) =
-            *typed[0] * weight[0] +
-            *typed[1] * weight[1] +
-            *typed[2] * weight[2];
-      }
-    }
-
   public:
     in() = default;
 
-    in(dsl_shader_module &m) noexcept {
-      // 把自身属性填入数组
-      m.variables_meta.inputs[m.variables_meta.inputs_count++] =
-          shader_stage_variable_description{
+    constexpr in(shader_layout_builder &b) noexcept
+        : offset_(b.input({
               .location = Loc,
               .size = sizeof(Tp),
               .align = alignof(Tp),
-              .interpolation = interpolation<Tp>,
-          };
-    }
+              .components = interpolation_components<Tp>::value,
+          })) {}
 
-    [[nodiscard]] static inline const Tp &get(shader *host) noexcept {
-      return *reinterpret_cast<const Tp *const>((*host->input)[Loc]);
+    [[nodiscard]] inline const Tp &get(shader *host) const noexcept {
+      return *reinterpret_cast<const Tp *>(host->input + offset_);
     }
+
+  private:
+    /// 在输入块中的字节偏移
+    std::uint32_t offset_ = 0;
   };
 
   template <class Tp>
   class out {
-  private:
-    // 匹配不同类型变量的 format
-    template <class>
-    struct attribute_format_matcher;
-
-    template <>
-    struct attribute_format_matcher<vec2> {
-      static constexpr auto format = format::RG32f;
-    };
-
-    template <>
-    struct attribute_format_matcher<vec3> {
-      static constexpr auto format = format::RGB32f;
-    };
-
-    template <>
-    struct attribute_format_matcher<vec4> {
-      static constexpr auto format = format::RGBA32f;
-    };
-
   public:
     out() = default;
 
-    out(dsl_shader_module &m) noexcept {
-      // 把自身属性填入数组
-      m.variables_meta.outputs[m.variables_meta.outputs_count++] =
-          shader_stage_variable_description{
+    constexpr out(shader_layout_builder &b) noexcept
+        : offset_(b.output({
               .format = attribute_format_matcher<Tp>::format,
               .location = Loc,
               .size = sizeof(Tp),
               .align = alignof(Tp),
-          };
-    }
+          })) {}
 
-    [[nodiscard]] static inline Tp &get(shader *host) noexcept {
-      return *reinterpret_cast<Tp *const>((*host->output)[Loc]);
+    [[nodiscard]] inline Tp &get(shader *host) const noexcept {
+      return *reinterpret_cast<Tp *>(host->output + offset_);
     }
+
+  private:
+    /// 在输出块中的字节偏移
+    std::uint32_t offset_ = 0;
   };
 };
 
 template <std::uint8_t Bd>
 struct shader::binding {
   template <class Tp>
-  struct uniform {
+  class uniform {
+  private:
+    /// 大小未知或者过大的常量只在常量块中保存描述符的地址
+    static constexpr bool indirect = [] {
+      if constexpr (std::is_unbounded_array_v<Tp>) {
+        return true;
+      } else {
+        return sizeof(Tp) > shader_layout_builder::uniform_copy_limit;
+      }
+    }();
+
+  public:
     uniform() = default;
 
-    uniform(dsl_shader_module &m) noexcept {
-      // 显然着色器常量是由外部提供的，但为了保证能够让上面的 constructor 类
-      // 能够正常构造，特添加这个函数
+    constexpr uniform(shader_layout_builder &b) noexcept
+        : offset_(b.uniform({
+              .binding = Bd,
+              .indirect = indirect,
+              .size = sizeof(std::conditional_t<indirect, const_memory, Tp>),
+              .align = alignof(std::conditional_t<indirect, const_memory, Tp>),
+          })) {}
+
+    [[nodiscard]] inline const Tp &get(shader *host) const noexcept {
+      if constexpr (indirect) {
+        return *reinterpret_cast<const Tp *>(*reinterpret_cast<const const_memory *>(host->uniform + offset_));
+      } else {
+        return *reinterpret_cast<const Tp *>(host->uniform + offset_);
+      }
+    }
+
+  private:
+    /// 在常量块中的字节偏移
+    std::uint32_t offset_ = 0;
+  };
+};
+
+template <std::uint8_t Idx>
+struct shader::input_attachment {
+  /// 读取同一子通道组中之前的子通道在当前像素写入的内容，
+  /// 类型的内存布局需要与附件格式一致
+  template <class Tp>
+  struct subpass_input {
+    subpass_input() = default;
+
+    constexpr subpass_input(shader_layout_builder &) noexcept {
+      // 输入附件由子通道提供，不占用任何块，只是为了让 shader_layout 能够正常构造
     }
 
     [[nodiscard]] inline static const Tp &
     get(shader *shader) noexcept {
-      return *reinterpret_cast<const Tp *const>((*shader->uniform)[Bd]);
+      auto host = static_cast<fragment_shader *>(shader);
+      return *reinterpret_cast<const Tp *const>(host->subpass_inputs[Idx]);
     }
   };
 };
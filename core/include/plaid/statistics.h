@@ -0,0 +1,77 @@
+#pragma once
+#ifndef PLAID_STATISTICS_H_
+#define PLAID_STATISTICS_H_
+
+#include <cstdint>
+
+namespace plaid {
+
+/// 管道统计计数器，只有定义了 PLAID_PIPELINE_STATISTICS 时才会被收集
+/// 见 render_pass::state::draw_statistics 与 render_pass::state::statistics
+struct pipeline_statistics {
+  /// 包围球位于视锥之外而被整体跳过的实例数
+  std::uint64_t instances_culled;
+  /// 包围球位于视锥之外或者整体背对而被跳过的网格簇数
+  std::uint64_t clusters_culled;
+  /// 从顶点缓冲区读取的顶点数
+  std::uint64_t vertices_fetched;
+  /// 顶点着色器执行次数
+  std::uint64_t vertex_shader_invocations;
+  /// 只计算位置的顶点着色器入口的执行次数
+  std::uint64_t position_shader_invocations;
+  /// 索引绘制时命中后变换顶点缓存、不再执行顶点着色器的顶点数
+  std::uint64_t vertex_cache_hits;
+  /// 装配得到的图元数
+  std::uint64_t primitives_assembled;
+  /// 跨越裁剪平面而需要裁剪的图元数
+  std::uint64_t primitives_clipped;
+  /// 完全位于裁剪空间之外而被丢弃的图元数
+  std::uint64_t primitives_culled_outside;
+  /// 被面剔除的图元数
+  std::uint64_t primitives_culled_face;
+  /// 投影面积为零而被丢弃的图元数
+  std::uint64_t primitives_culled_degenerate;
+  /// 裁剪之后送入光栅化的三角形数，一个图元被裁剪后可能产生多个三角形
+  std::uint64_t primitives_rasterized;
+  /// 送入光栅化但不覆盖任何像素中心，在设置之前或者光栅化时被丢弃的三角形数
+  std::uint64_t primitives_missed_samples;
+  /// 光栅化时整块在三角形之外而被跳过的 8x8 像素块数
+  std::uint64_t raster_blocks_skipped;
+  /// 光栅化时整块在三角形之内而不做边测试直接填充的 8x8 像素块数
+  std::uint64_t raster_blocks_filled;
+  /// 被三角形覆盖，进行深度测试的片元数
+  std::uint64_t fragments_tested;
+  /// 通过深度测试的片元数
+  std::uint64_t fragments_depth_passed;
+  /// 片元着色器执行次数
+  std::uint64_t fragment_shader_invocations;
+  /// 绘制写入附件的字节数，包括深度与分块内存中的附件，不包括附件清除
+  std::uint64_t attachment_bytes_written;
+
+  constexpr pipeline_statistics &operator+=(const pipeline_statistics &b) noexcept {
+    instances_culled += b.instances_culled;
+    clusters_culled += b.clusters_culled;
+    vertices_fetched += b.vertices_fetched;
+    vertex_shader_invocations += b.vertex_shader_invocations;
+    position_shader_invocations += b.position_shader_invocations;
+    vertex_cache_hits += b.vertex_cache_hits;
+    primitives_assembled += b.primitives_assembled;
+    primitives_clipped += b.primitives_clipped;
+    primitives_culled_outside += b.primitives_culled_outside;
+    primitives_culled_face += b.primitives_culled_face;
+    primitives_culled_degenerate += b.primitives_culled_degenerate;
+    primitives_rasterized += b.primitives_rasterized;
+    primitives_missed_samples += b.primitives_missed_samples;
+    raster_blocks_skipped += b.raster_blocks_skipped;
+    raster_blocks_filled += b.raster_blocks_filled;
+    fragments_tested += b.fragments_tested;
+    fragments_depth_passed += b.fragments_depth_passed;
+    fragment_shader_invocations += b.fragment_shader_invocations;
+    attachment_bytes_written += b.attachment_bytes_written;
+    return *this;
+  }
+};
+
+} // namespace plaid
+
+#endif // PLAID_STATISTICS_H_
@@ -0,0 +1,83 @@
+/// 时间线追踪，只有定义了 PLAID_TRACE 时才会记录
+/// 每个线程把区间写入自己的环形缓冲区，缓冲区写满后覆盖最早的区间，
+/// 需要时调用 write_chrome_trace 导出，结果可以在 chrome://tracing 或 Perfetto 中打开
+
+#pragma once
+#ifndef PLAID_TRACE_H_
+#define PLAID_TRACE_H_
+
+#ifdef PLAID_TRACE
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+namespace plaid {
+
+/// 追踪使用的纳秒时间戳
+[[nodiscard]] inline std::uint64_t trace_clock() noexcept {
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/// 把一个区间写入当前线程的环形缓冲区
+/// @param name 区间名称，必须是静态存储期的字符串
+/// @param begin 开始时间戳
+/// @param end 结束时间戳
+void trace_record(const char *name, std::uint64_t begin, std::uint64_t end) noexcept;
+
+/// 把所有线程中尚未被覆盖的区间导出为 Chrome trace JSON，可以与记录同时进行
+void write_chrome_trace(std::ostream &);
+
+/// 丢弃所有线程中已经记录的区间
+void clear_trace() noexcept;
+
+/// 作用域区间，构造时开始，析构时写入当前线程的环形缓冲区
+class trace_zone {
+public:
+
+  explicit trace_zone(const char *name) noexcept : name_(name), begin_(trace_clock()) {}
+
+  trace_zone(const trace_zone &) = delete;
+
+  ~trace_zone() {
+    if (name_) {
+      trace_record(name_, begin_, trace_clock());
+    }
+  }
+
+  /// 在作用域结束之前提前结束区间
+  void end() noexcept {
+    trace_record(name_, begin_, trace_clock());
+    name_ = nullptr;
+  }
+
+private:
+
+  const char *name_;
+  std::uint64_t begin_;
+};
+
+} // namespace plaid
+
+#define PLAID_TRACE_CONCAT_(a, b) a##b
+#define PLAID_TRACE_CONCAT(a, b) PLAID_TRACE_CONCAT_(a, b)
+
+/// 在当前作用域内记录一个区间
+#define PLAID_TRACE_ZONE(name) ::plaid::trace_zone PLAID_TRACE_CONCAT(plaid_trace_zone_, __LINE__)(name)
+#else
+#define PLAID_TRACE_ZONE(name) static_cast<void>(0)
+#endif
+
+/// 逐图元、逐片元的细粒度区间，数量巨大且本身开销不可忽略，需要额外定义 PLAID_TRACE_DETAIL
+#if defined(PLAID_TRACE) && defined(PLAID_TRACE_DETAIL)
+#define PLAID_TRACE_DETAIL_ZONE(name) PLAID_TRACE_ZONE(name)
+/// 开始一个可以用 PLAID_TRACE_DETAIL_ZONE_END 提前结束的区间
+#define PLAID_TRACE_DETAIL_ZONE_BEGIN(var, name) ::plaid::trace_zone var(name)
+#define PLAID_TRACE_DETAIL_ZONE_END(var) var.end()
+#else
+#define PLAID_TRACE_DETAIL_ZONE(name) static_cast<void>(0)
+#define PLAID_TRACE_DETAIL_ZONE_BEGIN(var, name) static_cast<void>(0)
+#define PLAID_TRACE_DETAIL_ZONE_END(var) static_cast<void>(0)
+#endif
+
+#endif // PLAID_TRACE_H_
@@ -269,9 +269,9 @@ operator^=(vec<LTp, N> &a, const vec<RTp, N> &b) noexcept {
   return a;
 }
 
-template <class Tp, std::size_t N>
-[[nodiscard]] constexpr auto dot(const vec<Tp, N> &a, const vec<Tp, N> &b) noexcept {
-  decltype(a.x * a.x) res = 0;
+template <class LTp, class RTp, std::size_t N>
+[[nodiscard]] constexpr auto dot(const vec<LTp, N> &a, const vec<RTp, N> &b) noexcept {
+  decltype(a.x * b.x) res = 0;
   for (auto i = 0; i != N; ++i) {
     res += a[i] * b[i];
   }
@@ -288,7 +288,9 @@ template <class Tp, std::size_t N>
 
 template <class Tp, std::size_t N>
 [[nodiscard]] auto abs(const vec<Tp, N> &v) noexcept {
-  return std::sqrt(dot(v, v));
+  // 分量为通道类型时由参数依赖查找找到对应的 sqrt
+  using std::sqrt;
+  return sqrt(dot(v, v));
 }
 
 template <class Tp, std::size_t N>
@@ -1,7 +1,15 @@
+#include <cstring>
+
 #include "attachment_transition.h"
 
 using namespace plaid;
 
+/// 格式相同时直接拷贝
+template <std::uint32_t Size>
+static void copy_attachment(const std::byte *src, std::byte *dst) {
+  std::memcpy(dst, src, Size);
+}
+
 void plaid::RGB32f_to_BGRA8u(const std::byte *src, std::byte *dst) {
   auto final_color = reinterpret_cast<const float *>(src);
   auto r = std::uint32_t(final_color[0] * 0xff);
@@ -29,6 +37,14 @@ void plaid::RGBA32u_to_BGRA8u(const std::byte *src, std::byte *dst) {
 }
 
 attachment_transition_function *plaid::match_attachment_transition_function(format src, format dst) {
+  if (src == dst) {
+    switch (format_size(src)) {
+      case 4: return copy_attachment<4>;
+      case 8: return copy_attachment<8>;
+      case 12: return copy_attachment<12>;
+      case 16: return copy_attachment<16>;
+    }
+  }
   if (src == format::RGB32f) {
     if (dst == format::BGRA8u) {
       return RGB32f_to_BGRA8u;
@@ -1,64 +1,54 @@
 #include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <limits>
 #include <stdexcept>
 
 #include <plaid/frame_buffer.h>
+#include <plaid/trace.h>
 
 #include "graphics_pipeline_cache.h"
+#include "sort_last_renderer.h"
+#include "tile_binner.h"
+#include "worker_pool.h"
 
 using namespace plaid;
 
-graphics_pipeline::graphics_pipeline(const graphics_pipeline::create_info &info) {
-  cache_ = new graphics_pipeline_cache(info);
-}
-
-graphics_pipeline::graphics_pipeline(const graphics_pipeline_cache &cache) {
-  cache_ = new graphics_pipeline_cache(cache);
-}
-
-graphics_pipeline::graphics_pipeline(graphics_pipeline &&mov) noexcept {
-  cache_ = mov.cache_;
-  mov.cache_ = nullptr;
-}
-
-graphics_pipeline::~graphics_pipeline() {
-  if (cache_) {
-    delete cache_;
+pipeline_rasterization plaid::make_rasterization(const graphics_pipeline::create_info &info) {
+  pipeline_rasterization res{.state = info.rasterization_state, .viewport{}, .scissor{}};
+  auto &viewport_state = info.viewport_state;
+  if (viewport_state.viewports_count) {
+    res.viewport = viewport_state.viewports[0];
+  }
+  if (viewport_state.scissors_count) {
+    res.scissor = viewport_state.scissors[0];
   }
+  return res;
 }
 
-graphics_pipeline &graphics_pipeline::operator=(graphics_pipeline &&mov) noexcept {
-  return *new (this) graphics_pipeline(static_cast<graphics_pipeline &&>(mov));
-}
+graphics_pipeline::graphics_pipeline(const graphics_pipeline::create_info &info)
+    : cache_(std::make_shared<graphics_pipeline_cache>(info)),
+      rasterization_(std::make_shared<pipeline_rasterization>(make_rasterization(info))) {}
 
-const primitive_topology &graphics_pipeline::vertex_assembly() noexcept {
+const primitive_topology &graphics_pipeline::vertex_assembly() const noexcept {
   return cache_->vertex_assembly;
 }
 
-static std::byte *aligned_malloc(std::uint32_t size, std::uint32_t al) {
-  if (!al || (al & -al) != al) {
-    return nullptr;
-  }
-  static constexpr auto address = sizeof(std::uintptr_t *);
-  auto real_size = address + size + al - 1;
-  auto start = reinterpret_cast<std::uintptr_t>(std::malloc(real_size));
-  std::uintptr_t *dat = reinterpret_cast<std::uintptr_t *>((start + address + al - 1) / al * al);
-  *(dat - 1) = start;
-  return reinterpret_cast<std::byte *>(dat);
-}
-
-static void aligned_free(void *ptr) {
-  std::free(*(reinterpret_cast<void **>(ptr) - 1));
-}
-
 graphics_pipeline_cache::graphics_pipeline_cache(const graphics_pipeline::create_info &info) {
   vertex_assembly = info.input_assembly_state.topology;
-  rasterization_state = info.rasterization_state;
+  primitive_restart = info.input_assembly_state.primitive_restart_enable;
 
   auto &vertex_shader_module = info.shader_stage.vertex_shader;
   auto &fragment_shader_module = info.shader_stage.fragment_shader;
+  auto &vertex_meta = vertex_shader_module.variables_meta;
+  auto &fragment_meta = fragment_shader_module.variables_meta;
 
   // 获取顶点着色器入口函数
   m_vertex_shader = vertex_shader_module.entry;
+  m_position_shader = vertex_shader_module.position_entry;
   m_fragment_shader = fragment_shader_module.entry;
 
   // 把绑定点描述信息放入稀疏表方便快速访问
@@ -71,283 +61,307 @@ graphics_pipeline_cache::graphics_pipeline_cache(const graphics_pipeline::create
     }
   }
 
+  // 同样按编号索引顶点着色器的输入与输出
+  const shader_stage_variable_description *vertex_inputs[1 << 8]{};
+  for (auto it = vertex_meta.inputs, ed = it + vertex_meta.inputs_count; it != ed; ++it) {
+    vertex_inputs[it->location] = it;
+  }
+  const shader_stage_variable_description *vertex_outputs[1 << 8]{};
+  for (auto it = vertex_meta.outputs, ed = it + vertex_meta.outputs_count; it != ed; ++it) {
+    vertex_outputs[it->location] = it;
+  }
+
   {
     // 填充两个 [vertex_attribute_detail] 数组
     auto it = info.vertex_input_state.attributes;
     auto ed = it + info.vertex_input_state.attributes_count;
-    int per_vert_cnt = 0, per_inst_cnt = 0;
-    // 遍历每一个顶点属性，放到对应的数组
+    // 遍历每一个顶点属性，放到对应的数组，着色器没有声明的属性不需要读取
     for (; it != ed; ++it) {
+      auto input = vertex_inputs[it->location];
+      if (!input) {
+        continue;
+      }
       auto &binding = *vert_in_binding_desc_map[it->binding];
+      vertex_input_detail detail{
+          .binding = it->binding,
+          .stride = binding.stride,
+          .offset = it->offset,
+          .destination = input->offset,
+          .size = input->size,
+      };
       if (binding.input_rate == vertex_input_rate::vertex) {
-        m_vertex_input_per_vertex[per_vert_cnt++] = {
-            .location = it->location,
-            .binding = it->binding,
-            .stride = binding.stride,
-            .offset = it->offset,
-        };
+        m_vertex_input_per_vertex.push_back(detail);
       } else {
-        m_vertex_input_per_instance[per_inst_cnt++] = {
-            .location = it->location,
-            .binding = it->binding,
-            .stride = binding.stride,
-            .offset = it->offset,
-        };
+        m_vertex_input_per_instance.push_back(detail);
       }
     }
-    m_counts.vertex_input_per_vertex = per_vert_cnt;
-    m_counts.vertex_input_per_instance = per_inst_cnt;
   }
 
   {
-    struct compare_weights {
-      std::uint8_t location;
-      std::uint32_t align;
-      std::uint32_t size;
-    } stage_attrs[1 << 8];
-
-    auto vertex_output_cnt = vertex_shader_module.variables_meta.outputs_count;
-    std::uint32_t chunk_size = 0;
-    std::uint32_t chunk_align = 0;
-    if (vertex_output_cnt) {
-      {
-        // 把类型信息放入待排序数组
-        auto it = vertex_shader_module.variables_meta.outputs;
-        auto ed = it + vertex_output_cnt;
-        for (auto dst = stage_attrs; it != ed; ++it, ++dst) {
-          *dst = {
-              .location = it->location,
-              .align = it->align,
-              .size = it->size,
-          };
-        }
-
-        // 按照 align 排序，则保证构造出来的结构成员间的 padding 和最小
-        // 保证去除内存浪费
-        std::sort(
-            stage_attrs, stage_attrs + vertex_output_cnt,
-            [](const compare_weights &a, const compare_weights &b) {
-              return a.align < b.align;
-            }
-        );
-      }
-
-      for (auto it = stage_attrs, ed = stage_attrs + vertex_output_cnt; it != ed; ++it) {
-        chunk_size = (chunk_size + it->align - 1) / it->align * it->align;
-        // 先把成员偏移量放到记录数组内
-        auto offset_ptr = reinterpret_cast<std::byte *>(chunk_size);
-        for (auto &out : m_vertex_shader_output) {
-          out[it->location] = offset_ptr;
-        }
-        m_fragment_shader_input[it->location] = offset_ptr;
-        chunk_size += it->size;
+    auto uniform_details = [](const shader_variables_meta &meta) {
+      std::vector<uniform_detail> details;
+      for (auto it = meta.uniforms, ed = it + meta.uniforms_count; it != ed; ++it) {
+        details.push_back({it->binding, it->indirect, it->offset, it->size});
       }
+      return details;
+    };
+    m_vertex_uniforms = uniform_details(vertex_meta);
+    m_fragment_uniforms = uniform_details(fragment_meta);
+  }
 
-      chunk_align = stage_attrs[vertex_output_cnt - 1].align;
+  // 可以插值的片元着色器输入位于输入块开头，按 float 分量紧密排列，
+  // 记录每个分量在顶点着色器输出块中的位置，其余的输入从第一个顶点的输出复制
+  auto fragment_inputs = fragment_meta.inputs;
+  auto fragment_input_cnt = fragment_meta.inputs_count;
+  for (auto it = fragment_inputs, ed = it + fragment_input_cnt; it != ed; ++it) {
+    auto source = vertex_outputs[it->location];
+    if (!source) {
+      continue;
     }
-
-    shader_stage_variable_description fragment_output_desc[1 << 8];
-    auto fragment_output_cnt = fragment_shader_module.variables_meta.outputs_count;
-    std::uint32_t fragment_output_size = 0;
-    // 片元着色器输出的内存对齐
-    std::uint32_t fragment_output_align = 0;
-    if (fragment_output_cnt) {
-      {
-        auto src = fragment_shader_module.variables_meta.outputs;
-        std::copy_n(src, fragment_output_cnt, fragment_output_desc);
-      }
-
-      using cmp_t = const shader_stage_variable_description;
-      std::sort(
-          fragment_output_desc, fragment_output_desc + fragment_output_cnt,
-          [](cmp_t &a, cmp_t &b) { return a.align < b.align; }
-      );
-
-      for (auto it = fragment_output_desc, ed = it + fragment_output_cnt; it != ed; ++it) {
-        fragment_output_size = (fragment_output_size + it->align - 1) / it->align * it->align;
-        auto offset_ptr = reinterpret_cast<std::byte *>(fragment_output_size);
-        m_fragment_shader_output[it->location] = offset_ptr;
-        fragment_output_size += it->size;
-      }
-      fragment_output_align = fragment_output_desc[fragment_output_cnt - 1].align;
+    if (!it->components) {
+      m_flat_inputs.push_back({source->offset, it->offset, it->size});
+      continue;
     }
-
-    // 片元着色器输出在这块堆内存的偏移
-    auto fragment_output_offset = (chunk_size * 4 + fragment_output_align - 1) /
-                                  fragment_output_align * fragment_output_align;
-
-    // 整个输出结构的字节大小
-    auto allocated_memory_size = fragment_output_offset + fragment_output_size;
-
-    // 申请内存
-    auto allocated_memory_align = (std::max)(chunk_align, fragment_output_align);
-    m_allocated_memory = aligned_malloc(allocated_memory_size, allocated_memory_align);
-
-    {
-      // 整个输出结构的偏移量
-      auto offset = reinterpret_cast<std::ptrdiff_t>(m_allocated_memory);
-      for (auto it = stage_attrs, ed = stage_attrs + vertex_output_cnt; it != ed; ++it) {
-        for (auto &out : m_vertex_shader_output) {
-          out[it->location] += offset;
-          offset += chunk_size;
-        }
-        m_fragment_shader_input[it->location] += offset;
-      }
-
-      for (auto it = fragment_output_desc, ed = it + fragment_output_cnt; it != ed; ++it) {
-        m_fragment_shader_output[it->location] += fragment_output_offset + offset;
-      }
+    std::size_t first = it->offset / sizeof(float);
+    m_varying_sources.resize((std::max)(m_varying_sources.size(), first + it->components));
+    for (std::uint32_t i = 0; i != it->components; ++i) {
+      m_varying_sources[first + i] = static_cast<std::uint32_t>(source->offset + i * sizeof(float));
     }
   }
-
-  m_counts.fragment_input = fragment_shader_module.variables_meta.inputs_count;
-  m_counts.fragment_output = fragment_shader_module.variables_meta.outputs_count;
+  // 分量数组的长度取整到 8 的倍数，着色器排布输入块时已经为此留出了空间
+  auto varyings_count = static_cast<std::uint32_t>(m_varying_sources.size());
+  auto varyings_stride = (varyings_count + 7) / 8 * 8;
+  auto varyings_size = static_cast<std::uint32_t>(varyings_stride * sizeof(float));
+  m_varyings_count = varyings_count;
+  m_varyings_stride = varyings_stride;
+
+  // 所有输入都可以插值且子通道没有输入附件时，片元着色器按通道执行
+  auto &subpass = info.render_pass.subpass(info.subpass);
+  auto lanes = fragment_shader_module.lanes_entry && !subpass.input_attachments_count &&
+               std::all_of(fragment_inputs, fragment_inputs + fragment_input_cnt, [](auto &d) {
+                 return d.components != 0;
+               });
+  m_fragment_shader_lanes = lanes ? fragment_shader_module.lanes_entry : nullptr;
 
   {
-    auto src = fragment_shader_module.variables_meta.inputs;
-    auto src_ed = src + m_counts.fragment_input;
-    std::transform(src, src_ed, m_fragment_input, [](const plaid::shader_stage_variable_description &d) {
-      return fragment_input_detail{d.location, d.interpolation};
-    });
+    // 每一块都按同一个对齐排布，至少为 32 字节，便于编译器向量化
+    auto align = (std::max)({std::uint32_t{32}, vertex_meta.align, fragment_meta.align});
+    auto round_up = [align](std::uint32_t n) { return (n + align - 1) / align * align; };
+
+    // 平面方程块的大小满足对齐，使第一个顶点的输出紧随其后
+    m_layout.varying_planes = round_up(sizeof(pipeline_context::depth_planes));
+    m_planes_size = round_up(m_layout.varying_planes + varyings_size * 3);
+    m_vertex_output_size = vertex_meta.outputs_size;
+    // 光栅化只从第一个顶点的输出中读取不插值的输入，没有这样的输入时记录三角形不需要带上它
+    m_payload_size = m_planes_size + (m_flat_inputs.empty() ? 0 : m_vertex_output_size);
+
+    auto size = m_planes_size + m_vertex_output_size * 3;
+    auto reserve = [&](std::uint32_t n) {
+      auto offset = round_up(size);
+      size = offset + n;
+      return offset;
+    };
+    m_layout.fragment_input = reserve(fragment_meta.inputs_size);
+    m_layout.fragment_output = reserve(fragment_meta.outputs_size);
+    m_layout.vertex_input = reserve(vertex_meta.inputs_size);
+    m_layout.vertex_uniforms = reserve(vertex_meta.uniforms_size);
+    m_layout.fragment_uniforms = reserve(fragment_meta.uniforms_size);
+    // 按通道执行时输入与输出的每个分量都需要一份 floatx8
+    m_layout.lanes_input = reserve(lanes ? fragment_meta.inputs_size * lanes_count : 0);
+    m_layout.lanes_output = reserve(lanes ? fragment_meta.outputs_size * lanes_count : 0);
+    m_layout.row_varyings = reserve(lanes ? 0 : varyings_size);
+    m_layout.size = size;
+    m_layout.align = align;
   }
 
   {
-    auto &subpass = info.render_pass.subpass(info.subpass);
-
-    auto src = fragment_shader_module.variables_meta.outputs;
-    auto src_ed = src + m_counts.fragment_output;
-    std::transform(src, src_ed, m_fragment_output, [&](const plaid::shader_stage_variable_description &d) {
+    auto src = fragment_meta.outputs;
+    auto src_ed = src + fragment_meta.outputs_count;
+    // 附件内容是否需要写入由渲染时的附件视图决定，分块渲染时不写回的附件仍需写入分块内存
+    std::transform(src, src_ed, std::back_inserter(m_fragment_output), [&](const plaid::shader_stage_variable_description &d) {
       auto &attachment = subpass.color_attachments[d.location];
-      auto should_store = info.render_pass.attachment(attachment.id).store_op == attachment_store_op::store;
       return fragment_output_detail{
-          .location = d.location,
+          .offset = d.offset,
           .attachment_id = attachment.id,
-          .attachment_stride = format_size(attachment.format) * should_store,
+          .attachment_stride = format_size(attachment.format),
+          .components = d.size / static_cast<std::uint32_t>(sizeof(float)),
           .attachment_transition = match_attachment_transition_function(d.format, attachment.format)};
     });
-  }
-}
-
-graphics_pipeline_cache::~graphics_pipeline_cache() {
-  aligned_free(m_allocated_memory);
-}
 
-static void clear_by_format(
-    format src, format dst,
-    std::byte *first, std::byte *last,
-    const std::byte *val, std::uint32_t stride
-) {
-  if (src == dst) {
-    for (; first != last; first += stride) {
-      std::memcpy(first, val, stride);
-    }
-  } else {
-    // 绑定布局转换函数
-    auto trans = match_attachment_transition_function(src, dst);
-    for (; first != last; first += stride) {
-      trans(val, first);
-    }
-  }
-}
-
-void graphics_pipeline_cache::clear_color_attachment(const render_pass::state &state, attachment_reference ref) {
-  // 根据附件类型选定清除值
-  auto src_format = format::undefined;
-  const std::byte *src = nullptr;
-  if (is_float_format(ref.format)) {
-    src_format = format::RGBA32f;
-    src = reinterpret_cast<const std::byte *>(&state.clear_values_[ref.id].color.f);
-  } else if (is_unsigned_integer_format(ref.format)) {
-    src_format = format::RGBA32u;
-    src = reinterpret_cast<const std::byte *>(&state.clear_values_[ref.id].color.u);
+    std::transform(
+        subpass.input_attachments, subpass.input_attachments + subpass.input_attachments_count,
+        std::back_inserter(m_input_attachments), [](const attachment_reference &ref) {
+          return input_attachment_detail{ref.id, format_size(ref.format)};
+        }
+    );
   }
-
-  auto dst_stride = format_size(ref.format);
-  auto dst = (*state.frame_buffer_)[ref.id];
-  auto dst_ed = dst + state.frame_buffer_->width() * state.frame_buffer_->height() * dst_stride;
-  clear_by_format(src_format, ref.format, dst, dst_ed, src, dst_stride);
 }
 
-void graphics_pipeline_cache::clear_stencil_attachment(const render_pass::state &state, attachment_reference ref) {
-  // 根据附件类型选定清除值
-  auto src_format = format::undefined;
-  const std::byte *src = nullptr;
-  if (is_float_format(ref.format)) {
-    src_format = format::R32f;
-    src = reinterpret_cast<const std::byte *>(&state.clear_values_[ref.id].depth_stencil.depth);
+void graphics_pipeline_cache::bind_context(pipeline_context &ctx) const {
+  auto memory = ctx.reserve(m_layout.size, m_layout.align);
+  ctx.pipeline = this;
+  ctx.planes = reinterpret_cast<pipeline_context::depth_planes *>(memory);
+  auto varyings_size = m_varyings_stride * sizeof(float);
+  for (std::uint32_t i = 0; i != 3; ++i) {
+    ctx.varying_planes[i] = reinterpret_cast<float *>(memory + m_layout.varying_planes + varyings_size * i);
+    ctx.vertex_output[i] = memory + m_planes_size + m_vertex_output_size * i;
   }
-
-  auto dst = (*state.frame_buffer_)[ref.id];
-  auto dst_stride = format_size(ref.format);
-  auto dst_ed = dst + state.frame_buffer_->width() * state.frame_buffer_->height() * dst_stride;
-  clear_by_format(src_format, ref.format, dst, dst_ed, src, dst_stride);
+  ctx.fragment_input = memory + m_layout.fragment_input;
+  ctx.varyings = reinterpret_cast<float *>(ctx.fragment_input);
+  ctx.fragment_output = memory + m_layout.fragment_output;
+  ctx.vertex_input = memory + m_layout.vertex_input;
+  ctx.vertex_uniforms = memory + m_layout.vertex_uniforms;
+  ctx.fragment_uniforms = memory + m_layout.fragment_uniforms;
+  ctx.fragment_uniforms_source = nullptr;
+  ctx.varyings_lanes = reinterpret_cast<floatx8 *>(memory + m_layout.lanes_input);
+  ctx.fragment_output_lanes = memory + m_layout.lanes_output;
+  ctx.row_varyings = reinterpret_cast<float *>(memory + m_layout.row_varyings);
+  ctx.lanes_count = 0;
 }
 
 void graphics_pipeline_cache::draw(
-    const render_pass::state &state,
+    const render_pass::state &state, const graphics_pipeline &pipeline,
     std::uint32_t vertex_count, std::uint32_t instance_count,
     std::uint32_t first_vertex, std::uint32_t first_instance
-) {
-  auto last_vert = first_vertex + vertex_count;
-  auto last_inst = first_instance + instance_count;
-  draw_internal<false>(
-      state, first_vertex, last_vert, first_instance, last_inst, 0
-  );
+) const {
+  draw_indirect_command command{vertex_count, instance_count, first_vertex, first_instance};
+  draw_internal<false>(state, pipeline, reinterpret_cast<const std::byte *>(&command), 1, sizeof(command));
 }
 
 void graphics_pipeline_cache::draw_indexed(
-    const render_pass::state &state,
+    const render_pass::state &state, const graphics_pipeline &pipeline,
     std::uint32_t indices_count, std::uint32_t instances_count,
     std::uint32_t first_index, std::int32_t vertex_offset,
     std::uint32_t first_instance
-) {
-  auto last_index = first_index + indices_count;
-  auto last_inst = first_instance + instances_count;
-  draw_internal<true>(
-      state, first_index, last_index, first_instance, last_inst, vertex_offset
-  );
+) const {
+  draw_indexed_indirect_command command{indices_count, instances_count, first_index, vertex_offset, first_instance};
+  draw_internal<true>(state, pipeline, reinterpret_cast<const std::byte *>(&command), 1, sizeof(command));
+}
+
+void graphics_pipeline_cache::draw_indirect(
+    const render_pass::state &state, const graphics_pipeline &pipeline,
+    const std::byte *commands, std::uint32_t draws_count, std::uint32_t stride
+) const {
+  draw_internal<false>(state, pipeline, commands, draws_count, stride);
+}
+
+void graphics_pipeline_cache::draw_indexed_indirect(
+    const render_pass::state &state, const graphics_pipeline &pipeline,
+    const std::byte *commands, std::uint32_t draws_count, std::uint32_t stride
+) const {
+  draw_internal<true>(state, pipeline, commands, draws_count, stride);
 }
 
 template <bool Indexed>
 void graphics_pipeline_cache::draw_internal(
-    const render_pass::state &state,
-    std::uint32_t first, std::uint32_t last,
-    std::uint32_t first_inst, std::uint32_t last_inst,
-    std::int32_t vert_offset
-) {
+    const render_pass::state &state, const graphics_pipeline &pipeline,
+    const std::byte *commands, std::uint32_t draws_count, std::uint32_t stride
+) const {
+  PLAID_TRACE_ZONE("draw");
+  [[unlikely]] if (state.current_subpass_ == state.last_subpass_) {
+    throw std::runtime_error("The render pass has already ended.");
+  }
+  if constexpr (Indexed) {
+    [[unlikely]] if (!state.index_buffer_) {
+      throw std::runtime_error("No index buffer bound for indexed drawing.");
+    }
+  }
+  // 不支持的图元拓扑在分给工作线程或者记录下来之前拒绝
+  [[unlikely]] if (vertex_assembly == primitive_topology::line_strip) {
+    throw std::runtime_error("Unsupported topology line_strip.");
+  }
   auto width = state.frame_buffer_->width();
   auto height = state.frame_buffer_->height();
   [[unlikely]] if (!width || !height) {
     return;
   }
 
-  {
-    // 对所有颜色附件应用清除值
-    auto it = state.current_subpass_->color_attachments;
-    auto ed = it + state.current_subpass_->color_attachments_count;
-    for (; it != ed; ++it) {
-      auto &desc = state.attachment_descriptions_[it->id];
-      if (desc.load_op == attachment_load_op::clear) {
-        clear_color_attachment(state, *it);
-      }
-    }
+  // 渲染通道状态上动态设置的值覆盖管道中的值，视口与裁剪矩形没有指定时使用整个帧缓冲区
+  auto &rasterization = pipeline.rasterization();
+  auto dynamic = state.dynamic_state_;
+  auto viewport = dynamic & render_pass::state::dynamic_viewport ? state.viewport_ : rasterization.viewport;
+  if (!viewport.width) {
+    viewport = {0, 0, static_cast<float>(width), static_cast<float>(height), 0, 1};
+  }
+  rect2d frame{{0, 0}, {width, height}};
+  auto scissor = dynamic & render_pass::state::dynamic_scissor ? state.scissor_ : rasterization.scissor;
+  auto area = scissor.extent.width ? intersect(scissor, frame) : frame;
+  [[unlikely]] if (!area.extent.width || !area.extent.height) {
+    return;
+  }
+  // sort-last 渲染时只记录绘制，子通道结束时由各线程在各自的状态上重新提交
+  if (state.sort_last_) {
+    state.sort_last_->record(pipeline, Indexed, commands, draws_count, stride, area);
+    return;
   }
 
-  {
-    // 对深度/模板附件应用清除值
-    auto ref = *state.current_subpass_->depth_stencil_attachment;
-    auto &desc = state.attachment_descriptions_[ref.id];
-    if (desc.stencil_load_op == attachment_load_op::clear) {
-      clear_stencil_attachment(state, ref);
+  // 合并子通道组内只记录三角形，光栅化推迟到分块渲染时进行
+  attachment_view views[1 << 8];
+  render_target target{
+      .viewport = viewport,
+      .area = area,
+      .views = views,
+      .subpass = state.current_subpass_,
+      .descriptor_set = &state.descriptor_set_,
+  };
+  auto &ctx = *state.context_;
+  if (ctx.pipeline != this) {
+    bind_context(ctx);
+  }
+  ctx.cull_mode = dynamic & render_pass::state::dynamic_cull_mode ? state.cull_mode_ : rasterization.state.cull_mode;
+  ctx.depth_bias = dynamic & render_pass::state::dynamic_depth_bias ? state.depth_bias_ : rasterization.state.depth_bias;
+#ifdef PLAID_PIPELINE_STATISTICS
+  ctx.statistics = &state.draw_statistics_.emplace_back();
+#endif
+  // 常量在一次绘制中保持不变，绘制开始时复制到常量块
+  fill_uniforms(ctx.vertex_uniforms, m_vertex_uniforms, state.descriptor_set_);
+  fill_uniforms(ctx.fragment_uniforms, m_fragment_uniforms, state.descriptor_set_);
+  ctx.fragment_uniforms_source = &state.descriptor_set_;
+  if (state.binner_) {
+    state.binner_->begin_draw(pipeline, state.descriptor_set_, viewport, area);
+  } else {
+    state.frame_views(views);
+  }
+
+  auto parallel = worker_pool::instance().concurrency() > 1;
+  for (std::uint32_t i = 0; i != draws_count; ++i) {
+    // 参数所在的内存不一定对齐
+    std::uint32_t first, count, first_inst, instances;
+    std::int32_t vert_offset = 0;
+    if constexpr (Indexed) {
+      draw_indexed_indirect_command command;
+      std::memcpy(&command, commands + std::size_t{stride} * i, sizeof(command));
+      first = command.first_index, count = command.indices_count;
+      first_inst = command.first_instance, instances = command.instances_count;
+      vert_offset = command.vertex_offset;
+    } else {
+      draw_indirect_command command;
+      std::memcpy(&command, commands + std::size_t{stride} * i, sizeof(command));
+      first = command.first_vertex, count = command.vertices_count;
+      first_inst = command.first_instance, instances = command.instances_count;
+    }
+    auto last = first + count, last_inst = first_inst + instances;
+    if (parallel && instances > 1 && std::uint64_t{count} * instances >= parallel_vertices_min) {
+      draw_instances_parallel<Indexed>(ctx, state, target, first, last, first_inst, last_inst, vert_offset);
+    } else {
+      draw_instances<Indexed>(ctx, state, target, first, last, first_inst, last_inst, vert_offset);
     }
   }
+}
 
+template <bool Indexed>
+void graphics_pipeline_cache::draw_instances(
+    pipeline_context &ctx, const render_pass::state &state, const render_target &target,
+    std::uint32_t first, std::uint32_t last,
+    std::uint32_t first_inst, std::uint32_t last_inst,
+    std::int32_t vert_offset
+) const {
   switch (vertex_assembly) {
     case primitive_topology::triangle_list:
-      draw_triangle_list<Indexed>(state, first, last, first_inst, last_inst, vert_offset);
+      draw_triangle_list<Indexed>(ctx, state, target, first, last, first_inst, last_inst, vert_offset);
       break;
     case primitive_topology::triangle_strip:
-      draw_triangle_strip<Indexed>(state, first, last, first_inst, last_inst, vert_offset);
+      draw_triangle_strip<Indexed>(ctx, state, target, first, last, first_inst, last_inst, vert_offset);
       break;
     case primitive_topology::line_strip:
       throw std::runtime_error("Unsupported topology line_strip.");
@@ -355,12 +369,142 @@ void graphics_pipeline_cache::draw_internal(
   }
 }
 
+template <bool Indexed>
+void graphics_pipeline_cache::draw_instances_parallel(
+    pipeline_context &ctx, const render_pass::state &state, const render_target &target,
+    std::uint32_t first, std::uint32_t last,
+    std::uint32_t first_inst, std::uint32_t last_inst,
+    std::int32_t vert_offset
+) const {
+  auto &pool = worker_pool::instance();
+  auto workers = pool.concurrency();
+  if (state.worker_contexts_count_ < workers) {
+    delete[] state.worker_contexts_;
+    state.worker_contexts_ = new pipeline_context[workers];
+    state.worker_contexts_count_ = workers;
+  }
+
+  // 实例按编号顺序分段，每段记录在执行它的线程的上下文中
+  struct job_records {
+    std::uint32_t worker;
+    std::size_t begin, end;
+  };
+  auto instances = last_inst - first_inst;
+  auto jobs = (std::min)(instances, workers * parallel_jobs_per_worker);
+  std::vector<job_records> records(jobs);
+  std::atomic<std::uint32_t> next_job = 0;
+#ifdef PLAID_PIPELINE_STATISTICS
+  std::vector<pipeline_statistics> statistics(workers);
+#endif
+
+  pool.run([&](std::uint32_t worker) {
+    PLAID_TRACE_ZONE("instances");
+    auto &local = state.worker_contexts_[worker];
+    auto job = next_job.fetch_add(1, std::memory_order_relaxed);
+    if (job >= jobs) {
+      return;
+    }
+    if (local.pipeline != this) {
+      bind_context(local);
+    }
+    fill_uniforms(local.vertex_uniforms, m_vertex_uniforms, state.descriptor_set_);
+    local.cull_mode = ctx.cull_mode;
+    local.depth_bias = ctx.depth_bias;
+    local.defer = true;
+    local.deferred.clear();
+#ifdef PLAID_PIPELINE_STATISTICS
+    local.statistics = &statistics[worker];
+#endif
+    for (; job < jobs; job = next_job.fetch_add(1, std::memory_order_relaxed)) {
+      auto begin = first_inst + static_cast<std::uint32_t>(std::uint64_t{instances} * job / jobs);
+      auto end = first_inst + static_cast<std::uint32_t>(std::uint64_t{instances} * (job + 1) / jobs);
+      auto offset = local.deferred.size();
+      draw_instances<Indexed>(local, state, target, first, last, begin, end, vert_offset);
+      records[job] = {worker, offset, local.deferred.size()};
+    }
+  });
+
+#ifdef PLAID_PIPELINE_STATISTICS
+  for (auto &s : statistics) {
+    *ctx.statistics += s;
+  }
+#endif
+
+  PLAID_TRACE_ZONE("replay");
+  auto payload_size = m_payload_size;
+  auto record_size = deferred_record_size();
+  for (auto &job : records) {
+    auto data = state.worker_contexts_[job.worker].deferred.data();
+    for (auto offset = job.begin; offset != job.end; offset += record_size) {
+      auto &clip_coord = *reinterpret_cast<const vec4 (*)[3]>(data + offset);
+      auto payload = data + offset + sizeof(clip_coord);
+      if (state.binner_) {
+        const vec4 *triangle[]{clip_coord, clip_coord + 1, clip_coord + 2};
+        state.binner_->bin_triangle(triangle, payload, payload_size);
+      } else {
+        rasterize_binned(ctx, target, clip_coord, payload);
+      }
+    }
+  }
+}
+
+bool graphics_pipeline_cache::instance_visible(const render_pass::state &state, std::uint32_t inst) {
+  if (!state.instance_bounds_) {
+    return true;
+  }
+  auto sphere = reinterpret_cast<const float *>(state.instance_bounds_ + std::size_t{inst} * state.instance_bounds_stride_);
+  for (auto &plane : state.instance_planes_) {
+    if (plane.x * sphere[0] + plane.y * sphere[1] + plane.z * sphere[2] + plane.w < -sphere[3]) {
+      return false;
+    }
+  }
+  return true;
+}
+
 static vec4 line_insertion(const vec4 &l, const vec4 &a, const vec4 &b) {
   auto da = dot(a, l), db = dot(b, l);
   auto weight = da / (da - db);
   return a * (1 - weight) + b * weight;
 }
 
+/// 顶点是否位于所有裁剪平面之内，与 [clip_triangle] 使用的平面一致
+static bool inside_clip_volume(const vec4 &v) {
+  return v.z >= 0 && v.z <= v.w &&
+         v.x >= -v.w && v.x <= v.w &&
+         v.y >= -v.w && v.y <= v.w;
+}
+
+/// 求出中心位于多边形屏幕坐标包围盒与渲染区域之内的像素范围，
+/// 只有这些像素可能被覆盖，范围为空的多边形 (通常是落在像素中心之间的小三角形) 可以直接丢弃
+/// @param view 多边形各顶点的屏幕坐标
+/// @param box 接收像素范围的左、上、右、下边界 (包含)
+/// @return 范围不为空
+static bool sample_bounds(const vec2 *view, int count, const rect2d &area, std::uint32_t (&box)[4]) {
+  auto min_x = view[0].x, min_y = view[0].y, max_x = view[0].x, max_y = view[0].y;
+  for (int i = 1; i != count; ++i) {
+    min_x = (std::min)(min_x, view[i].x);
+    min_y = (std::min)(min_y, view[i].y);
+    max_x = (std::max)(max_x, view[i].x);
+    max_y = (std::max)(max_y, view[i].y);
+  }
+  auto l = (std::max)(static_cast<float>(area.offset.x), min_x - .5f);
+  auto t = (std::max)(static_cast<float>(area.offset.y), min_y - .5f);
+  auto r = (std::min)(static_cast<float>(area.offset.x + area.extent.width - 1), max_x - .5f);
+  auto b = (std::min)(static_cast<float>(area.offset.y + area.extent.height - 1), max_y - .5f);
+  if (!(l <= r && t <= b)) {
+    return false;
+  }
+  // 渲染区域的坐标不为负，边界限制之后向零取整就是向下取整，
+  // 不使用 std::ceil 与 std::floor，没有 SSE4.1 时它们都是函数调用
+  box[0] = static_cast<std::uint32_t>(l);
+  box[1] = static_cast<std::uint32_t>(t);
+  box[2] = static_cast<std::uint32_t>(r);
+  box[3] = static_cast<std::uint32_t>(b);
+  box[0] += static_cast<float>(box[0]) < l;
+  box[1] += static_cast<float>(box[1]) < t;
+  return box[0] <= box[2] && box[1] <= box[3];
+}
+
 static int clip_triangle(const vec4 (&src)[3], vec4 dst[]) {
   static constexpr vec4 clip_planes[]{
       // near
@@ -387,6 +531,8 @@ static int clip_triangle(const vec4 (&src)[3], vec4 dst[]) {
   }
   int cnt[2]{3};
   int pre = 0;
+  // 交点总是从平面内侧的端点向外侧的端点插值，相邻三角形的公共边无论沿哪个方向经过都得到完全相同的交点，
+  // 裁剪之后的公共边上不会出现裂缝或者重叠
   for (auto &clip : clip_planes) {
     auto now = pre ^ 1;
     cnt[now] = 0;
@@ -395,7 +541,7 @@ static int clip_triangle(const vec4 (&src)[3], vec4 dst[]) {
       auto &previous = queue[pre][(i + cnt[pre] - 1) % cnt[pre]];
       if (dot(clip, current) >= 0) {
         if (dot(clip, previous) < 0) {
-          queue[now][cnt[now]++] = line_insertion(clip, previous, current);
+          queue[now][cnt[now]++] = line_insertion(clip, current, previous);
         }
         queue[now][cnt[now]++] = current;
       } else if (dot(clip, previous) >= 0) {
@@ -410,11 +556,13 @@ static int clip_triangle(const vec4 (&src)[3], vec4 dst[]) {
 }
 
 template <bool Indexed>
-std::uint32_t graphics_pipeline_cache::actual_vertex(
-    std::uint32_t position, std::int32_t vert_offset
-) {
+std::uint32_t graphics_pipeline_cache::fetch_index(const render_pass::state &state, std::uint32_t position) {
   if constexpr (Indexed) {
-    return m_index_buffer[position] + vert_offset;
+    if (state.index_type_ == index_type::uint16) {
+      auto index = reinterpret_cast<const std::uint16_t *>(state.index_buffer_)[position];
+      return index == 0xFFFF ? restart_index : index;
+    }
+    return reinterpret_cast<const std::uint32_t *>(state.index_buffer_)[position];
   } else {
     return position;
   }
@@ -422,273 +570,842 @@ std::uint32_t graphics_pipeline_cache::actual_vertex(
 
 template <bool Indexed>
 void graphics_pipeline_cache::draw_triangle_list(
-    const render_pass::state &state,
+    pipeline_context &ctx, const render_pass::state &state, const render_target &target,
     std::uint32_t first, std::uint32_t last,
     std::uint32_t first_inst, std::uint32_t last_inst,
     std::int32_t vert_offset
-) {
+) const {
   [[unlikely]] if (last - first <= 2) {
     return;
   }
 
   auto &vertex_buffer = state.vertex_buffer_;
+  auto restart = Indexed && primitive_restart;
 
   vec4 clip_coords[3];
+  vec4 clipped[6];
+  const vec4 *polygon;
+  // 三个顶点的编号、输出块是否已经由完整的顶点着色器写入以及在顶点缓存中的槽
+  std::uint32_t vertex_ids[3];
+  bool shaded[3];
+  std::uint32_t cache_slots[3];
   // 采用 IMR 模式，每当完成相邻三个顶点的顶点着色器之后马上进行图元的光栅化
   // 顶点属性的更新采用如下方法：分别使用 [vertex_input_per_vertex_attributes]
   // 和 [vertex_input_per_instance_attributes] 记录顶点属性在顶点缓冲区的位置，
   // 绘制同一实例的不同顶点，只需要更新逐顶点数据
   for (auto inst = first_inst; inst != last_inst; ++inst) {
-    obtain_next_instance_attributes(vertex_buffer, inst);
-
-    std::uint32_t indices[]{0, 1, 2};
-
-    vec4 clipped[6];
-    vec4 *target[3];
-    target[0] = clipped;
-    while (1) {
-      auto it = m_vertex_shader_output;
-      auto coord_it = clip_coords;
-      for (auto i : indices) {
-        obtain_next_vertex_attribute(
-            vertex_buffer,
-            actual_vertex<Indexed>(i, vert_offset)
-        );
+    if (!instance_visible(state, inst)) {
+      PLAID_STATISTICS_ADD(instances_culled, 1);
+      continue;
+    }
+    obtain_next_instance_attributes(ctx, vertex_buffer, inst);
+    auto &cache = ctx.vertex_cache;
+    if constexpr (Indexed) {
+      cache.reset(m_vertex_output_size);
+    }
 
-        invoke_vertex_shader(state.descriptor_set_, *it, *coord_it);
-        ++it, ++coord_it;
+    // 当前三角形已经完成变换的顶点数
+    int assembled = 0;
+    for (auto i = first; i != last; ++i) {
+      auto index = fetch_index<Indexed>(state, i);
+      if (restart && index == restart_index) {
+        assembled = 0;
+        continue;
       }
-
-      auto vertex_cnt = clip_triangle(clip_coords, clipped);
-      for (auto i = 1; i <= vertex_cnt - 2; ++i) {
-        target[1] = clipped + i;
-        target[2] = clipped + i + 1;
-        rasterize_triangle(state, const_cast<const vec4 *const(&)[3]>(target));
+      auto vert_id = Indexed ? index + vert_offset : index;
+      vertex_ids[assembled] = vert_id;
+      if constexpr (Indexed) {
+        // 索引绘制中同一个顶点被多个三角形引用，命中缓存时直接复制之前的结果
+        auto slot = cache.find(index);
+        if (slot != cache.size) {
+          clip_coords[assembled] = cache.clip_coords[slot];
+          shaded[assembled] = cache.shaded[slot];
+          if (shaded[assembled]) {
+            std::memcpy(ctx.vertex_output[assembled], cache.output(slot), m_vertex_output_size);
+          }
+          PLAID_STATISTICS_ADD(vertex_cache_hits, 1);
+        } else {
+          shaded[assembled] = transform_vertex(
+              ctx, vertex_buffer, vert_id, ctx.vertex_output[assembled], clip_coords[assembled]
+          );
+          slot = cache.insert(index);
+          cache.clip_coords[slot] = clip_coords[assembled];
+          cache.shaded[slot] = shaded[assembled];
+          if (shaded[assembled]) {
+            std::memcpy(cache.output(slot), ctx.vertex_output[assembled], m_vertex_output_size);
+          }
+        }
+        cache_slots[assembled] = slot;
+      } else {
+        shaded[assembled] = transform_vertex(
+            ctx, vertex_buffer, vert_id, ctx.vertex_output[assembled], clip_coords[assembled]
+        );
+      }
+      if (++assembled != 3) {
+        continue;
       }
+      assembled = 0;
 
-      auto start = indices[2];
-      if (start + 3 >= last) break;
-      indices[0] = start + 1;
-      indices[1] = start + 2;
-      indices[2] = start + 3;
+      auto vertex_cnt = clip_and_cull(ctx, target, clip_coords, false, clipped, polygon);
+      if (!vertex_cnt) {
+        continue;
+      }
+      // 只执行过位置入口的顶点在三角形通过剔除之后才执行完整的顶点着色器
+      for (int k = 0; k != 3; ++k) {
+        if (shaded[k]) {
+          continue;
+        }
+        shade_vertex(ctx, vertex_buffer, vertex_ids[k], ctx.vertex_output[k]);
+        if constexpr (Indexed) {
+          std::memcpy(cache.output(cache_slots[k]), ctx.vertex_output[k], m_vertex_output_size);
+          cache.shaded[cache_slots[k]] = true;
+        }
+      }
+      emit_polygon(ctx, state, target, clip_coords, polygon, vertex_cnt);
     }
   }
 }
 
 template <bool Indexed>
 void graphics_pipeline_cache::draw_triangle_strip(
-    const render_pass::state &state,
+    pipeline_context &ctx, const render_pass::state &state, const render_target &target,
     std::uint32_t first, std::uint32_t last,
     std::uint32_t first_inst, std::uint32_t last_inst,
     std::int32_t vert_offset
-) {
+) const {
   [[unlikely]] if (last - first <= 2) {
     return;
   }
 
   auto &vertex_buffer = state.vertex_buffer_;
+  auto restart = Indexed && primitive_restart;
 
   vec4 clip_coords[3];
+  vec4 clipped[6];
+  const vec4 *polygon;
+  // 三个输出块对应的顶点编号以及是否已经由完整的顶点着色器写入
+  std::uint32_t vertex_ids[3];
+  bool shaded[3];
   // 采用 IMR 模式，每当完成相邻三个顶点的顶点着色器之后马上进行图元的光栅化
   // 顶点属性的更新采用如下方法：分别使用 [vertex_input_per_vertex_attributes]
   // 和 [vertex_input_per_instance_attributes] 记录顶点属性在顶点缓冲区的位置，
   // 绘制同一实例的不同顶点，只需要更新逐顶点数据
   for (auto inst = first_inst; inst != last_inst; ++inst) {
-    obtain_next_instance_attributes(vertex_buffer, inst);
-
-    std::uint32_t indices[]{0, 1, 2};
-    // 需要先单独处理前三个顶点的顶点着色器
-    for (auto i : indices) {
-      // 顶点编号刚好对应数据位置，而下面的 while 循环则不能如此
-      obtain_next_vertex_attribute(vertex_buffer, actual_vertex<Indexed>(i, vert_offset));
-      invoke_vertex_shader(state.descriptor_set_, m_vertex_shader_output[i], clip_coords[i]);
-    }
-
-    vec4 clipped[6];
-    vec4 *target[3];
-    target[0] = clipped;
-
-    int ping_pong = 0;
-    while (1) {
-      auto vertex_cnt = clip_triangle(clip_coords, clipped);
-      for (auto i = 1; i <= vertex_cnt - 2; ++i) {
-        target[1] = clipped + i;
-        target[2] = clipped + i + 1;
-        rasterize_triangle(state, const_cast<const vec4 *(&)[3]>(target));
+    if (!instance_visible(state, inst)) {
+      PLAID_STATISTICS_ADD(instances_culled, 1);
+      continue;
+    }
+    obtain_next_instance_attributes(ctx, vertex_buffer, inst);
+
+    // 当前条带已经完成顶点着色器的顶点数，第 k 个顶点的输出轮流存放在 k % 3 号输出块，
+    // 于是第 t 个三角形的三个顶点按存放顺序是 (t, t + 1, t + 2) 的一个轮换，
+    // t 为奇数时与条带规定的顺序 (t + 1, t, t + 2) 朝向相反
+    std::uint32_t strip = 0;
+    int slot = 0;
+    for (auto i = first; i != last; ++i) {
+      auto index = fetch_index<Indexed>(state, i);
+      if (restart && index == restart_index) {
+        strip = 0;
+        slot = 0;
+        continue;
+      }
+      auto vert_id = Indexed ? index + vert_offset : index;
+      vertex_ids[slot] = vert_id;
+      shaded[slot] = transform_vertex(ctx, vertex_buffer, vert_id, ctx.vertex_output[slot], clip_coords[slot]);
+      slot = slot == 2 ? 0 : slot + 1;
+      if (++strip < 3) {
+        continue;
       }
 
-      indices[ping_pong] += 3;
-      if (indices[ping_pong] == last) break;
-      obtain_next_vertex_attribute(
-          vertex_buffer,
-          actual_vertex<Indexed>(indices[ping_pong], vert_offset)
-      );
-      invoke_vertex_shader(
-          state.descriptor_set_,
-          m_vertex_shader_output[ping_pong],
-          clip_coords[ping_pong]
-      );
-      ping_pong = (ping_pong + 1) % 3;
+      auto vertex_cnt = clip_and_cull(ctx, target, clip_coords, (strip & 1) == 0, clipped, polygon);
+      if (!vertex_cnt) {
+        continue;
+      }
+      // 一个顶点最多属于三个三角形，只要其中之一通过剔除就执行完整的顶点着色器
+      for (int k = 0; k != 3; ++k) {
+        if (!shaded[k]) {
+          shade_vertex(ctx, vertex_buffer, vertex_ids[k], ctx.vertex_output[k]);
+          shaded[k] = true;
+        }
+      }
+      emit_polygon(ctx, state, target, clip_coords, polygon, vertex_cnt);
     }
   }
 }
 
 void graphics_pipeline_cache::obtain_next_vertex_attribute(
-    const const_memory_array<1 << 8> &vertex_buffer, std::uint32_t vert_id
-) {
-  auto it = m_vertex_input_per_vertex;
-  auto ed = it + m_counts.vertex_input_per_vertex;
-  for (; it != ed; ++it) {
-    auto ptr = vertex_buffer[it->binding] + it->stride * vert_id + it->offset;
-    m_vertex_shader_input[it->location] = ptr;
+    pipeline_context &ctx, const const_memory_array<1 << 8> &vertex_buffer, std::uint32_t vert_id
+) const {
+  for (auto &attr : m_vertex_input_per_vertex) {
+    auto ptr = vertex_buffer[attr.binding] + attr.stride * vert_id + attr.offset;
+    std::memcpy(ctx.vertex_input + attr.destination, ptr, attr.size);
   }
+  PLAID_STATISTICS_ADD(vertices_fetched, 1);
 }
 
 void graphics_pipeline_cache::obtain_next_instance_attributes(
-    const const_memory_array<1 << 8> &vertex_buffer, std::uint32_t inst_id
-) {
-  auto it = m_vertex_input_per_instance;
-  auto ed = it + m_counts.vertex_input_per_instance;
-  for (; it != ed; ++it) {
-    auto ptr = vertex_buffer[it->binding] + it->stride * inst_id + it->offset;
-    m_vertex_shader_input[it->location] = ptr;
+    pipeline_context &ctx, const const_memory_array<1 << 8> &vertex_buffer, std::uint32_t inst_id
+) const {
+  for (auto &attr : m_vertex_input_per_instance) {
+    auto ptr = vertex_buffer[attr.binding] + attr.stride * inst_id + attr.offset;
+    std::memcpy(ctx.vertex_input + attr.destination, ptr, attr.size);
   }
 }
 
-void graphics_pipeline_cache::invoke_vertex_shader(
-    const const_memory_array<1 << 8> &descriptor_set,
-    const memory_array<1 << 8> &output,
-    vec4 &clip_coord
-) {
+void graphics_pipeline_cache::invoke_vertex_shader(pipeline_context &ctx, memory output, vec4 &clip_coord) const {
   // 只有一个内置变量，即裁剪空间坐标
   auto mutable_builtin = reinterpret_cast<memory>(&clip_coord);
-  m_vertex_shader(descriptor_set, m_vertex_shader_input, output, &mutable_builtin);
+  m_vertex_shader(ctx.vertex_uniforms, ctx.vertex_input, output, &mutable_builtin);
+  PLAID_STATISTICS_ADD(vertex_shader_invocations, 1);
 }
 
-void graphics_pipeline_cache::rasterize_triangle(
-    const render_pass::state &state,
-    const vec4 *const (&clip_coord)[3]
+void graphics_pipeline_cache::invoke_position_shader(pipeline_context &ctx, memory output, vec4 &clip_coord) const {
+  auto mutable_builtin = reinterpret_cast<memory>(&clip_coord);
+  m_position_shader(ctx.vertex_uniforms, ctx.vertex_input, output, &mutable_builtin);
+  PLAID_STATISTICS_ADD(position_shader_invocations, 1);
+}
+
+bool graphics_pipeline_cache::transform_vertex(
+    pipeline_context &ctx, const const_memory_array<1 << 8> &vertex_buffer, std::uint32_t vert_id,
+    memory output, vec4 &clip_coord
+) const {
+  PLAID_TRACE_DETAIL_ZONE("vertex");
+  obtain_next_vertex_attribute(ctx, vertex_buffer, vert_id);
+  if (m_position_shader) {
+    invoke_position_shader(ctx, output, clip_coord);
+    return false;
+  }
+  invoke_vertex_shader(ctx, output, clip_coord);
+  return true;
+}
+
+void graphics_pipeline_cache::shade_vertex(
+    pipeline_context &ctx, const const_memory_array<1 << 8> &vertex_buffer, std::uint32_t vert_id, memory output
+) const {
+  PLAID_TRACE_DETAIL_ZONE("vertex");
+  obtain_next_vertex_attribute(ctx, vertex_buffer, vert_id);
+  // 裁剪空间坐标沿用只计算位置的入口的结果，保证剔除与光栅化使用同一个位置
+  vec4 clip_coord;
+  invoke_vertex_shader(ctx, output, clip_coord);
+}
+
+void graphics_pipeline_cache::fill_uniforms(
+    std::byte *block, const std::vector<uniform_detail> &details,
+    const const_memory_array<1 << 8> &descriptor_set
 ) {
-  auto &frame = *state.frame_buffer_;
-  auto width = frame.width();
-  auto height = frame.height();
+  for (auto &detail : details) {
+    auto src = descriptor_set[detail.binding];
+    if (detail.indirect) {
+      std::memcpy(block + detail.offset, &src, sizeof(src));
+    } else if (src) {
+      std::memcpy(block + detail.offset, src, detail.size);
+    }
+  }
+}
+
+int graphics_pipeline_cache::clip_and_cull(
+    pipeline_context &ctx, const render_target &target, const vec4 (&clip_coords)[3], bool reversed,
+    vec4 (&clipped)[6], const vec4 *&polygon
+) const {
+  PLAID_STATISTICS_ADD(primitives_assembled, 1);
+
+  polygon = clip_coords;
+  auto vertex_cnt = 3;
+  PLAID_TRACE_DETAIL_ZONE_BEGIN(clip_zone, "clip");
+  // 三个顶点都在裁剪空间之内的三角形占绝大多数，不需要逐个平面裁剪
+  if (!inside_clip_volume(clip_coords[0]) || !inside_clip_volume(clip_coords[1]) ||
+      !inside_clip_volume(clip_coords[2])) {
+    PLAID_STATISTICS_ADD(primitives_clipped, 1);
+    polygon = clipped;
+    vertex_cnt = clip_triangle(clip_coords, clipped);
+    if (vertex_cnt < 3) {
+      PLAID_STATISTICS_ADD(primitives_culled_outside, 1);
+      return 0;
+    }
+  }
 
-  vec2 view[3];
-  float z[3];
   {
-    auto *view_it = view;
-    auto *z_it = z;
-    for (auto v : clip_coord) {
-      // CLIP -> NDC -> VIEW
-      // [-w, w] -> [-1, 1] -> [0, width]
-      view_it->x = (v->x / v->w + 1.f) / 2 * width;
-      // [-w, w] -> [-1, 1] -> [0, height]
-      view_it->y = (v->y / v->w + 1.f) / 2 * height;
-      // [0, w] -> [0, 1]
-      *z_it = v->z / v->w;
-      ++view_it;
-      ++z_it;
+    // 在光栅化 (以及分块记录) 之前进行面剔除，裁剪得到的凸多边形与原三角形朝向相同，
+    // 用整个多边形的有向面积判断朝向，NDC 到屏幕坐标的缩放不改变符号
+    vec2 ndc[6];
+    for (int i = 0; i != vertex_cnt; ++i) {
+      ndc[i] = {polygon[i].x / polygon[i].w, polygon[i].y / polygon[i].w};
+    }
+    float area = 0;
+    for (int i = 1; i < vertex_cnt - 1; ++i) {
+      area += cross(ndc[i] - ndc[0], ndc[i + 1] - ndc[0]);
+    }
+    if (area == 0) {
+      PLAID_STATISTICS_ADD(primitives_culled_degenerate, 1);
+      return 0;
+    }
+    // 视口翻转一个坐标轴时屏幕上的朝向也随之翻转
+    if ((target.viewport.width * target.viewport.height < 0) != reversed) {
+      area = -area;
+    }
+    if (((ctx.cull_mode & cull_modes::back) && area > 0) || ((ctx.cull_mode & cull_modes::front) && area < 0)) {
+      PLAID_STATISTICS_ADD(primitives_culled_face, 1);
+      return 0;
+    }
+
+    // 密集网格中大量三角形小于一个像素，在计算属性平面方程 (以及执行完整的顶点着色器、分块记录) 之前丢弃
+    // 不覆盖任何像素中心的三角形，屏幕坐标与 [rasterize_triangle] 中的计算完全相同
+    vec2 view[6];
+    for (int i = 0; i != vertex_cnt; ++i) {
+      view[i] = viewport_transform(target.viewport, ndc[i]);
+    }
+    std::uint32_t box[4];
+    if (!sample_bounds(view, vertex_cnt, target.area, box)) {
+      PLAID_STATISTICS_ADD(primitives_missed_samples, 1);
+      return 0;
     }
   }
+  PLAID_TRACE_DETAIL_ZONE_END(clip_zone);
+  return vertex_cnt;
+}
 
-  auto ab = view[1] - view[0];
-  auto ac = view[2] - view[0];
+void graphics_pipeline_cache::emit_polygon(
+    pipeline_context &ctx, const render_pass::state &state, const render_target &target,
+    const vec4 (&clip_coords)[3], const vec4 *polygon, int vertex_cnt
+) const {
+  if (!setup_planes(ctx, target, clip_coords)) {
+    PLAID_STATISTICS_ADD(primitives_culled_degenerate, 1);
+    return;
+  }
 
-  {
-    /// 面剔除
-    vec3 ab3 = {ab.x, ab.y, z[1] - z[0]};
-    vec3 ac3 = {ac.x, ac.y, z[2] - z[0]};
-    auto dir = dot(cross(ab3, ac3), {0, 0, 1});
-    if ((rasterization_state.cull_mode & cull_modes::back) && dir >= 0) {
-      return;
+  const vec4 *triangle[3];
+  triangle[0] = polygon;
+  for (auto i = 1; i <= vertex_cnt - 2; ++i) {
+    triangle[1] = polygon + i;
+    triangle[2] = polygon + i + 1;
+    PLAID_STATISTICS_ADD(primitives_rasterized, 1);
+    if (ctx.defer) {
+      defer_triangle(ctx, triangle);
+    } else if (state.binner_) {
+      // 属性平面方程与第一个顶点的着色器输出位于申请内存的开头，按需一并记录
+      state.binner_->bin_triangle(triangle, ctx.data(), m_payload_size);
+    } else {
+      rasterize_triangle(ctx, target, triangle);
     }
-    if (rasterization_state.cull_mode & cull_modes::front && dir <= 0) {
-      return;
+  }
+}
+
+std::uint32_t graphics_pipeline_cache::deferred_record_size() const noexcept {
+  return (sizeof(vec4) * 3 + m_payload_size + 15) / 16 * 16;
+}
+
+void graphics_pipeline_cache::defer_triangle(pipeline_context &ctx, const vec4 *const (&clip_coord)[3]) const {
+  auto offset = ctx.deferred.size();
+  ctx.deferred.resize(offset + deferred_record_size());
+  auto record = ctx.deferred.data() + offset;
+  for (int i = 0; i != 3; ++i) {
+    std::memcpy(record + sizeof(vec4) * i, clip_coord[i], sizeof(vec4));
+  }
+  std::memcpy(record + sizeof(vec4) * 3, ctx.data(), m_payload_size);
+}
+
+void graphics_pipeline_cache::rasterize_binned(
+    pipeline_context &ctx, const render_target &target, const vec4 (&clip_coord)[3], const std::byte *payload
+) const {
+  if (ctx.pipeline != this) {
+    bind_context(ctx);
+  }
+  std::copy_n(payload, m_payload_size, ctx.data());
+  // 同一次分块渲染中相邻的三角形通常来自同一个描述符集快照
+  if (target.descriptor_set != ctx.fragment_uniforms_source) {
+    fill_uniforms(ctx.fragment_uniforms, m_fragment_uniforms, *target.descriptor_set);
+    ctx.fragment_uniforms_source = target.descriptor_set;
+  }
+  const vec4 *triangle[]{clip_coord, clip_coord + 1, clip_coord + 2};
+  rasterize_triangle(ctx, target, triangle);
+}
+
+bool graphics_pipeline_cache::setup_planes(
+    pipeline_context &ctx, const render_target &target, const vec4 (&clip_coords)[3]
+) const {
+  PLAID_TRACE_DETAIL_ZONE("planes");
+  // 设三列分别为三个顶点 (x, y, w) 的矩阵为 M，屏幕上一点的 NDC 坐标为 (nx, ny)，
+  // 该点在原三角形上的重心坐标 b 满足 M * b = w * (nx, ny, 1)。令 g = M^-1 * (nx, ny, 1)，
+  // 则 b = g / sum(g)，而 g 关于屏幕坐标是线性的，于是 sum(g) 即 1/w，
+  // 深度 sum(g * z) 与属性 sum(g * a) 都只需要一个平面方程，属性再除以 1/w 即完成透视校正
+  vec3 columns[3];
+  for (int i = 0; i != 3; ++i) {
+    columns[i] = {clip_coords[i].x, clip_coords[i].y, clip_coords[i].w};
+  }
+  vec3 rows[]{
+      cross(columns[1], columns[2]),
+      cross(columns[2], columns[0]),
+      cross(columns[0], columns[1]),
+  };
+  auto det = dot(columns[0], rows[0]);
+  [[unlikely]] if (!det) {
+    return false;
+  }
+  det = 1 / det;
+
+  // NDC -> VIEW: nx = (x - vx) / width * 2 - 1, ny = (y - vy) / height * 2 - 1
+  auto &viewport = target.viewport;
+  auto sx = 2.f / viewport.width * det;
+  auto sy = 2.f / viewport.height * det;
+  auto ox = 1 + 2 * viewport.x / viewport.width;
+  auto oy = 1 + 2 * viewport.y / viewport.height;
+  pipeline_context::plane g[3];
+  for (int i = 0; i != 3; ++i) {
+    g[i] = {rows[i].x * sx, rows[i].y * sy, (rows[i].z - rows[i].x * ox - rows[i].y * oy) * det};
+  }
+
+  // 深度映射到视口的深度范围
+  auto depth_range = viewport.max_depth - viewport.min_depth;
+  auto &planes = *ctx.planes;
+  planes.depth = {
+      (g[0].a * clip_coords[0].z + g[1].a * clip_coords[1].z + g[2].a * clip_coords[2].z) * depth_range,
+      (g[0].b * clip_coords[0].z + g[1].b * clip_coords[1].z + g[2].b * clip_coords[2].z) * depth_range,
+      (g[0].c * clip_coords[0].z + g[1].c * clip_coords[1].z + g[2].c * clip_coords[2].z) * depth_range +
+          viewport.min_depth,
+  };
+  if (auto &bias = ctx.depth_bias; bias.constant_factor != 0 || bias.slope_factor != 0) {
+    // r 取三角形最大深度处 float 的精度，位于视点之后的顶点不参与
+    auto max_depth = 0.f;
+    for (auto &v : clip_coords) {
+      if (v.w > 0) {
+        max_depth = (std::max)(max_depth, std::abs(viewport.min_depth + v.z / v.w * depth_range));
+      }
+    }
+    auto r = max_depth > 0 ? std::ldexp(1.f, std::ilogb(max_depth) - std::numeric_limits<float>::digits + 1)
+                           : std::numeric_limits<float>::min();
+    auto m = (std::max)(std::abs(planes.depth.a), std::abs(planes.depth.b));
+    auto offset = bias.constant_factor * r + bias.slope_factor * m;
+    if (bias.clamp > 0) {
+      offset = (std::min)(offset, bias.clamp);
+    } else if (bias.clamp < 0) {
+      offset = (std::max)(offset, bias.clamp);
     }
+    planes.depth.c += offset;
   }
+  planes.inv_w = {
+      g[0].a + g[1].a + g[2].a,
+      g[0].b + g[1].b + g[2].b,
+      g[0].c + g[1].c + g[2].c,
+  };
 
-  auto l = width - 1, t = height - 1, r = 0u, b = 0u;
-  for (auto &v : view) {
-    l = (std::min)(l, static_cast<decltype(l)>(v.x));
-    t = (std::min)(t, static_cast<decltype(l)>(v.y));
-    r = (std::max)(r, static_cast<decltype(l)>(v.x));
-    b = (std::max)(b, static_cast<decltype(l)>(v.y));
+  auto chunk = ctx.data() + m_planes_size;
+  auto stride = m_vertex_output_size;
+  auto pa = ctx.varying_planes[0], pb = ctx.varying_planes[1], pc = ctx.varying_planes[2];
+  for (std::uint32_t k = 0; k != m_varyings_count; ++k) {
+    auto source = chunk + m_varying_sources[k];
+    auto v0 = *reinterpret_cast<const float *>(source);
+    auto v1 = *reinterpret_cast<const float *>(source + stride);
+    auto v2 = *reinterpret_cast<const float *>(source + stride * 2);
+    pa[k] = g[0].a * v0 + g[1].a * v1 + g[2].a * v2;
+    pb[k] = g[0].b * v0 + g[1].b * v1 + g[2].b * v2;
+    pc[k] = g[0].c * v0 + g[1].c * v1 + g[2].c * v2;
+  }
+  // 分量数组末尾的填充也参与插值，保持为 0
+  for (auto k = m_varyings_count; k != m_varyings_stride; ++k) {
+    pa[k] = pb[k] = pc[k] = 0;
   }
-  // 有些三角形裁剪之后，顶点刚好落在边缘上，上面算出来会超出帧缓冲范围
-  r = (std::min)(r, width - 1);
-  b = (std::min)(b, height - 1);
+  return true;
+}
 
-  auto m = cross(ab, ac);
+void graphics_pipeline_cache::rasterize_triangle(
+    pipeline_context &ctx, const render_target &target,
+    const vec4 *const (&clip_coord)[3]
+) const {
+  PLAID_TRACE_DETAIL_ZONE_BEGIN(setup_zone, "setup");
+  // CLIP -> NDC -> VIEW
+  vec2 view[3];
+  for (int i = 0; i != 3; ++i) {
+    view[i] = viewport_transform(target.viewport, *clip_coord[i]);
+  }
+
+  // 只有中心位于顶点包围盒与渲染区域之内的像素才可能被覆盖，范围为空的三角形不需要任何设置
+  std::uint32_t box[4];
+  if (!sample_bounds(view, 3, target.area, box)) {
+    PLAID_STATISTICS_ADD(primitives_missed_samples, 1);
+    return;
+  }
+  auto l = box[0], t = box[1], r = box[2], b = box[3];
+
+  // 面剔除已经在 [clip_and_cull] 中完成，这里只需要三角形的朝向
+  auto m = cross(view[1] - view[0], view[2] - view[0]);
   if (!m) {
     return;
   }
-  m = 1 / m;
-
-  auto pa = view[0] - vec2{l + .5f, t + .5f};
-  auto um = cross(ac, pa);
-  auto vm = cross(pa, ab);
-
-  auto depth_stencil_index = state.current_subpass_->depth_stencil_attachment->id;
-  auto depth_stencil_attachment = frame[depth_stencil_index];
-
-  for (auto y = t; y <= b; ++y) {
-    auto um_first = um, vm_first = vm;
-    for (auto x = l; x <= r; ++x) {
-      auto u = um * m, v = vm * m;
-      if (u >= 0 && v >= 0 && u + v <= 1) {
-        auto p = 1 - u - v;
-        auto k = 1 / (p * z[0] + u * z[1] + v * z[2]);
-        float weight[3]{
-            p * z[0] * k,
-            u * z[1] * k,
-            v * z[2] * k,
-        };
-        auto cz = z[0] * weight[0] + z[1] * weight[1] + z[2] * weight[2];
-        auto pre_z = reinterpret_cast<float *>(depth_stencil_attachment);
-        pre_z += y * width + x;
-        if (cz < *pre_z) {
-          *pre_z = cz;
-          invoke_fragment_shader(state, {float(x), float(y), cz}, y * width + x, weight);
+  // 第 i 条边连接顶点 i 与 i + 1，从起点 o 指向终点的向量为 d 时边函数为 cross(d, (x, y) - o)，
+  // 按三角形的顺序计算时对面顶点处的值为 m，从另一个端点出发时为 -m，乘以对应的符号后内部为正。
+  // 乘以 ±1 没有舍入误差，覆盖测试也不需要除法
+  raster_edges edges;
+  for (int i = 0; i != 3; ++i) {
+    auto p = view[i], q = view[(i + 1) % 3];
+    auto reversed = q.x < p.x || (q.x == p.x && q.y < p.y);
+    auto sign = (m > 0) != reversed ? 1.f : -1.f;
+    edges.origin[i] = reversed ? q : p;
+    edges.direction[i] = (reversed ? p - q : q - p) * sign;
+    // 边函数关于 x 的导数为 -direction.y，关于 y 的导数为 direction.x，
+    // 内部在右侧的边是左边，水平并且内部在下方的边是上边
+    auto &d = edges.direction[i];
+    edges.inclusive[i] = d.y < 0 || (d.y == 0 && d.x > 0);
+  }
+
+  // 不插值的输入在整个三角形上都取第一个顶点的值
+  for (auto &flat : m_flat_inputs) {
+    std::memcpy(ctx.fragment_input + flat.destination, ctx.vertex_output[0] + flat.source, flat.size);
+  }
+
+  // 没有深度附件时不进行深度测试
+  const attachment_view *depth_view = nullptr;
+  if (auto ref = target.subpass->depth_stencil_attachment) {
+    depth_view = target.views + ref->id;
+  }
+  PLAID_TRACE_DETAIL_ZONE_END(setup_zone);
+
+  // 光栅化方式只由三角形自身的宽和高决定，与渲染区域 (分块渲染时为分块) 无关，
+  // 宽度小于 N 的三角形最多跨过 N 列像素中心，限制到渲染区域之后的包围盒同样不超过 N
+  auto width = (std::max)({view[0].x, view[1].x, view[2].x}) - (std::min)({view[0].x, view[1].x, view[2].x});
+  auto height = (std::max)({view[0].y, view[1].y, view[2].y}) - (std::min)({view[0].y, view[1].y, view[2].y});
+
+  // 只覆盖少数像素的三角形一次求出固定大小块的覆盖掩码，不需要分块分类与逐行步进
+  if (width < 2 && height < 2) {
+    if (!rasterize_small_triangle<2>(ctx, target, depth_view, edges, l, t, r - l + 1, b - t + 1)) {
+      PLAID_STATISTICS_ADD(primitives_missed_samples, 1);
+    }
+    return;
+  }
+  if (width < small_triangle_size && height < small_triangle_size) {
+    if (!rasterize_small_triangle<small_triangle_size>(ctx, target, depth_view, edges, l, t, r - l + 1, b - t + 1)) {
+      PLAID_STATISTICS_ADD(primitives_missed_samples, 1);
+    }
+    return;
+  }
+
+  PLAID_TRACE_DETAIL_ZONE("raster");
+  // 包围盒跨过的对齐块逐个处理，只光栅化块与包围盒的交集；
+  // 包围盒不超过一块大小的三角形不需要分类，整个包围盒直接逐个像素测试
+  constexpr auto n = raster_block_size;
+  auto single = width < n && height < n;
+  auto covered = false;
+  for (auto bt = single ? t : t / n * n; bt <= b; bt += n) {
+    auto top = (std::max)(bt, t), bottom = (std::min)(bt + n - 1, b);
+    for (auto bl = single ? l : l / n * n; bl <= r; bl += n) {
+      auto left = (std::max)(bl, l), right = (std::min)(bl + n - 1, r);
+
+      if (!single) {
+        // 边函数是线性的，块内的最小值与最大值都在四个角上的像素中心取到
+        float lo[3], hi[3];
+        for (int c = 0; c != 4; ++c) {
+          float values[3];
+          edges.row(static_cast<float>(c & 2 ? bottom : top) + .5f, values);
+          auto cx = static_cast<float>(c & 1 ? right : left) + .5f;
+          for (int k = 0; k != 3; ++k) {
+            auto e = values[k] - edges.direction[k].y * (cx - edges.origin[k].x);
+            lo[k] = c ? (std::min)(lo[k], e) : e;
+            hi[k] = c ? (std::max)(hi[k], e) : e;
+          }
+        }
+        if (!edges.inside(0, hi[0]) || !edges.inside(1, hi[1]) || !edges.inside(2, hi[2])) {
+          PLAID_STATISTICS_ADD(raster_blocks_skipped, 1);
+          continue;
+        }
+        if (edges.inside(0, lo[0]) && edges.inside(1, lo[1]) && edges.inside(2, lo[2])) {
+          // 整块都被覆盖，逐行填充，不做边测试
+          PLAID_STATISTICS_ADD(raster_blocks_filled, 1);
+          covered = true;
+          for (auto y = top; y <= bottom; ++y) {
+            fill_row(ctx, target, depth_view, bl, left, right, y);
+          }
+          continue;
+        }
+      }
+
+      // 部分覆盖的块逐个像素求边函数
+      for (auto y = top; y <= bottom; ++y) {
+        float values[3];
+        edges.row(static_cast<float>(y) + .5f, values);
+        for (auto x = left; x <= right; ++x) {
+          if (edges.covers(static_cast<float>(x) + .5f, values)) {
+            covered = true;
+            depth_test_fragment(ctx, target, depth_view, x, y);
+          }
         }
       }
-      um += ac.y;
-      vm -= ab.y;
     }
-    um = um_first - ac.x;
-    vm = vm_first + ab.x;
+  }
+  if (!covered) {
+    PLAID_STATISTICS_ADD(primitives_missed_samples, 1);
+  }
+
+  // 队列只在同一个三角形内积累，之后的三角形可能覆盖这些片元
+  if (ctx.lanes_count) {
+    invoke_fragment_shader_lanes(ctx, target);
   }
 }
 
-void graphics_pipeline_cache::invoke_fragment_shader(
-    const render_pass::state &state,
-    vec3 fragcoord,
-    std::uint32_t index, const float (&weight)[3]
-) {
-  {
-    auto it = m_fragment_input, ed = it + m_counts.fragment_input;
-    for (; it != ed; ++it) {
-      auto location = it->location;
-      const std::byte *src[3] = {
-          m_vertex_shader_output[0][location],
-          m_vertex_shader_output[1][location],
-          m_vertex_shader_output[2][location],
-      };
-      it->interpolation(src, weight, m_fragment_shader_input[location]);
+template <std::uint32_t N>
+bool graphics_pipeline_cache::rasterize_small_triangle(
+    pipeline_context &ctx, const render_target &target, const attachment_view *depth_view, const raster_edges &edges,
+    std::uint32_t l, std::uint32_t t, std::uint32_t width, std::uint32_t height
+) const {
+  PLAID_TRACE_DETAIL_ZONE("raster small");
+  // 固定大小的 N * N 块，循环次数是编译期常量，由编译器展开并向量化，边函数与分块路径中的完全相同
+  std::uint32_t mask = 0;
+  for (std::uint32_t dy = 0; dy != N; ++dy) {
+    float values[3];
+    edges.row(static_cast<float>(t + dy) + .5f, values);
+    for (std::uint32_t dx = 0; dx != N; ++dx) {
+      auto inside = (dx < width) & (dy < height) & edges.covers(static_cast<float>(l + dx) + .5f, values);
+      mask |= static_cast<std::uint32_t>(inside) << (dy * N + dx);
     }
   }
-  auto mutable_builtin = reinterpret_cast<memory>(&fragcoord);
-  m_fragment_shader(
-      state.descriptor_set_, const_cast<const_memory(&)[256]>(m_fragment_shader_input),
-      m_fragment_shader_output, &mutable_builtin
-  );
+  for (auto bits = mask; bits; bits &= bits - 1) {
+    auto i = static_cast<std::uint32_t>(std::countr_zero(bits));
+    depth_test_fragment(ctx, target, depth_view, l + i % N, t + i / N);
+  }
+  if (ctx.lanes_count) {
+    invoke_fragment_shader_lanes(ctx, target);
+  }
+  return mask != 0;
+}
+
+void graphics_pipeline_cache::depth_test_fragment(
+    pipeline_context &ctx, const render_target &target, const attachment_view *depth_view, std::uint32_t x,
+    std::uint32_t y
+) const {
+  // 深度在屏幕空间中是线性的，直接由平面方程得到
+  auto &depth = ctx.planes->depth;
+  auto cz = depth.a * (x + .5f) + (depth.b * (y + .5f) + depth.c);
+  PLAID_STATISTICS_ADD(fragments_tested, 1);
+  if (!depth_view) {
+    PLAID_STATISTICS_ADD(fragments_depth_passed, 1);
+    shade_fragment(ctx, target, {float(x), float(y), cz});
+  } else if (auto pre_z = reinterpret_cast<float *>(depth_view->base) + depth_view->index(x, y); cz < *pre_z) {
+    *pre_z = cz;
+    PLAID_STATISTICS_ADD(fragments_depth_passed, 1);
+    PLAID_STATISTICS_ADD(attachment_bytes_written, sizeof(float));
+    shade_fragment(ctx, target, {float(x), float(y), cz});
+  }
+}
+
+void graphics_pipeline_cache::fill_row(
+    pipeline_context &ctx, const render_target &target, const attachment_view *depth_view, std::uint32_t block_left,
+    std::uint32_t left, std::uint32_t right, std::uint32_t y
+) const {
+  static_assert(raster_block_size == lanes_count, "a row of a block is filled as one group of lanes");
+  // 平面方程按 a * x + (b * y + c) 求值，括号内的部分每行只求一次，
+  // 结果与 [depth_test_fragment] 以及片元着色器调用中逐个像素的求值完全相同，不随执行路径改变
+  auto &planes = *ctx.planes;
+  auto cy = static_cast<float>(y) + .5f;
+  floatx8 cx;
+  for (std::uint32_t i = 0; i != lanes_count; ++i) {
+    cx[i] = static_cast<float>(block_left + i) + .5f;
+  }
+  auto z = planes.depth.a * cx + (planes.depth.b * cy + planes.depth.c);
+  auto inv_w = planes.inv_w.a * cx + (planes.inv_w.b * cy + planes.inv_w.c);
+
+  // 通过深度测试的像素记入掩码，第 i 位对应块中第 i 列
+  auto first = left - block_left, last = right - block_left;
+  PLAID_STATISTICS_ADD(fragments_tested, last - first + 1);
+  std::uint32_t mask = 0;
+  if (!depth_view) {
+    mask = (2u << last) - (1u << first);
+  } else {
+    auto pre_z = reinterpret_cast<float *>(depth_view->base) + depth_view->index(left, y);
+    for (auto i = first; i <= last; ++i) {
+      if (z[i] < pre_z[i - first]) {
+        pre_z[i - first] = z[i];
+        mask |= 1u << i;
+      }
+    }
+    PLAID_STATISTICS_ADD(attachment_bytes_written, std::popcount(mask) * sizeof(float));
+  }
+  if (!mask) {
+    return;
+  }
+  PLAID_STATISTICS_ADD(fragments_depth_passed, std::popcount(mask));
+
+  auto pa = ctx.varying_planes[0], pb = ctx.varying_planes[1], pc = ctx.varying_planes[2];
+  if (!m_fragment_shader_lanes) {
+    // 插值分量与 x 无关的部分同样每行只求一次，只有通过深度测试的像素才需要加上 a * x 再乘以 w
+    auto row = ctx.row_varyings;
+    for (std::uint32_t k = 0; k != m_varyings_stride; ++k) {
+      row[k] = pb[k] * cy + pc[k];
+    }
+    for (auto bits = mask; bits; bits &= bits - 1) {
+      auto i = static_cast<std::uint32_t>(std::countr_zero(bits));
+      auto w = 1 / inv_w[i];
+      for (std::uint32_t k = 0; k != m_varyings_stride; ++k) {
+        ctx.varyings[k] = (pa[k] * cx[i] + row[k]) * w;
+      }
+      execute_fragment_shader(ctx, target, {static_cast<float>(block_left + i), static_cast<float>(y), z[i]});
+    }
+    return;
+  }
+
+  // 行中只有部分像素通过深度测试时放入队列，与其它片元凑满一组再执行，不浪费通道
+  if (mask != (1u << lanes_count) - 1) {
+    for (auto bits = mask; bits; bits &= bits - 1) {
+      auto i = static_cast<std::uint32_t>(std::countr_zero(bits));
+      shade_fragment(ctx, target, {static_cast<float>(block_left + i), static_cast<float>(y), z[i]});
+    }
+    return;
+  }
 
-  auto &frame = *state.frame_buffer_;
-  auto it = m_fragment_output, ed = it + m_counts.fragment_output;
+  // 整行作为一组通道执行
+  vec3x8 coord;
+  for (std::uint32_t i = 0; i != lanes_count; ++i) {
+    coord.x[i] = static_cast<float>(block_left + i);
+    coord.y[i] = static_cast<float>(y);
+  }
+  coord.z = z;
+  auto w = 1.f / inv_w;
+  for (std::uint32_t k = 0; k != m_varyings_count; ++k) {
+    ctx.varyings_lanes[k] = (pa[k] * cx + (pb[k] * cy + pc[k])) * w;
+  }
+  execute_fragment_shader_lanes(ctx, target, coord, mask);
+}
+
+void graphics_pipeline_cache::shade_fragment(
+    pipeline_context &ctx, const render_target &target, vec3 fragcoord
+) const {
+  if (!m_fragment_shader_lanes) {
+    invoke_fragment_shader(ctx, target, fragcoord);
+    return;
+  }
+  ctx.lanes_fragcoord.x[ctx.lanes_count] = fragcoord.x;
+  ctx.lanes_fragcoord.y[ctx.lanes_count] = fragcoord.y;
+  ctx.lanes_fragcoord.z[ctx.lanes_count] = fragcoord.z;
+  if (++ctx.lanes_count == lanes_count) {
+    invoke_fragment_shader_lanes(ctx, target);
+  }
+}
+
+void graphics_pipeline_cache::invoke_fragment_shader(
+    pipeline_context &ctx, const render_target &target,
+    vec3 fragcoord
+) const {
+  // 在像素中心求出所有分量的平面方程，再乘以 w 完成透视校正，
+  // 分量连续存放且长度是 8 的倍数，循环可以被编译器向量化
+  auto cx = fragcoord.x + .5f, cy = fragcoord.y + .5f;
+  auto &inv_w = ctx.planes->inv_w;
+  auto w = 1 / (inv_w.a * cx + (inv_w.b * cy + inv_w.c));
+  auto pa = ctx.varying_planes[0], pb = ctx.varying_planes[1], pc = ctx.varying_planes[2];
+  for (std::uint32_t k = 0; k != m_varyings_stride; ++k) {
+    ctx.varyings[k] = (pa[k] * cx + (pb[k] * cy + pc[k])) * w;
+  }
+  execute_fragment_shader(ctx, target, fragcoord);
+}
+
+void graphics_pipeline_cache::execute_fragment_shader(
+    pipeline_context &ctx, const render_target &target,
+    vec3 fragcoord
+) const {
+  PLAID_TRACE_DETAIL_ZONE_BEGIN(fragment_zone, "fragment");
+  auto x = static_cast<std::uint32_t>(fragcoord.x);
+  auto y = static_cast<std::uint32_t>(fragcoord.y);
+
+  // 输入附件只能读取当前像素位置的内容
+  const_memory input_attachments[1 << 8];
+  for (std::size_t i = 0; i != m_input_attachments.size(); ++i) {
+    auto &detail = m_input_attachments[i];
+    auto &view = target.views[detail.attachment_id];
+    input_attachments[i] = view.base + view.index(x, y) * detail.attachment_stride;
+  }
+
+  std::uint32_t lane_mask = 1;
+  memory mutable_builtin[]{
+      reinterpret_cast<memory>(&fragcoord),
+      reinterpret_cast<memory>(input_attachments),
+      reinterpret_cast<memory>(&lane_mask),
+  };
+  m_fragment_shader(ctx.fragment_uniforms, ctx.fragment_input, ctx.fragment_output, mutable_builtin);
+  PLAID_STATISTICS_ADD(fragment_shader_invocations, 1);
+  PLAID_TRACE_DETAIL_ZONE_END(fragment_zone);
+
+  PLAID_TRACE_DETAIL_ZONE("convert");
+
+  auto it = m_fragment_output.data(), ed = it + m_fragment_output.size();
   for (; it != ed; ++it) {
-    if (!it->attachment_stride) {
+    auto &view = target.views[it->attachment_id];
+    if (!view.base) {
       continue;
     }
-    auto ptr = frame[it->attachment_id] + index * it->attachment_stride;
-    it->attachment_transition(m_fragment_shader_output[it->location], ptr);
+    auto ptr = view.base + view.index(x, y) * it->attachment_stride;
+    it->attachment_transition(ctx.fragment_output + it->offset, ptr);
+    PLAID_STATISTICS_ADD(attachment_bytes_written, it->attachment_stride);
+  }
+}
+
+void graphics_pipeline_cache::invoke_fragment_shader_lanes(
+    pipeline_context &ctx, const render_target &target
+) const {
+  auto count = ctx.lanes_count;
+  ctx.lanes_count = 0;
+
+  // 小三角形只有零星几个片元，空闲通道过多时逐个调用更快
+  auto &coord = ctx.lanes_fragcoord;
+  if (count < lanes_count / 2) {
+    for (std::uint32_t i = 0; i != count; ++i) {
+      invoke_fragment_shader(ctx, target, {coord.x[i], coord.y[i], coord.z[i]});
+    }
+    return;
+  }
+
+  // 空闲通道复制第一个片元，使它们的计算结果保持有效
+  for (auto i = count; i != lanes_count; ++i) {
+    coord.x[i] = coord.x[0];
+    coord.y[i] = coord.y[0];
+    coord.z[i] = coord.z[0];
+  }
+
+  {
+    // 与 [invoke_fragment_shader] 相同的插值，每个分量一次算出所有通道
+    auto cx = coord.x + .5f, cy = coord.y + .5f;
+    auto &inv_w = ctx.planes->inv_w;
+    auto w = 1.f / (inv_w.a * cx + (inv_w.b * cy + inv_w.c));
+    auto pa = ctx.varying_planes[0], pb = ctx.varying_planes[1], pc = ctx.varying_planes[2];
+    for (std::uint32_t k = 0; k != m_varyings_count; ++k) {
+      ctx.varyings_lanes[k] = (pa[k] * cx + (pb[k] * cy + pc[k])) * w;
+    }
+  }
+  execute_fragment_shader_lanes(ctx, target, coord, (1u << count) - 1);
+}
+
+void graphics_pipeline_cache::execute_fragment_shader_lanes(
+    pipeline_context &ctx, const render_target &target, vec3x8 &coord, std::uint32_t lane_mask
+) const {
+  PLAID_TRACE_DETAIL_ZONE_BEGIN(fragment_zone, "fragment");
+  memory mutable_builtin[]{
+      reinterpret_cast<memory>(&coord),
+      nullptr,
+      reinterpret_cast<memory>(&lane_mask),
+  };
+  m_fragment_shader_lanes(
+      ctx.fragment_uniforms, reinterpret_cast<const_memory>(ctx.varyings_lanes),
+      ctx.fragment_output_lanes, mutable_builtin
+  );
+  PLAID_STATISTICS_ADD(fragment_shader_invocations, std::popcount(lane_mask));
+  PLAID_TRACE_DETAIL_ZONE_END(fragment_zone);
+
+  PLAID_TRACE_DETAIL_ZONE("convert");
+
+  auto ed = m_fragment_output.data() + m_fragment_output.size();
+  for (auto bits = lane_mask; bits; bits &= bits - 1) {
+    auto lane = static_cast<std::uint32_t>(std::countr_zero(bits));
+    auto x = static_cast<std::uint32_t>(coord.x[lane]);
+    auto y = static_cast<std::uint32_t>(coord.y[lane]);
+    for (auto it = m_fragment_output.data(); it != ed; ++it) {
+      auto &view = target.views[it->attachment_id];
+      if (!view.base) {
+        continue;
+      }
+      // 取出单个通道的输出，再按逐个调用时的方式变换到附件
+      auto src = reinterpret_cast<const floatx8 *>(ctx.fragment_output_lanes + it->offset * lanes_count);
+      auto dst = ctx.fragment_output + it->offset;
+      for (std::uint32_t c = 0; c != it->components; ++c) {
+        reinterpret_cast<float *>(dst)[c] = src[c][lane];
+      }
+      auto ptr = view.base + view.index(x, y) * it->attachment_stride;
+      it->attachment_transition(dst, ptr);
+      PLAID_STATISTICS_ADD(attachment_bytes_written, it->attachment_stride);
+    }
   }
 }
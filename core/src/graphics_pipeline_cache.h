@@ -2,32 +2,60 @@
 #ifndef PLAID_GRAPHICS_PIPELINE_INTERNAL_H_
 #define PLAID_GRAPHICS_PIPELINE_INTERNAL_H_
 
+#include <vector>
+
+#include <plaid/lanes.h>
 #include <plaid/pipeline.h>
 #include <plaid/render_pass.h>
 #include <plaid/shader.h>
+#include <plaid/statistics.h>
 #include <plaid/vec.h>
 
 #include "attachment_transition.h"
+#include "pipeline_context.h"
+#include "render_target.h"
+
+#ifdef PLAID_PIPELINE_STATISTICS
+/// 累加当前绘制的统计计数器，统计位于名为 ctx 的执行上下文中
+#define PLAID_STATISTICS_ADD(counter, n) (ctx.statistics->counter += (n))
+#else
+/// 未开启管道统计时不产生任何代码
+#define PLAID_STATISTICS_ADD(counter, n) static_cast<void>(0)
+#endif
 
 namespace plaid {
 
+/// 光栅化状态，不影响管道的编译结果，派生管道只替换这一部分
+/// 绘制时其中的每一项都可以被渲染通道状态上动态设置的值覆盖
+struct pipeline_rasterization {
+  struct graphics_pipeline::create_info::rasterization_state state;
+  /// 视口，宽度为 0 时使用整个帧缓冲区
+  plaid::viewport viewport;
+  /// 裁剪矩形，宽度为 0 时使用整个帧缓冲区
+  rect2d scissor;
+};
+
+/// 取出创建参数中的光栅化状态
+[[nodiscard]] pipeline_rasterization make_rasterization(const graphics_pipeline::create_info &);
+
+/// 编译完成的图形管道，创建之后不再改变
+/// 执行绘制所需的可变状态都在 [pipeline_context] 中，多个线程可以各自使用自己的上下文同时绘制
 class graphics_pipeline_cache {
 public:
 
   graphics_pipeline_cache(const graphics_pipeline::create_info &);
 
-  ~graphics_pipeline_cache();
-
   /// 按照给定顶点范围执行绘制
+  /// @param pipeline 编译结果为此管道的句柄，提供光栅化状态，sort-last 渲染时复制一份保存到子通道结束
   /// @param vertex_count 要绘制的顶点总数
   /// @param instances_count 要绘制的实例总数
   /// @param first_vertex 第一个顶点的编号
   /// @param first_instance 第一个实例的编号
   void draw(
-      const plaid::render_pass::state &,
+      const plaid::render_pass::state &, const graphics_pipeline &pipeline,
       std::uint32_t vertices_count, std::uint32_t instances_count,
       std::uint32_t first_vertex, std::uint32_t first_instance
-  );
+  ) const;
 
   /// 按照索引缓冲区的顺序执行绘制
   /// @param indices_count 要绘制的顶点总数
@@ -36,170 +64,398 @@ public:
   /// @param vertex_offset 顶点编号偏移
   /// @param first_instance 第一个实例的编号
   void draw_indexed(
-      const plaid::render_pass::state &,
+      const plaid::render_pass::state &, const graphics_pipeline &pipeline,
       std::uint32_t indices_count, std::uint32_t instances_count,
       std::uint32_t first_index, std::int32_t vertex_offset,
       std::uint32_t first_instance
-  );
+  ) const;
+
+  /// 依次执行多组绘制参数
+  /// @param commands 第一组 [draw_indirect_command] 的地址
+  /// @param draws_count 绘制参数的组数
+  /// @param stride 相邻两组参数之间的字节数
+  void draw_indirect(
+      const plaid::render_pass::state &, const graphics_pipeline &pipeline,
+      const std::byte *commands, std::uint32_t draws_count, std::uint32_t stride
+  ) const;
+
+  /// 依次执行多组索引绘制参数
+  /// @param commands 第一组 [draw_indexed_indirect_command] 的地址
+  /// @param draws_count 绘制参数的组数
+  /// @param stride 相邻两组参数之间的字节数
+  void draw_indexed_indirect(
+      const plaid::render_pass::state &, const graphics_pipeline &pipeline,
+      const std::byte *commands, std::uint32_t draws_count, std::uint32_t stride
+  ) const;
+
+  /// 光栅化分块渲染时记录下来的三角形
+  /// @param target 当前分块
+  /// @param clip_coord 三角形裁剪空间坐标
+  /// @param payload 记录三角形时一同保存的属性平面方程，有不插值的输入时还有第一个顶点的着色器输出
+  void rasterize_binned(
+      pipeline_context &, const render_target &target, const vec4 (&clip_coord)[3], const std::byte *payload
+  ) const;
 
 private:
 
-  /// 将采用颜色清除值重置附件
-  static void clear_color_attachment(const render_pass::state &, attachment_reference);
-
-  /// 采用模板清除值重置附件
-  static void clear_stencil_attachment(const render_pass::state &, attachment_reference);
+  /// 按照管道的内存布局划分上下文的内存
+  void bind_context(pipeline_context &) const;
 
+  /// 准备绘制状态，然后依次执行每组绘制参数
+  /// @param commands 第一组绘制参数的地址，Indexed 为真时是 [draw_indexed_indirect_command]，
+  /// 否则是 [draw_indirect_command]
   template <bool Indexed>
   void draw_internal(
-      const render_pass::state &,
+      const render_pass::state &, const graphics_pipeline &pipeline,
+      const std::byte *commands, std::uint32_t draws_count, std::uint32_t stride
+  ) const;
+
+  /// 按顶点装配模式绘制一段实例
+  template <bool Indexed>
+  void draw_instances(
+      pipeline_context &, const render_pass::state &, const render_target &,
       std::uint32_t first, std::uint32_t last,
       std::uint32_t first_inst, std::uint32_t last_inst,
-      std::int32_t vertex_offset
-  );
+      std::int32_t vert_offset
+  ) const;
 
+  /// 把实例分成若干段交给工作线程，各线程只执行到裁剪与属性平面方程为止并记录三角形，
+  /// 全部完成后由调用线程按实例顺序光栅化，结果与单线程绘制相同
   template <bool Indexed>
-  std::uint32_t actual_vertex(std::uint32_t position, std::int32_t vert_offset);
+  void draw_instances_parallel(
+      pipeline_context &, const render_pass::state &, const render_target &,
+      std::uint32_t first, std::uint32_t last,
+      std::uint32_t first_inst, std::uint32_t last_inst,
+      std::int32_t vert_offset
+  ) const;
+
+  /// 实例的包围球是否与视锥相交，没有绑定包围球时总是为真
+  static bool instance_visible(const render_pass::state &, std::uint32_t inst);
+
+  /// 图元重启索引，所有位都为 1
+  static constexpr std::uint32_t restart_index = 0xFFFFFFFF;
 
-  /// 绘制 (n / 3) 个三角形，不对顶点进行重用
+  /// 读取绘制中第 position 个顶点对应的索引，16 位的重启索引扩展为 [restart_index]
+  /// 非索引绘制时直接返回 position
+  template <bool Indexed>
+  static std::uint32_t fetch_index(const render_pass::state &, std::uint32_t position);
+
+  /// 绘制 (n / 3) 个三角形，索引绘制时通过上下文的后变换顶点缓存重用最近执行过顶点着色器的顶点
   /// @param first 第一个顶点/索引编号
   /// @param last 最后一个顶点/索引之后的顶点/索引编号 (不绘制)
   /// @param first_inst 第一个实例的编号
   /// @param last_inst 最后一个实例之后的实例 (不绘制)
   template <bool Indexed>
   void draw_triangle_list(
-      const render_pass::state &,
+      pipeline_context &, const render_pass::state &, const render_target &,
       std::uint32_t first, std::uint32_t last,
       std::uint32_t first_inst, std::uint32_t last_inst,
       std::int32_t vert_offset
-  );
+  ) const;
 
-  /// 绘制 (n - 2) 个三角形，第 2 ~ (n - 1) 个顶点存在共用
+  /// 绘制 (n - 2) 个三角形，第 2 ~ (n - 1) 个顶点存在共用，
+  /// 第奇数个三角形 (从 0 开始) 的前两个顶点交换顺序，使所有三角形朝向一致
   /// @param first 第一个顶点/索引编号
   /// @param last 最后一个顶点/索引之后的顶点/索引编号 (不绘制)
   /// @param first_inst 第一个实例的编号
   /// @param last_inst 最后一个实例之后的实例 (不绘制)
   template <bool Indexed>
   void draw_triangle_strip(
-      const render_pass::state &,
+      pipeline_context &, const render_pass::state &, const render_target &,
       std::uint32_t first, std::uint32_t last,
       std::uint32_t first_inst, std::uint32_t last_inst,
       std::int32_t vert_offset
-  );
+  ) const;
 
   /// 更新逐顶点属性
   /// @param vertex_buffer 顶点缓冲区列表
   /// @param inst_id 顶点 ID
-  void obtain_next_vertex_attribute(const const_memory_array<1 << 8> &vertex_buffer, std::uint32_t vert_id);
+  void obtain_next_vertex_attribute(
+      pipeline_context &, const const_memory_array<1 << 8> &vertex_buffer, std::uint32_t vert_id
+  ) const;
 
   /// 更新逐实例属性
   /// @param vertex_buffer 顶点缓冲区列表
   /// @param inst_id 实例 ID
-  void obtain_next_instance_attributes(const const_memory_array<1 << 8> &vertex_buffer, std::uint32_t inst_id);
+  void obtain_next_instance_attributes(
+      pipeline_context &, const const_memory_array<1 << 8> &vertex_buffer, std::uint32_t inst_id
+  ) const;
 
   /// 执行顶点着色器
-  /// @param descriptor_set 描述符集列表
-  /// @param output 接收顶点着色器输出变量列表
+  /// @param output 接收顶点着色器输出的输出块
   /// @param clip_coord 接收裁剪空间坐标
-  void invoke_vertex_shader(
-      const const_memory_array<1 << 8> &descriptor_set,
-      const memory_array<1 << 8> &output, vec4 &clip_coord
+  void invoke_vertex_shader(pipeline_context &, memory output, vec4 &clip_coord) const;
+
+  /// 执行只计算位置的顶点着色器入口
+  /// @param output 输出块，入口不需要写入，写入的内容也会被之后完整的顶点着色器覆盖
+  /// @param clip_coord 接收裁剪空间坐标
+  void invoke_position_shader(pipeline_context &, memory output, vec4 &clip_coord) const;
+
+  /// 读取顶点属性并计算裁剪空间坐标，有只计算位置的入口时只执行它
+  /// @return 输出块是否已经由完整的顶点着色器写入
+  bool transform_vertex(
+      pipeline_context &, const const_memory_array<1 << 8> &vertex_buffer, std::uint32_t vert_id,
+      memory output, vec4 &clip_coord
+  ) const;
+
+  /// 三角形通过剔除之后，为只执行过位置入口的顶点重新读取属性并执行完整的顶点着色器
+  void shade_vertex(
+      pipeline_context &, const const_memory_array<1 << 8> &vertex_buffer, std::uint32_t vert_id, memory output
+  ) const;
+
+  /// 着色器常量元属性
+  struct uniform_detail {
+    /// 绑定点编号
+    std::uint8_t binding;
+    /// 为真时只保存描述符的地址
+    bool indirect;
+    /// 在常量块中的字节偏移
+    std::uint32_t offset;
+    /// 复制到常量块中的字节数
+    std::uint32_t size;
+  };
+
+  /// 按照描述符集填充常量块
+  static void fill_uniforms(
+      std::byte *block, const std::vector<uniform_detail> &details,
+      const const_memory_array<1 << 8> &descriptor_set
   );
 
-  /// 光栅化三角形
-  void rasterize_triangle(const render_pass::state &, const vec4 *const (&)[3]);
+  /// 裁剪并剔除三角形，只用到裁剪空间坐标，可以在顶点着色器输出就绪之前进行
+  /// @param clip_coords 三个顶点的裁剪空间坐标
+  /// @param reversed 顶点的存放顺序与三角形的实际环绕方向相反，只影响面剔除
+  /// @param clipped 三角形被裁剪时接收裁剪得到的凸多边形
+  /// @param polygon 接收需要光栅化的多边形，没有被裁剪时指向 clip_coords
+  /// @return 多边形的顶点数，三角形被剔除时为 0
+  int clip_and_cull(
+      pipeline_context &, const render_target &, const vec4 (&clip_coords)[3], bool reversed,
+      vec4 (&clipped)[6], const vec4 *&polygon
+  ) const;
+
+  /// 计算属性平面方程，把 [clip_and_cull] 得到的多边形拆成三角形交给光栅化或者分块记录
+  /// @param clip_coords 三个顶点的裁剪空间坐标，对应的输出位于上下文的顶点着色器输出块
+  void emit_polygon(
+      pipeline_context &, const render_pass::state &, const render_target &, const vec4 (&clip_coords)[3],
+      const vec4 *polygon, int vertex_cnt
+  ) const;
+
+  /// 计算原三角形上深度、1/w 以及所有插值分量关于屏幕坐标的平面方程，
+  /// 裁剪得到的每个三角形都位于同一平面上，可以共用
+  /// @param clip_coords 三个顶点的裁剪空间坐标，对应的输出位于上下文的顶点着色器输出块
+  /// @return 三角形所在平面经过视点时无法计算，返回 false
+  bool setup_planes(pipeline_context &, const render_target &, const vec4 (&clip_coords)[3]) const;
+
+  /// 记录一个三角形的裁剪空间坐标、属性平面方程与第一个顶点的着色器输出
+  void defer_triangle(pipeline_context &, const vec4 *const (&clip_coord)[3]) const;
+
+  /// 每个记录的三角形所占的字节数，保持 16 字节对齐
+  [[nodiscard]] std::uint32_t deferred_record_size() const noexcept;
+
+  /// 三角形三条边的边函数，在三角形内部为正
+  /// 每条边都从字典序较小的端点出发计算，共用一条边的两个三角形在同一像素中心求出的值只差一个符号，
+  /// 值恰好为 0 的像素中心 (包括恰好位于顶点上的) 按左上填充规则只属于其中一个三角形
+  struct raster_edges {
+    /// 每条边的起点
+    vec2 origin[3];
+    /// 起点指向另一个端点的向量，已经乘以使三角形内部为正的符号
+    vec2 direction[3];
+    /// 左边与上边为真，边函数为 0 的像素中心被覆盖，其余的边要求边函数大于 0
+    /// 用比较方式而不是阈值区分，非规格化数被当作 0 (FTZ/DAZ) 时规则同样成立
+    bool inclusive[3];
+
+    /// 三条边函数在屏幕坐标 y 为 cy 的一行上与 x 无关的部分
+    void row(float cy, float (&values)[3]) const noexcept {
+      for (int k = 0; k != 3; ++k) {
+        values[k] = direction[k].x * (cy - origin[k].y);
+      }
+    }
+
+    /// 第 k 条边的边函数值 e 是否满足覆盖条件
+    [[nodiscard]] bool inside(int k, float e) const noexcept {
+      return inclusive[k] ? e >= 0 : e > 0;
+    }
+
+    /// 屏幕坐标 x 为 cx 的点是否被三角形覆盖，不短路求值，便于编译器向量化
+    /// @param values 所在行由 [row] 求出的部分
+    [[nodiscard]] bool covers(float cx, const float (&values)[3]) const noexcept {
+      return inside(0, values[0] - direction[0].y * (cx - origin[0].x)) &
+             inside(1, values[1] - direction[1].y * (cx - origin[1].x)) &
+             inside(2, values[2] - direction[2].y * (cx - origin[2].x));
+    }
+  };
+
+  /// 光栅化三角形，属性平面方程需要已经计算完成
+  void rasterize_triangle(pipeline_context &, const render_target &, const vec4 *const (&)[3]) const;
+
+  /// 像素中心包围盒不超过 N * N 的三角形的光栅化，一次求出整块的覆盖掩码，只对覆盖的像素逐个处理
+  /// @param edges 三角形的边函数
+  /// @param l 像素中心包围盒左上角
+  /// @param width 像素中心包围盒的宽度，不超过 N
+  /// @return 是否覆盖了任何像素中心
+  template <std::uint32_t N>
+  bool rasterize_small_triangle(
+      pipeline_context &, const render_target &, const attachment_view *depth_view, const raster_edges &edges,
+      std::uint32_t l, std::uint32_t t, std::uint32_t width, std::uint32_t height
+  ) const;
+
+  /// 对被覆盖的像素做深度测试，通过时执行片元着色器
+  /// @param depth_view 深度附件，为空时不进行深度测试
+  void depth_test_fragment(
+      pipeline_context &, const render_target &, const attachment_view *depth_view, std::uint32_t x, std::uint32_t y
+  ) const;
+
+  /// 填充完全被覆盖的块中的一行，深度、1/w 与插值分量的平面方程中与 x 无关的部分每行只求一次，
+  /// 按通道执行时整行都通过深度测试则作为一组通道执行
+  /// @param block_left 块的左端，对齐到 [raster_block_size]
+  /// @param left 行中第一个像素
+  /// @param right 行中最后一个像素
+  void fill_row(
+      pipeline_context &, const render_target &, const attachment_view *depth_view, std::uint32_t block_left,
+      std::uint32_t left, std::uint32_t right, std::uint32_t y
+  ) const;
+
+  /// 对通过深度测试的片元执行片元着色器，按通道执行时先放入队列，凑满 [lanes_count] 个再执行
+  /// @param fragcoord 片元屏幕坐标
+  void shade_fragment(pipeline_context &, const render_target &, vec3 fragcoord) const;
+
+  /// 求出片元的插值分量并执行片元着色器
+  /// @param fragcoord 片元屏幕坐标
+  void invoke_fragment_shader(pipeline_context &, const render_target &, vec3 fragcoord) const;
 
-  /// 执行片元着色器
+  /// 执行片元着色器并写入附件，插值分量需要已经写入片元着色器输入块
   /// @param fragcoord 片元屏幕坐标
-  /// @param index 片元在每个附件中的索引
-  /// @param weight 三个顶点的权重
-  void invoke_fragment_shader(const render_pass::state &, vec3 fragcoord, std::uint32_t index, const float (&weight)[3]);
+  void execute_fragment_shader(pipeline_context &, const render_target &, vec3 fragcoord) const;
+
+  /// 按通道执行队列中的片元，不足 [lanes_count] 个时空闲通道的输出被丢弃
+  void invoke_fragment_shader_lanes(pipeline_context &, const render_target &) const;
+
+  /// 按通道执行片元着色器并写入附件，插值分量需要已经写入按通道执行的输入块
+  /// @param coord 各通道的片元屏幕坐标
+  /// @param lane_mask 有效通道的掩码，其余通道的输出被丢弃
+  void execute_fragment_shader_lanes(
+      pipeline_context &, const render_target &, vec3x8 &coord, std::uint32_t lane_mask
+  ) const;
 
 public:
 
-  viewport viewport;
+  /// 实例化绘制的顶点总数 (每个实例的顶点数乘以实例数) 达到此值时才分给多个线程
+  static constexpr std::uint64_t parallel_vertices_min = 1 << 12;
+  /// 每个线程平均分到的实例段数，分段越多负载越均衡
+  static constexpr std::uint32_t parallel_jobs_per_worker = 8;
+  /// 光栅化按此大小、对齐到屏幕坐标的正方形块进行，完全在三角形外的块跳过，
+  /// 完全在三角形内的块不做边测试，每一行按通道执行时正好是一组通道
+  static constexpr std::uint32_t raster_block_size = lanes_count;
+  /// 像素中心包围盒的宽和高都不超过此值的三角形按小三角形光栅化，不经过分块分类
+  static constexpr std::uint32_t small_triangle_size = 4;
 
   /// 顶点装配模式
   primitive_topology vertex_assembly;
-
-  struct graphics_pipeline::create_info::rasterization_state rasterization_state;
+  /// 索引绘制时是否启用图元重启
+  bool primitive_restart;
 
 private:
 
+  /// 上下文内存依次是属性平面方程、三个顶点的着色器输出块、片元着色器输入块与输出块、
+  /// 顶点着色器输入块、两个着色器的常量块、按通道执行时的输入块与输出块以及逐行填充时的插值分量，以下为各块的字节偏移
   struct {
-    /// 顶点着色器逐顶点属性数量
-    std::uint8_t vertex_input_per_vertex;
-    /// 顶点着色器逐实例属性数量
-    std::uint8_t vertex_input_per_instance;
-    /// 片元着色器属性数量
-    std::uint8_t fragment_input;
-    /// 片元着色器输出数量
-    std::uint8_t fragment_output;
-    /// 颜色附件数量
-    std::uint8_t color_attachments;
-  } m_counts;
-
-  /// 动态申请出的内存
-  std::byte *m_allocated_memory;
-  /// 申请出的内存分为 4 + 1 块，此值表示前 4 块，每一块的字节数
-  std::uint32_t m_allocated_memory_chunk_size;
+    std::uint32_t varying_planes;
+    std::uint32_t fragment_input;
+    std::uint32_t fragment_output;
+    std::uint32_t vertex_input;
+    std::uint32_t vertex_uniforms;
+    std::uint32_t fragment_uniforms;
+    std::uint32_t lanes_input;
+    std::uint32_t lanes_output;
+    std::uint32_t row_varyings;
+    /// 总字节数
+    std::uint32_t size;
+    /// 每一块共同的对齐
+    std::uint32_t align;
+  } m_layout;
+  /// 每个顶点着色器输出块的字节数
+  std::uint32_t m_vertex_output_size;
+  /// 属性平面方程块的字节数，它与第一个顶点的着色器输出相邻，分块渲染时一起记录
+  std::uint32_t m_planes_size;
+  /// 分块渲染与延迟光栅化为每个三角形记录的额外数据的字节数，
+  /// 只有存在不插值的输入时才包括第一个顶点的着色器输出
+  std::uint32_t m_payload_size;
+
+  /// 插值分量总数
+  std::uint32_t m_varyings_count;
+  /// 插值分量数组的长度，向上取整到 8 的倍数
+  std::uint32_t m_varyings_stride;
+  /// 每个插值分量在顶点着色器输出块中的字节偏移
+  std::vector<std::uint32_t> m_varying_sources;
+
+  /// 不插值的片元着色器输入，从第一个顶点的输出复制
+  struct flat_input_detail {
+    /// 在顶点着色器输出块中的字节偏移
+    std::uint32_t source;
+    /// 在片元着色器输入块中的字节偏移
+    std::uint32_t destination;
+    /// 字节大小
+    std::uint32_t size;
+  };
+  std::vector<flat_input_detail> m_flat_inputs;
 
   /// 顶点着色器入口函数
   shader_module::entry_function *m_vertex_shader;
-  /// 顶点着色器输入变量的地址索引表，一个数组下标就对应一个变量编号
-  const std::byte *m_vertex_shader_input[1 << 8];
-  /// 顶点着色器输出变量的地址索引表，一个数组下标就对应一个变量编号
-  std::byte *m_vertex_shader_output[3][1 << 8];
+  /// 只计算位置的顶点着色器入口函数，为空时每个顶点直接执行完整的顶点着色器
+  shader_module::entry_function *m_position_shader;
+  /// 顶点着色器使用的常量
+  std::vector<uniform_detail> m_vertex_uniforms;
 
   /// 着色器输入变量元属性
   struct vertex_input_detail {
-    /// 属性的编号
-    std::uint8_t location;
     /// 绑定点编号
     std::uint8_t binding;
     /// 顶点缓冲区数据项字节数
     std::uint32_t stride;
     /// 数据偏移量
     std::uint32_t offset;
+    /// 在顶点着色器输入块中的字节偏移
+    std::uint32_t destination;
+    /// 属性的字节大小
+    std::uint32_t size;
   };
   /// 保存顶点着色器逐顶点属性
-  vertex_input_detail m_vertex_input_per_vertex[1 << 8];
+  std::vector<vertex_input_detail> m_vertex_input_per_vertex;
   /// 保存顶点着色器逐实例属性
-  vertex_input_detail m_vertex_input_per_instance[1 << 8];
+  std::vector<vertex_input_detail> m_vertex_input_per_instance;
 
   /// 片元着色器入口函数
   shader_module::entry_function *m_fragment_shader;
-  /// 片元着色器输入变量的地址索引表，一个数组下标就对应一个变量编号
-  std::byte *m_fragment_shader_input[1 << 8];
-  /// 片元着色器输出变量的地址索引表，一个数组下标就对应一个变量编号
-  std::byte *m_fragment_shader_output[1 << 8];
-
-  /// 片元着色器输入变量元属性
-  struct fragment_input_detail {
-    /// 变量编号
-    std::uint8_t location;
-    /// 插值函数
-    shader_stage_variable_description::interpolation_function *interpolation;
-  };
-  /// 保存片元着色器变量元属性
-  fragment_input_detail m_fragment_input[1 << 8];
+  /// 片元着色器使用的常量
+  std::vector<uniform_detail> m_fragment_uniforms;
+  /// 片元着色器按通道执行的入口函数，着色器或子通道不支持时为空
+  shader_module::entry_function *m_fragment_shader_lanes;
 
   /// 片元着色器输出变量元属性
   struct fragment_output_detail {
-    /// 变量编号
-    std::uint8_t location;
+    /// 在片元着色器输出块中的字节偏移
+    std::uint32_t offset;
     /// 目标附件编号
     std::uint8_t attachment_id;
     /// 目标附件单位长度
     std::uint32_t attachment_stride;
+    /// 变量的 float 分量数，按通道执行时据此取出单个通道
+    std::uint32_t components;
     /// 内存布局变换函数
     attachment_transition_function *attachment_transition;
   };
   /// 保存片元着色器变量元属性
-  fragment_output_detail m_fragment_output[1 << 8];
+  std::vector<fragment_output_detail> m_fragment_output;
+
+  /// 输入附件元属性
+  struct input_attachment_detail {
+    /// 附件编号
+    std::uint8_t attachment_id;
+    /// 附件单位长度
+    std::uint32_t attachment_stride;
+  };
+  /// 保存子通道输入附件的元属性，下标对应着色器中的输入附件编号
+  std::vector<input_attachment_detail> m_input_attachments;
 
-  /// 索引缓冲区
-  std::uint32_t *m_index_buffer;
 };
 
 } // namespace plaid
@@ -0,0 +1,150 @@
+#include <cstring>
+#include <type_traits>
+
+#include <plaid/pipeline_cache.h>
+#include <plaid/render_pass.h>
+#include <plaid/shader.h>
+
+#include "graphics_pipeline_cache.h"
+
+using namespace plaid;
+
+namespace {
+
+/// 把管道编译结果所依赖的参数逐个字段写入字节串，结构体的填充字节不参与比较
+class pipeline_key {
+public:
+
+  template <class Tp>
+  void append(const Tp &value) {
+    static_assert(std::is_scalar_v<Tp>);
+    char bytes[sizeof(Tp)];
+    std::memcpy(bytes, &value, sizeof(Tp));
+    key_.append(bytes, sizeof(Tp));
+  }
+
+  void append(const shader_stage_variable_description &d) {
+    append(d.format);
+    append(d.location);
+    append(d.size);
+    append(d.align);
+    append(d.components);
+    append(d.offset);
+  }
+
+  void append(const shader_uniform_description &d) {
+    append(d.binding);
+    append(d.indirect);
+    append(d.size);
+    append(d.align);
+    append(d.offset);
+  }
+
+  void append(const attachment_reference &ref) {
+    append(ref.id);
+    append(ref.format);
+  }
+
+  /// 写入元素个数与每一个元素
+  template <class Tp>
+  void append_array(const Tp *first, std::size_t count) {
+    append(count);
+    for (auto it = first, ed = first + count; it != ed; ++it) {
+      append(*it);
+    }
+  }
+
+  void append(const shader_module &module) {
+    append(module.entry);
+    append(module.lanes_entry);
+    append(module.position_entry);
+    auto &meta = module.variables_meta;
+    append(meta.inputs_size);
+    append(meta.outputs_size);
+    append(meta.uniforms_size);
+    append(meta.align);
+    append_array(meta.inputs, meta.inputs_count);
+    append_array(meta.outputs, meta.outputs_count);
+    append_array(meta.uniforms, meta.uniforms_count);
+  }
+
+  [[nodiscard]] std::string &&str() && noexcept {
+    return static_cast<std::string &&>(key_);
+  }
+
+private:
+  std::string key_;
+};
+
+std::string make_key(const graphics_pipeline::create_info &info) {
+  pipeline_key key;
+  key.append(info.input_assembly_state.topology);
+  key.append(info.input_assembly_state.primitive_restart_enable);
+
+  auto &vertex_input = info.vertex_input_state;
+  key.append(vertex_input.bindings_count);
+  for (auto it = vertex_input.bindings, ed = it + vertex_input.bindings_count; it != ed; ++it) {
+    key.append(it->binding);
+    key.append(it->input_rate);
+    key.append(it->stride);
+  }
+  key.append(vertex_input.attributes_count);
+  for (auto it = vertex_input.attributes, ed = it + vertex_input.attributes_count; it != ed; ++it) {
+    key.append(it->location);
+    key.append(it->binding);
+    key.append(it->offset);
+  }
+
+  key.append(info.shader_stage.vertex_shader);
+  key.append(info.shader_stage.fragment_shader);
+
+  // 管道只从子通道中读取附件的编号与格式
+  auto &subpass = info.render_pass.subpass(info.subpass);
+  key.append_array(subpass.input_attachments, subpass.input_attachments_count);
+  key.append_array(subpass.color_attachments, subpass.color_attachments_count);
+  return static_cast<pipeline_key &&>(key).str();
+}
+
+} // namespace
+
+graphics_pipeline pipeline_cache::create(const graphics_pipeline::create_info &info) {
+  auto key = make_key(info);
+  graphics_pipeline res;
+  res.rasterization_ = std::make_shared<pipeline_rasterization>(make_rasterization(info));
+  {
+    std::lock_guard lock(mutex_);
+    auto it = pipelines_.find(key);
+    if (it != pipelines_.end()) {
+      res.cache_ = it->second;
+      return res;
+    }
+  }
+
+  // 编译时不持有锁，其他线程可以同时创建不同的管道，
+  // 两个线程同时编译相同的参数时保留先插入的结果
+  auto compiled = std::make_shared<const graphics_pipeline_cache>(info);
+  std::lock_guard lock(mutex_);
+  res.cache_ = pipelines_.try_emplace(static_cast<std::string &&>(key), compiled).first->second;
+  return res;
+}
+
+graphics_pipeline pipeline_cache::derive(
+    const graphics_pipeline &base, const struct graphics_pipeline::create_info::rasterization_state &state
+) {
+  graphics_pipeline res;
+  res.cache_ = base.cache_;
+  auto rasterization = *base.rasterization_;
+  rasterization.state = state;
+  res.rasterization_ = std::make_shared<pipeline_rasterization>(rasterization);
+  return res;
+}
+
+std::size_t pipeline_cache::size() const {
+  std::lock_guard lock(mutex_);
+  return pipelines_.size();
+}
+
+void pipeline_cache::clear() {
+  std::lock_guard lock(mutex_);
+  pipelines_.clear();
+}
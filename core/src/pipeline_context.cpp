@@ -0,0 +1,41 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "pipeline_context.h"
+
+using namespace plaid;
+
+static std::byte *aligned_malloc(std::uint32_t size, std::uint32_t al) {
+  if (!al || (al & -al) != al) {
+    return nullptr;
+  }
+  static constexpr auto address = sizeof(std::uintptr_t *);
+  auto real_size = address + size + al - 1;
+  auto start = reinterpret_cast<std::uintptr_t>(std::malloc(real_size));
+  std::uintptr_t *dat = reinterpret_cast<std::uintptr_t *>((start + address + al - 1) / al * al);
+  *(dat - 1) = start;
+  return reinterpret_cast<std::byte *>(dat);
+}
+
+static void aligned_free(void *ptr) {
+  std::free(*(reinterpret_cast<void **>(ptr) - 1));
+}
+
+pipeline_context::~pipeline_context() {
+  if (memory_) {
+    aligned_free(memory_);
+  }
+}
+
+std::byte *pipeline_context::reserve(std::uint32_t size, std::uint32_t align) {
+  // 只增不减，在不同管道之间切换时不需要反复申请
+  if (size > capacity_ || align > align_) {
+    if (memory_) {
+      aligned_free(memory_);
+    }
+    capacity_ = (std::max)(size, capacity_);
+    align_ = (std::max)(align, align_);
+    memory_ = aligned_malloc(capacity_, align_);
+  }
+  return memory_;
+}
@@ -0,0 +1,157 @@
+#pragma once
+#ifndef PLAID_PIPELINE_CONTEXT_H_
+#define PLAID_PIPELINE_CONTEXT_H_
+
+#include <cstddef>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <plaid/lanes.h>
+#include <plaid/pipeline.h>
+#include <plaid/shader.h>
+#include <plaid/statistics.h>
+#include <plaid/vec.h>
+
+namespace plaid {
+
+class graphics_pipeline_cache;
+
+/// 管道执行时的全部可变状态，每个渲染通道状态持有一份
+/// 管道本身在创建之后不再改变，多个线程各自使用自己的上下文即可同时使用同一个管道绘制
+class pipeline_context {
+public:
+
+  /// 一个关于屏幕坐标的平面方程 f(x, y) = a * x + b * y + c
+  struct plane {
+    float a, b, c;
+  };
+
+  /// 深度与 1/w 的平面方程，插值分量的平面方程除以 1/w 即得到透视校正的结果
+  struct depth_planes {
+    plane depth;
+    plane inv_w;
+  };
+
+  pipeline_context() = default;
+
+  pipeline_context(const pipeline_context &) = delete;
+
+  ~pipeline_context();
+
+  /// 保证内存至少有 [size] 字节并且满足 [align] 对齐，原有内容不保留
+  /// @return 内存的起始地址
+  std::byte *reserve(std::uint32_t size, std::uint32_t align);
+
+  /// 内存的起始地址，属性平面方程块位于这里
+  [[nodiscard]] std::byte *data() const noexcept { return memory_; }
+
+  /// 当前内存按照哪个管道的布局划分，为空时需要先由管道绑定
+  const graphics_pipeline_cache *pipeline = nullptr;
+  /// 当前绘制的面剔除模式，已经应用了动态状态
+  plaid::cull_mode cull_mode;
+  /// 当前绘制的深度偏移，已经应用了动态状态
+  plaid::depth_bias depth_bias;
+
+  /// 位于属性平面方程块开头
+  depth_planes *planes;
+  /// 插值分量平面方程的三个系数，各自连续存放
+  float *varying_planes[3];
+  /// 插值完成的分量，位于片元着色器输入块的开头
+  float *varyings;
+  /// 逐行填充时插值分量平面方程中与 x 无关的部分 b * y + c
+  float *row_varyings;
+
+  /// 顶点着色器输入块
+  std::byte *vertex_input;
+  /// 三个顶点各自的顶点着色器输出块，第一块紧随属性平面方程块
+  std::byte *vertex_output[3];
+  /// 顶点着色器常量块
+  std::byte *vertex_uniforms;
+
+  /// 片元着色器输入块
+  std::byte *fragment_input;
+  /// 片元着色器输出块
+  std::byte *fragment_output;
+  /// 片元着色器常量块
+  std::byte *fragment_uniforms;
+  /// 片元着色器常量块当前内容所来自的描述符集，分块渲染时描述符集改变才需要重新填充
+  const const_memory_array<1 << 8> *fragment_uniforms_source = nullptr;
+
+  /// 按通道执行时的插值分量，同时也是按通道执行时的输入块
+  floatx8 *varyings_lanes;
+  /// 按通道执行时的片元着色器输出块
+  std::byte *fragment_output_lanes;
+  /// 等待按通道执行的片元坐标
+  vec3x8 lanes_fragcoord;
+  /// 等待按通道执行的片元数
+  std::uint32_t lanes_count = 0;
+
+  /// 为真时三角形不立即光栅化，连同属性平面方程与第一个顶点的着色器输出一起记录到 [deferred]，
+  /// 多线程绘制实例时由发起绘制的线程按实例顺序光栅化
+  bool defer = false;
+  std::vector<std::byte> deferred;
+
+  /// 索引绘制三角形列表时的后变换顶点缓存，按先进先出替换，大小与常见硬件相当，
+  /// 按这一模型重排过三角形的网格 (见 plaid::mesh::optimize) 大部分顶点只需执行一次顶点着色器
+  struct vertex_cache {
+    static constexpr std::uint32_t size = 16;
+    /// 空槽的索引，索引绘制中它总是图元重启标记，不会被缓存
+    static constexpr std::uint32_t empty = 0xFFFFFFFF;
+
+    /// 每个槽对应的索引
+    std::uint32_t indices[size];
+    /// 每个槽的裁剪空间坐标
+    vec4 clip_coords[size];
+    /// 每个槽的输出块是否已经由完整的顶点着色器写入，只执行过位置入口的顶点为假
+    bool shaded[size];
+    /// 每个槽的顶点着色器输出块依次存放
+    std::vector<std::byte> outputs;
+    /// 每个输出块的字节数
+    std::uint32_t output_size;
+    /// 下一个被替换的槽
+    std::uint32_t next;
+
+    /// 清空所有槽，着色器的输入 (逐实例属性、常量) 改变时缓存的结果不再有效
+    void reset(std::uint32_t vertex_output_size) {
+      std::fill_n(indices, size, empty);
+      output_size = vertex_output_size;
+      outputs.resize(size * vertex_output_size);
+      next = 0;
+    }
+
+    /// @return 索引所在的槽，不在缓存中时为 size
+    [[nodiscard]] std::uint32_t find(std::uint32_t index) const noexcept {
+      std::uint32_t slot = 0;
+      while (slot != size && indices[slot] != index) {
+        ++slot;
+      }
+      return slot;
+    }
+
+    /// 替换最早放入的槽
+    /// @return 被替换的槽
+    std::uint32_t insert(std::uint32_t index) noexcept {
+      auto slot = next;
+      indices[slot] = index;
+      next = (next + 1) % size;
+      return slot;
+    }
+
+    [[nodiscard]] std::byte *output(std::uint32_t slot) noexcept { return outputs.data() + output_size * slot; }
+  } vertex_cache;
+
+#ifdef PLAID_PIPELINE_STATISTICS
+  /// 当前绘制的统计，分块渲染时每个三角形需要写回它所属的绘制
+  pipeline_statistics *statistics = nullptr;
+#endif
+
+private:
+  std::byte *memory_ = nullptr;
+  std::uint32_t capacity_ = 0;
+  std::uint32_t align_ = 0;
+};
+
+} // namespace plaid
+
+#endif // PLAID_PIPELINE_CONTEXT_H_
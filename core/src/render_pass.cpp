@@ -1,9 +1,93 @@
 #include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include <plaid/frame_buffer.h>
+#include <plaid/trace.h>
 
 #include "graphics_pipeline_cache.h"
+#include "pipeline_context.h"
+#include "render_target.h"
+#include "sort_last_renderer.h"
+#include "tile_binner.h"
+#include "worker_pool.h"
 
 using namespace plaid;
 
+namespace {
+
+/// 从矩阵的行直接得到视锥平面：-w <= x <= w，-w <= y <= w，0 <= z <= w
+/// 平面的 xyz 为单位法线，指向视锥内侧
+void frustum_planes(const mat4 &m, vec4 (&planes)[6]) {
+  auto row = [&m](std::size_t r) { return vec4{m(r, 0), m(r, 1), m(r, 2), m(r, 3)}; };
+  auto x = row(0), y = row(1), z = row(2), w = row(3);
+  vec4 unnormalized[]{w + x, w - x, w + y, w - y, z, w - z};
+  for (int i = 0; i != 6; ++i) {
+    auto &p = unnormalized[i];
+    auto length = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+    planes[i] = length > 0 ? p * (1 / length) : p;
+  }
+}
+
+/// 齐次坐标下的视点，即变换后 x、y、w 都为 0 的点，是矩阵第 0、1、3 行的四维叉积
+/// 透视投影时视点是 xyz / w，正交投影时 w 为 0，xyz 是指向视点的方向
+vec4 eye_point(const mat4 &m) {
+  auto minor = [&m](int c0, int c1, int c2) {
+    vec3 a{m(0, c0), m(1, c0), m(3, c0)}, b{m(0, c1), m(1, c1), m(3, c1)}, c{m(0, c2), m(1, c2), m(3, c2)};
+    return dot(a, cross(b, c));
+  };
+  return {-minor(1, 2, 3), minor(0, 2, 3), -minor(0, 1, 3), minor(0, 1, 2)};
+}
+
+/// 在顶点处理之前判断网格簇能否整体剔除
+class cluster_culler {
+public:
+
+  /// @param flip 视口是否翻转了一个坐标轴
+  cluster_culler(const mat4 &clip_transform, cull_mode mode, bool flip)
+      : eye_(eye_point(clip_transform)), mode_(mode), flip_(flip) {
+    frustum_planes(clip_transform, planes_);
+  }
+
+  [[nodiscard]] bool visible(const cluster &c) const {
+    for (auto &plane : planes_) {
+      if (plane.x * c.center.x + plane.y * c.center.y + plane.z * c.center.z + plane.w < -c.radius) {
+        return false;
+      }
+    }
+    if (mode_ == cull_modes::none || c.cone_cos <= 0) {
+      return true;
+    }
+
+    // 视点 e 为齐次坐标时，三角形 (a, b, c) 投影之后的有向面积与 -dot(n, e.xyz - e.w * p) 同号，
+    // 其中 n = cross(b - a, c - a)，p 是三角形所在平面上的任意一点。
+    // 令 g = e.xyz - e.w * center，p 在包围球内时 e.xyz - e.w * p 与 g 相差不超过 |e.w| * radius，
+    // 法线在圆锥之内时 dot(n, g) / |n| 不小于 dot(g, axis) * cos - |cross(g, axis)| * sin
+    vec3 g{eye_.x - eye_.w * c.center.x, eye_.y - eye_.w * c.center.y, eye_.z - eye_.w * c.center.z};
+    auto along = dot(g, c.cone_axis);
+    auto across = abs(cross(g, c.cone_axis));
+    auto sin = std::sqrt((std::max)(1 - c.cone_cos * c.cone_cos, 0.f));
+    auto slack = std::abs(eye_.w) * c.radius;
+    // 所有三角形的 dot(n, e.xyz - e.w * p) 都为正 (都为负)
+    auto positive = along * c.cone_cos - across * sin > slack;
+    auto negative = -along * c.cone_cos - across * sin > slack;
+    // 与 [graphics_pipeline_cache::clip_and_cull] 一致：有向面积为正的是背面
+    auto back = flip_ ? positive : negative;
+    auto front = flip_ ? negative : positive;
+    return !(((mode_ & cull_modes::back) && back) || ((mode_ & cull_modes::front) && front));
+  }
+
+private:
+  vec4 planes_[6];
+  vec4 eye_;
+  cull_mode mode_;
+  bool flip_;
+};
+
+} // namespace
+
 render_pass::render_pass(const create_info &info) {
   subpass_description *copied_subpasses = nullptr;
   if (info.subpasses_count) {
@@ -36,10 +120,99 @@ render_pass::render_pass(const create_info &info) {
     }
   }
 
+  attachment_usage *usages = nullptr;
+  if (info.attachments_count) {
+    usages = new attachment_usage[info.attachments_count];
+    std::fill_n(usages, info.attachments_count, attachment_usage{0xff, 0, false});
+    auto use = [&](const attachment_reference &ref, std::uint8_t subpass) {
+      auto &usage = usages[ref.id];
+      usage.first_subpass = (std::min)(usage.first_subpass, subpass);
+      usage.last_subpass = (std::max)(usage.last_subpass, subpass);
+    };
+    for (std::uint8_t i = 0; i != info.subpasses_count; ++i) {
+      auto &subpass = info.subpasses[i];
+      std::for_each_n(subpass.input_attachments, subpass.input_attachments_count, [&](auto &ref) { use(ref, i); });
+      std::for_each_n(subpass.color_attachments, subpass.color_attachments_count, [&](auto &ref) { use(ref, i); });
+      if (subpass.depth_stencil_attachment) {
+        use(*subpass.depth_stencil_attachment, i);
+        usages[subpass.depth_stencil_attachment->id].depth_stencil = true;
+      }
+    }
+  }
+
+  std::uint8_t *merged_last = nullptr;
+  if (info.subpasses_count) {
+    // 相邻子通道之间只存在逐像素的依赖时才能合并，合并组内的子通道共享分块内存
+    bool merge_with_previous[1 << 8]{};
+    std::uint8_t group_first = 0;
+    for (std::uint8_t i = 1; i != info.subpasses_count; ++i) {
+      bool by_region = false, other = false;
+      for (auto it = info.dependencies, ed = it + info.dependencies_count; it != ed; ++it) {
+        if (it->dst_subpass != i || it->src_subpass < group_first || it->src_subpass >= i) {
+          continue;
+        }
+        (it->flags & dependency_flags::by_region ? by_region : other) = true;
+      }
+      merge_with_previous[i] = by_region && !other;
+      if (!merge_with_previous[i]) {
+        group_first = i;
+      }
+    }
+
+    merged_last = new std::uint8_t[info.subpasses_count];
+    std::uint8_t last = info.subpasses_count - 1;
+    for (auto i = last + 1; i-- != 0;) {
+      merged_last[i] = last;
+      if (!merge_with_previous[i]) {
+        last = i - 1;
+      }
+    }
+  }
+
   subpasses_count_ = info.subpasses_count;
   attachments_count_ = info.attachments_count;
   subpasses_ = copied_subpasses;
   attachments_ = copied_attachments;
+  attachment_usages_ = usages;
+  merged_last_ = merged_last;
+}
+
+bool render_pass::tile_resident(std::uint8_t attachment, std::uint8_t first, std::uint8_t last) const {
+  auto &usage = attachment_usages_[attachment];
+  if (usage.first_subpass < first || usage.last_subpass > last) {
+    return false;
+  }
+  auto &desc = attachments_[attachment];
+  if (usage.depth_stencil) {
+    return desc.stencil_load_op != attachment_load_op::load &&
+           desc.stencil_store_op == attachment_store_op::dont_care;
+  }
+  return desc.load_op != attachment_load_op::load &&
+         desc.store_op == attachment_store_op::dont_care;
+}
+
+bool render_pass::tiled(std::uint8_t first, std::uint8_t last) const {
+  if (first != last) {
+    return true;
+  }
+  for (std::uint8_t i = 0; i != attachments_count_; ++i) {
+    if (tile_resident(i, first, last)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool render_pass::transient(std::uint8_t attachment) const {
+  auto first = attachment_usages_[attachment].first_subpass;
+  if (first >= subpasses_count_) {
+    return false;
+  }
+  auto last = merged_last_[first];
+  while (first && merged_last_[first - 1] == last) {
+    --first;
+  }
+  return tile_resident(attachment, first, last);
 }
 
 render_pass::render_pass(render_pass &&mov) noexcept {
@@ -47,10 +220,14 @@ render_pass::render_pass(render_pass &&mov) noexcept {
   subpasses_count_ = mov.subpasses_count_;
   attachments_ = mov.attachments_;
   subpasses_ = mov.subpasses_;
+  attachment_usages_ = mov.attachment_usages_;
+  merged_last_ = mov.merged_last_;
   mov.attachments_count_ = 0;
   mov.subpasses_count_ = 0;
   mov.attachments_ = nullptr;
   mov.subpasses_ = nullptr;
+  mov.attachment_usages_ = nullptr;
+  mov.merged_last_ = nullptr;
 }
 
 render_pass::~render_pass() {
@@ -72,6 +249,12 @@ render_pass::~render_pass() {
   if (attachments_) {
     delete [] attachments_;
   }
+  if (attachment_usages_) {
+    delete [] attachment_usages_;
+  }
+  if (merged_last_) {
+    delete [] merged_last_;
+  }
 }
 
 render_pass &render_pass::operator=(render_pass &&mov) noexcept {
@@ -79,18 +262,147 @@ render_pass &render_pass::operator=(render_pass &&mov) noexcept {
 }
 
 render_pass::state::state(const begin_info &begin) {
+  render_pass_ = &begin.render_pass;
   attachment_descriptions_ = begin.render_pass.attachments_;
   current_subpass_ = first_subpass_ = begin.render_pass.subpasses_;
   last_subpass_ = first_subpass_ + begin.render_pass.subpasses_count_;
+  std::fill(std::begin(descriptor_set_), std::end(descriptor_set_), nullptr);
+  std::fill(std::begin(vertex_buffer_), std::end(vertex_buffer_), nullptr);
+  index_buffer_ = nullptr;
+  index_type_ = index_type::uint32;
   frame_buffer_ = &begin.frame_buffer;
   clear_values_count_ = begin.clear_values_count;
   clear_values_ = begin.clear_values;
+  dynamic_state_ = 0;
+  instance_bounds_ = nullptr;
+  binner_ = nullptr;
+  mode_ = begin.mode;
+  sort_last_ = nullptr;
+  context_ = new pipeline_context;
+  worker_contexts_ = nullptr;
+  worker_contexts_count_ = 0;
+  begin_subpass();
+}
+
+render_pass::state::state(const state &parent, const plaid::frame_buffer &frame_buffer) {
+  render_pass_ = parent.render_pass_;
+  attachment_descriptions_ = parent.attachment_descriptions_;
+  first_subpass_ = parent.first_subpass_;
+  current_subpass_ = parent.current_subpass_;
+  last_subpass_ = parent.last_subpass_;
+  std::fill(std::begin(descriptor_set_), std::end(descriptor_set_), nullptr);
+  std::fill(std::begin(vertex_buffer_), std::end(vertex_buffer_), nullptr);
+  index_buffer_ = nullptr;
+  index_type_ = index_type::uint32;
+  frame_buffer_ = &frame_buffer;
+  clear_values_count_ = parent.clear_values_count_;
+  clear_values_ = parent.clear_values_;
+  dynamic_state_ = 0;
+  instance_bounds_ = nullptr;
+  binner_ = nullptr;
+  mode_ = render_mode::immediate;
+  sort_last_ = nullptr;
+  context_ = new pipeline_context;
+  worker_contexts_ = nullptr;
+  worker_contexts_count_ = 0;
+}
+
+render_pass::state::~state() {
+  // 析构时不渲染，没有经过 [end] 或 [next_subpass] 提交的分块渲染与 sort-last 渲染直接丢弃，
+  // 析构函数因此不会抛出异常，绘制或者渲染抛出异常之后状态也能安全地销毁
+  delete binner_;
+  delete sort_last_;
+  delete context_;
+  delete[] worker_contexts_;
+}
+
+void render_pass::state::begin_subpass() {
+  [[unlikely]] if (current_subpass_ == last_subpass_ || binner_ || sort_last_) {
+    return;
+  }
+
+  auto index = static_cast<std::uint8_t>(current_subpass_ - first_subpass_);
+  auto last = render_pass_->merged_last_[index];
+  if (render_pass_->tiled(index, last)) {
+    // 合并组内的子通道全部记录下来，在组结束时再逐块渲染，附件清除也将逐块进行；
+    // 单独的子通道存在瞬态附件时同样逐块渲染，使瞬态附件不需要整帧的内存
+    binner_ = new tile_binner(*this, index, last);
+    return;
+  }
+
+  attachment_view views[1 << 8];
+  frame_views(views);
+  clear_attachments(index, views, {{0, 0}, {frame_buffer_->width(), frame_buffer_->height()}});
+  // 没有深度附件时无法按深度合成，只有一个线程时也没有必要
+  if (mode_ == render_mode::sort_last && current_subpass_->depth_stencil_attachment &&
+      worker_pool::instance().concurrency() > 1) {
+    sort_last_ = new sort_last_renderer(*this);
+  }
+}
+
+void render_pass::state::frame_views(attachment_view *views) const {
+  auto &frame = *frame_buffer_;
+  auto index = static_cast<std::uint8_t>(current_subpass_ - first_subpass_);
+  for (std::uint8_t i = 0; i != render_pass_->attachments_count_; ++i) {
+    auto &usage = render_pass_->attachment_usages_[i];
+    auto discard = !usage.depth_stencil && usage.last_subpass <= index &&
+                   attachment_descriptions_[i].store_op == attachment_store_op::dont_care;
+    views[i] = {discard ? nullptr : frame[i], frame.width(), 0, 0};
+  }
+}
+
+void render_pass::state::clear_attachments(
+    std::uint8_t subpass, const attachment_view *views, const rect2d &area
+) const {
+  PLAID_TRACE_ZONE("clear");
+  auto clear = [&](const attachment_reference &ref, bool depth_stencil) {
+    auto &desc = attachment_descriptions_[ref.id];
+    auto load_op = depth_stencil ? desc.stencil_load_op : desc.load_op;
+    if (load_op != attachment_load_op::clear ||
+        render_pass_->attachment_usages_[ref.id].first_subpass != subpass) {
+      return;
+    }
+    clear_attachment(views[ref.id], ref, clear_values_[ref.id], depth_stencil, area);
+  };
+
+  auto &desc = first_subpass_[subpass];
+  std::for_each_n(desc.color_attachments, desc.color_attachments_count, [&](auto &ref) { clear(ref, false); });
+  if (desc.depth_stencil_attachment) {
+    clear(*desc.depth_stencil_attachment, true);
+  }
 }
 
 void render_pass::state::next_subpass() {
+  [[unlikely]] if (current_subpass_ == last_subpass_) {
+    throw std::runtime_error("The render pass has already ended.");
+  }
+  auto index = static_cast<std::uint8_t>(current_subpass_ - first_subpass_);
+  if ((binner_ && render_pass_->merged_last_[index] == index) || sort_last_) {
+    flush();
+  }
   ++current_subpass_;
   if (current_subpass_ == last_subpass_) {
-    current_subpass_ = first_subpass_;
+    // 越过最后一个子通道即结束渲染通道，之后不再接受绘制
+    end();
+    return;
+  }
+  begin_subpass();
+}
+
+void render_pass::state::end() {
+  flush();
+  current_subpass_ = last_subpass_;
+}
+
+void render_pass::state::flush() {
+  // 先取走记录再渲染，渲染抛出异常时记录同样被释放，不会被再次渲染
+  if (binner_) {
+    std::unique_ptr<tile_binner> binner(std::exchange(binner_, nullptr));
+    binner->flush();
+  }
+  if (sort_last_) {
+    std::unique_ptr<sort_last_renderer> sort_last(std::exchange(sort_last_, nullptr));
+    sort_last->flush();
   }
 }
 
@@ -102,25 +414,143 @@ void render_pass::state::bind_vertex_buffer(std::uint8_t binding, const std::byt
   vertex_buffer_[binding] = buf;
 }
 
+void render_pass::state::bind_index_buffer(const std::byte *buffer, index_type type) {
+  index_buffer_ = buffer;
+  index_type_ = type;
+}
+
+void render_pass::state::bind_instance_bounds(const instance_bounds &bounds) {
+  instance_bounds_ = bounds.spheres;
+  instance_bounds_stride_ = bounds.stride;
+  frustum_planes(bounds.clip_transform, instance_planes_);
+}
+
+void render_pass::state::set_viewport(const viewport &viewport) {
+  viewport_ = viewport;
+  dynamic_state_ |= dynamic_viewport;
+}
+
+void render_pass::state::set_scissor(const rect2d &scissor) {
+  scissor_ = scissor;
+  dynamic_state_ |= dynamic_scissor;
+}
+
+void render_pass::state::set_cull_mode(cull_mode mode) {
+  cull_mode_ = mode;
+  dynamic_state_ |= dynamic_cull_mode;
+}
+
+void render_pass::state::set_depth_bias(const depth_bias &bias) {
+  depth_bias_ = bias;
+  dynamic_state_ |= dynamic_depth_bias;
+}
+
+void render_pass::state::reset_dynamic_state() noexcept {
+  dynamic_state_ = 0;
+}
+
 void render_pass::state::draw(
-    graphics_pipeline &pipeline,
+    const graphics_pipeline &pipeline,
     std::uint32_t vertex_count, std::uint32_t instance_count,
     std::uint32_t first_vertex, std::uint32_t first_instance
 ) {
-  graphics_pipeline_cache &cache = pipeline;
-  cache.draw(
-      *this, vertex_count, instance_count, first_vertex, first_instance
+  pipeline.cache().draw(
+      *this, pipeline, vertex_count, instance_count, first_vertex, first_instance
   );
 }
 
 void render_pass::state::draw_indexed(
-  graphics_pipeline &pipeline,
+  const graphics_pipeline &pipeline,
   std::uint32_t indices_count, std::uint32_t instances_count,
   std::uint32_t first_index, std::int32_t vertex_offset,
   std::uint32_t first_instance
 ) {
-  graphics_pipeline_cache &cache = pipeline;
-  cache.draw_indexed(
-    *this, indices_count, instances_count, first_index, vertex_offset, first_instance
+  pipeline.cache().draw_indexed(
+    *this, pipeline, indices_count, instances_count, first_index, vertex_offset, first_instance
   );
 }
+
+void render_pass::state::draw_indirect(
+    const graphics_pipeline &pipeline, const std::byte *commands, std::uint32_t draws_count, std::uint32_t stride
+) {
+  pipeline.cache().draw_indirect(*this, pipeline, commands, draws_count, stride);
+}
+
+void render_pass::state::draw_indexed_indirect(
+    const graphics_pipeline &pipeline, const std::byte *commands, std::uint32_t draws_count, std::uint32_t stride
+) {
+  pipeline.cache().draw_indexed_indirect(*this, pipeline, commands, draws_count, stride);
+}
+
+void render_pass::state::draw_clusters(
+    const graphics_pipeline &pipeline, const cluster *clusters, std::uint32_t clusters_count,
+    const mat4 &clip_transform, std::int32_t vertex_offset
+) {
+  [[unlikely]] if (current_subpass_ == last_subpass_) {
+    throw std::runtime_error("The render pass has already ended.");
+  }
+  [[unlikely]] if (pipeline.vertex_assembly() != primitive_topology::triangle_list) {
+    throw std::runtime_error("Clusters can only be drawn as triangle lists.");
+  }
+
+  // 与绘制时一致地取得面剔除模式与视口
+  auto &rasterization = pipeline.rasterization();
+  auto mode = dynamic_state_ & dynamic_cull_mode ? cull_mode_ : rasterization.state.cull_mode;
+  auto &viewport = dynamic_state_ & dynamic_viewport ? viewport_ : rasterization.viewport;
+  cluster_culler culler(clip_transform, mode, viewport.width * viewport.height < 0);
+
+  // 索引范围相接的簇合并为一组绘制参数
+  cluster_commands_.clear();
+  [[maybe_unused]] std::uint32_t culled = 0;
+  for (auto it = clusters, ed = clusters + clusters_count; it != ed; ++it) {
+    PLAID_TRACE_DETAIL_ZONE("cluster cull");
+    if (!culler.visible(*it)) {
+      ++culled;
+      continue;
+    }
+    if (!cluster_commands_.empty()) {
+      auto &back = cluster_commands_.back();
+      if (back.first_index + back.indices_count == it->first_index) {
+        back.indices_count += it->indices_count;
+        continue;
+      }
+    }
+    cluster_commands_.push_back({it->indices_count, 1, it->first_index, vertex_offset, 0});
+  }
+
+#ifdef PLAID_PIPELINE_STATISTICS
+  auto draws = draw_statistics_.size();
+#endif
+  // 所有簇都被剔除时不需要准备绘制
+  if (!cluster_commands_.empty()) {
+    pipeline.cache().draw_indexed_indirect(
+        *this, pipeline, reinterpret_cast<const std::byte *>(cluster_commands_.data()),
+        static_cast<std::uint32_t>(cluster_commands_.size()), sizeof(draw_indexed_indirect_command)
+    );
+  }
+#ifdef PLAID_PIPELINE_STATISTICS
+  // 没有留下绘制统计时 (所有簇都被剔除或者裁剪矩形为空) 仍然算作一次绘制，使剔除的簇数不会丢失
+  if (draw_statistics_.size() == draws) {
+    draw_statistics_.emplace_back();
+  }
+  draw_statistics_.back().clusters_culled += culled;
+#endif
+}
+
+#ifdef PLAID_PIPELINE_STATISTICS
+std::uint32_t render_pass::state::draws_count() const noexcept {
+  return static_cast<std::uint32_t>(draw_statistics_.size());
+}
+
+const pipeline_statistics &render_pass::state::draw_statistics(std::uint32_t draw) const {
+  return draw_statistics_[draw];
+}
+
+pipeline_statistics render_pass::state::statistics() const {
+  pipeline_statistics sum{};
+  for (auto &draw : draw_statistics_) {
+    sum += draw;
+  }
+  return sum;
+}
+#endif
@@ -0,0 +1,58 @@
+#include <cstring>
+
+#include "attachment_transition.h"
+#include "render_target.h"
+
+using namespace plaid;
+
+static void clear_by_format(
+    format src, format dst,
+    std::byte *first, std::byte *last,
+    const std::byte *val, std::uint32_t stride
+) {
+  if (src == dst) {
+    for (; first != last; first += stride) {
+      std::memcpy(first, val, stride);
+    }
+  } else {
+    // 绑定布局转换函数
+    auto trans = match_attachment_transition_function(src, dst);
+    for (; first != last; first += stride) {
+      trans(val, first);
+    }
+  }
+}
+
+void plaid::clear_attachment(
+    const attachment_view &view, attachment_reference ref,
+    const clear_value &value, bool depth_stencil, const rect2d &area
+) {
+  if (!view.base) {
+    return;
+  }
+
+  // 根据附件类型选定清除值
+  auto src_format = format::undefined;
+  const std::byte *src = nullptr;
+  if (depth_stencil) {
+    if (is_float_format(ref.format)) {
+      src_format = format::R32f;
+      src = reinterpret_cast<const std::byte *>(&value.depth_stencil.depth);
+    }
+  } else if (is_float_format(ref.format)) {
+    src_format = format::RGBA32f;
+    src = reinterpret_cast<const std::byte *>(&value.color.f);
+  } else if (is_unsigned_integer_format(ref.format)) {
+    src_format = format::RGBA32u;
+    src = reinterpret_cast<const std::byte *>(&value.color.u);
+  }
+
+  auto stride = format_size(ref.format);
+  auto x = static_cast<std::uint32_t>(area.offset.x);
+  auto y = static_cast<std::uint32_t>(area.offset.y);
+  for (auto row = y, ed = y + area.extent.height; row != ed; ++row) {
+    auto first = view.base + view.index(x, row) * stride;
+    auto last = first + area.extent.width * stride;
+    clear_by_format(src_format, ref.format, first, last, src, stride);
+  }
+}
@@ -0,0 +1,89 @@
+#pragma once
+#ifndef PLAID_RENDER_TARGET_H_
+#define PLAID_RENDER_TARGET_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include <plaid/pipeline.h>
+#include <plaid/render_pass.h>
+#include <plaid/shader.h>
+#include <plaid/utility.h>
+#include <plaid/vec.h>
+
+namespace plaid {
+
+/// 附件在一块渲染区域上的内存视图，整帧渲染时指向帧缓冲区，分块渲染时可能指向分块内存
+struct attachment_view {
+  /// 视图左上角像素的内存，为空表示这个附件的内容会被丢弃
+  std::byte *base;
+  /// 每行像素的数目
+  std::uint32_t pitch;
+  /// 视图左上角在帧缓冲区中的位置
+  std::uint32_t x, y;
+
+  /// 获取像素在视图中的索引
+  [[nodiscard]] constexpr std::uint32_t
+  index(std::uint32_t px, std::uint32_t py) const noexcept {
+    return (py - y) * pitch + (px - x);
+  }
+};
+
+/// 一次光栅化的目标
+struct render_target {
+  /// 当前绘制的视口
+  plaid::viewport viewport;
+  /// 允许写入的区域，即裁剪矩形，分块渲染时再与当前分块相交
+  rect2d area;
+  /// 以附件编号为下标的视图数组
+  const attachment_view *views;
+  /// 当前子通道
+  const subpass_description *subpass;
+  /// 当前绘制所使用的描述符集
+  const const_memory_array<1 << 8> *descriptor_set;
+};
+
+/// 对 NDC 坐标进行视口变换，得到屏幕坐标
+[[nodiscard]] inline vec2 viewport_transform(const viewport &viewport, const vec2 &ndc) noexcept {
+  // [-1, 1] -> [x, x + width]
+  return {
+      viewport.x + (ndc.x + 1.f) / 2 * viewport.width,
+      viewport.y + (ndc.y + 1.f) / 2 * viewport.height,
+  };
+}
+
+/// 对裁剪空间坐标进行透视除法与视口变换，得到屏幕坐标
+[[nodiscard]] inline vec2 viewport_transform(const viewport &viewport, const vec4 &clip) noexcept {
+  return viewport_transform(viewport, vec2{clip.x / clip.w, clip.y / clip.w});
+}
+
+/// 两个矩形的交集，不相交时宽或高为 0
+[[nodiscard]] inline rect2d intersect(const rect2d &lhs, const rect2d &rhs) noexcept {
+  auto right = [](const rect2d &r) { return r.offset.x + static_cast<std::int64_t>(r.extent.width); };
+  auto bottom = [](const rect2d &r) { return r.offset.y + static_cast<std::int64_t>(r.extent.height); };
+  auto l = (std::max)(lhs.offset.x, rhs.offset.x);
+  auto t = (std::max)(lhs.offset.y, rhs.offset.y);
+  auto r = (std::min)(right(lhs), right(rhs));
+  auto b = (std::min)(bottom(lhs), bottom(rhs));
+  return {
+      {l, t},
+      {static_cast<std::uint32_t>((std::max)(r - l, std::int64_t{0})),
+       static_cast<std::uint32_t>((std::max)(b - t, std::int64_t{0}))},
+  };
+}
+
+/// 用清除值填充附件的一块区域
+/// @param view 附件视图
+/// @param ref 附件引用
+/// @param value 清除值
+/// @param depth_stencil 是否作为深度/模板附件清除
+/// @param area 需要清除的区域
+void clear_attachment(
+    const attachment_view &view, attachment_reference ref,
+    const clear_value &value, bool depth_stencil, const rect2d &area
+);
+
+} // namespace plaid
+
+#endif // PLAID_RENDER_TARGET_H_
@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <mutex>
+
+#include <plaid/frame_buffer.h>
+#include <plaid/trace.h>
+
+#include "graphics_pipeline_cache.h"
+#include "render_target.h"
+#include "sort_last_renderer.h"
+#include "worker_pool.h"
+
+using namespace plaid;
+
+namespace {
+
+/// 合成时每个线程一次领取的行数
+constexpr std::uint32_t composite_rows = 16;
+
+/// 私有附件内存的空闲列表，连续渲染多帧时不需要重新分配内存以及触发缺页
+std::mutex free_memory_mutex;
+std::vector<std::vector<std::byte>> free_memory;
+
+/// 按深度把一行中更近的像素从 src 复制到 dst，每个像素 Words 个 32 位字，
+/// 逐像素选择而不分支，使循环可以被向量化
+template <std::uint32_t Words>
+void select_nearer(
+    std::uint32_t *dst, const std::uint32_t *src, const float *dst_depth, const float *src_depth,
+    std::uint32_t left, std::uint32_t right
+) {
+  for (auto x = left; x != right; ++x) {
+    auto nearer = src_depth[x] < dst_depth[x];
+    for (std::uint32_t i = 0; i != Words; ++i) {
+      dst[x * Words + i] = nearer ? src[x * Words + i] : dst[x * Words + i];
+    }
+  }
+}
+
+} // namespace
+
+sort_last_renderer::sort_last_renderer(render_pass::state &state)
+    : state_(state),
+      left_((std::numeric_limits<std::uint32_t>::max)()),
+      top_((std::numeric_limits<std::uint32_t>::max)()),
+      right_(0),
+      bottom_(0) {}
+
+sort_last_renderer::~sort_last_renderer() {
+  std::lock_guard lock(free_memory_mutex);
+  std::move(memory_.begin(), memory_.end(), std::back_inserter(free_memory));
+}
+
+void sort_last_renderer::record(
+    const graphics_pipeline &pipeline, bool indexed, const std::byte *commands, std::uint32_t draws_count,
+    std::uint32_t stride, const rect2d &area
+) {
+  auto &state = state_;
+  // 绑定没有变化时沿用上一份快照
+  auto snapshot = [](std::vector<bindings_snapshot> &snapshots, const const_memory_array<1 << 8> &bindings) {
+    if (snapshots.empty() || !std::equal(std::begin(bindings), std::end(bindings), snapshots.back().bindings)) {
+      auto &snapshot = snapshots.emplace_back();
+      std::copy(std::begin(bindings), std::end(bindings), snapshot.bindings);
+    }
+    return static_cast<std::uint32_t>(snapshots.size() - 1);
+  };
+
+  // 参数紧密地复制下来，同时按顶点数乘实例数估计工作量
+  auto size = indexed ? sizeof(draw_indexed_indirect_command) : sizeof(draw_indirect_command);
+  auto offset = static_cast<std::uint32_t>(commands_.size());
+  commands_.resize(offset + size * draws_count);
+  std::uint64_t cost = 0;
+  for (std::uint32_t i = 0; i != draws_count; ++i) {
+    auto command = commands + std::size_t{stride} * i;
+    std::memcpy(commands_.data() + offset + size * i, command, size);
+    std::uint32_t counts[2];
+    std::memcpy(counts, command, sizeof(counts));
+    cost += std::uint64_t{counts[0]} * counts[1];
+  }
+
+  auto &draw = draws_.emplace_back(draw_record{
+      .pipeline = pipeline,
+      .indexed = indexed,
+      .commands = offset,
+      .draws_count = draws_count,
+      .descriptor_set = snapshot(descriptor_sets_, state.descriptor_set_),
+      .vertex_buffer = snapshot(vertex_buffers_, state.vertex_buffer_),
+      .index_buffer = state.index_buffer_,
+      .index_type = state.index_type_,
+      .instance_bounds = state.instance_bounds_,
+      .instance_bounds_stride = state.instance_bounds_stride_,
+      .instance_planes{},
+      .dynamic_state = state.dynamic_state_,
+      .viewport = state.viewport_,
+      .scissor = state.scissor_,
+      .cull_mode = state.cull_mode_,
+      .depth_bias = state.depth_bias_,
+      .cost = cost,
+#ifdef PLAID_PIPELINE_STATISTICS
+      .statistics = static_cast<std::uint32_t>(state.draw_statistics_.size()),
+#endif
+  });
+  std::copy(std::begin(state.instance_planes_), std::end(state.instance_planes_), draw.instance_planes);
+#ifdef PLAID_PIPELINE_STATISTICS
+  state.draw_statistics_.emplace_back();
+#endif
+
+  auto l = static_cast<std::uint32_t>(area.offset.x), t = static_cast<std::uint32_t>(area.offset.y);
+  left_ = (std::min)(left_, l);
+  top_ = (std::min)(top_, t);
+  right_ = (std::max)(right_, l + area.extent.width);
+  bottom_ = (std::max)(bottom_, t + area.extent.height);
+}
+
+void sort_last_renderer::flush() {
+  if (draws_.empty()) {
+    return;
+  }
+  PLAID_TRACE_ZONE("sort-last");
+
+  // 按估计的工作量把绘制连续地分成至多 concurrency 组，保持组间的提交顺序
+  auto &pool = worker_pool::instance();
+  auto draws_count = static_cast<std::uint32_t>(draws_.size());
+  auto groups_max = (std::min)(pool.concurrency(), draws_count);
+  std::uint64_t total = 0;
+  for (auto &draw : draws_) {
+    total += draw.cost;
+  }
+  std::vector<std::uint32_t> bounds{0};
+  std::uint64_t sum = 0;
+  for (std::uint32_t i = 0; i + 1 < draws_count && bounds.size() < groups_max; ++i) {
+    sum += draws_[i].cost;
+    if (sum * groups_max >= total * bounds.size()) {
+      bounds.push_back(i + 1);
+    }
+  }
+  bounds.push_back(draws_count);
+  auto groups = static_cast<std::uint32_t>(bounds.size() - 1);
+
+  auto &frame = *state_.frame_buffer_;
+  if (groups == 1) {
+    // 只有一组时直接渲染，绘制内部仍然可以多线程处理实例
+    render_pass::state target(state_, frame);
+    replay(target, 0, draws_count);
+    return;
+  }
+
+  // 每组的私有附件依次排列在一块内存中，只有当前子通道写入的附件是私有的，
+  // 其余附件 (例如输入附件) 与帧缓冲区共用
+  attachment_view views[1 << 8];
+  state_.frame_views(views);
+  auto &subpass = *state_.current_subpass_;
+  auto pixels = std::size_t{frame.width()} * frame.height();
+  std::size_t offsets[1 << 8];
+  std::size_t size = 0;
+  auto place = [&](const attachment_reference &ref, std::uint32_t pixel_size) {
+    offsets[ref.id] = size;
+    size += (pixels * pixel_size + 63) & ~std::size_t{63};
+  };
+  std::for_each_n(subpass.color_attachments, subpass.color_attachments_count, [&](auto &ref) {
+    if (views[ref.id].base) {
+      place(ref, format_size(ref.format));
+    }
+  });
+  auto &depth_ref = *subpass.depth_stencil_attachment;
+  place(depth_ref, sizeof(float));
+
+  {
+    std::lock_guard lock(free_memory_mutex);
+    while (memory_.size() < groups - 1 && !free_memory.empty()) {
+      memory_.push_back(std::move(free_memory.back()));
+      free_memory.pop_back();
+    }
+  }
+  memory_.resize((std::max)(memory_.size(), std::size_t{groups - 1}));
+
+  auto attachments_count = state_.render_pass_->attachments_count_;
+  std::vector<frame_buffer> frames;
+  frames.reserve(groups);
+  frame_buffer::attachment addresses[1 << 8];
+  for (std::uint8_t i = 0; i != attachments_count; ++i) {
+    addresses[i] = frame[i];
+  }
+  frames.emplace_back(attachments_count, addresses, frame.width(), frame.height());
+  for (std::uint32_t g = 1; g != groups; ++g) {
+    auto &memory = memory_[g - 1];
+    if (memory.size() < size) {
+      memory.resize(size);
+    }
+    std::for_each_n(subpass.color_attachments, subpass.color_attachments_count, [&](auto &ref) {
+      addresses[ref.id] = views[ref.id].base ? memory.data() + offsets[ref.id] : nullptr;
+    });
+    addresses[depth_ref.id] = memory.data() + offsets[depth_ref.id];
+    frames.emplace_back(attachments_count, addresses, frame.width(), frame.height());
+  }
+
+  // 每个线程依次领取一组，私有深度附件先在所有绘制的区域内初始化为无穷远
+  std::atomic<std::uint32_t> next_group{0};
+  pool.run([&](std::uint32_t) {
+    for (std::uint32_t g; (g = next_group.fetch_add(1, std::memory_order_relaxed)) < groups;) {
+      PLAID_TRACE_ZONE("sort-last group");
+      if (g) {
+        auto depth = reinterpret_cast<float *>(frames[g][depth_ref.id]);
+        for (auto y = top_; y != bottom_; ++y) {
+          auto row = depth + std::size_t{y} * frame.width();
+          std::fill(row + left_, row + right_, std::numeric_limits<float>::infinity());
+        }
+      }
+      render_pass::state target(state_, frames[g]);
+      replay(target, bounds[g], bounds[g + 1]);
+    }
+  });
+
+  // 按组的顺序合成，各线程分别处理不同的行
+  std::atomic<std::uint32_t> next_row{top_};
+  pool.run([&](std::uint32_t) {
+    PLAID_TRACE_ZONE("sort-last composite");
+    for (std::uint32_t y; (y = next_row.fetch_add(composite_rows, std::memory_order_relaxed)) < bottom_;) {
+      auto bottom = (std::min)(y + composite_rows, bottom_);
+      for (std::uint32_t g = 1; g != groups; ++g) {
+        composite(frames[g], y, bottom);
+      }
+    }
+  });
+}
+
+void sort_last_renderer::replay(render_pass::state &target, std::uint32_t first, std::uint32_t last) const {
+  auto descriptor_set = (std::numeric_limits<std::uint32_t>::max)();
+  auto vertex_buffer = descriptor_set;
+  for (auto i = first; i != last; ++i) {
+    auto &draw = draws_[i];
+    if (draw.descriptor_set != descriptor_set) {
+      descriptor_set = draw.descriptor_set;
+      auto &bindings = descriptor_sets_[descriptor_set].bindings;
+      std::copy(std::begin(bindings), std::end(bindings), target.descriptor_set_);
+    }
+    if (draw.vertex_buffer != vertex_buffer) {
+      vertex_buffer = draw.vertex_buffer;
+      auto &bindings = vertex_buffers_[vertex_buffer].bindings;
+      std::copy(std::begin(bindings), std::end(bindings), target.vertex_buffer_);
+    }
+    target.index_buffer_ = draw.index_buffer;
+    target.index_type_ = draw.index_type;
+    target.instance_bounds_ = draw.instance_bounds;
+    target.instance_bounds_stride_ = draw.instance_bounds_stride;
+    std::copy(std::begin(draw.instance_planes), std::end(draw.instance_planes), target.instance_planes_);
+    target.dynamic_state_ = draw.dynamic_state;
+    target.viewport_ = draw.viewport;
+    target.scissor_ = draw.scissor;
+    target.cull_mode_ = draw.cull_mode;
+    target.depth_bias_ = draw.depth_bias;
+
+#ifdef PLAID_PIPELINE_STATISTICS
+    target.draw_statistics_.clear();
+#endif
+    auto commands = commands_.data() + draw.commands;
+    if (draw.indexed) {
+      draw.pipeline.cache().draw_indexed_indirect(
+          target, draw.pipeline, commands, draw.draws_count, sizeof(draw_indexed_indirect_command)
+      );
+    } else {
+      draw.pipeline.cache().draw_indirect(
+          target, draw.pipeline, commands, draw.draws_count, sizeof(draw_indirect_command)
+      );
+    }
+#ifdef PLAID_PIPELINE_STATISTICS
+    // 各组写入不同的绘制统计，不需要同步
+    for (auto &statistics : target.draw_statistics_) {
+      state_.draw_statistics_[draw.statistics] += statistics;
+    }
+#endif
+  }
+}
+
+void sort_last_renderer::composite(const frame_buffer &group, std::uint32_t top, std::uint32_t bottom) const {
+  auto &frame = *state_.frame_buffer_;
+  auto &subpass = *state_.current_subpass_;
+  auto depth_id = subpass.depth_stencil_attachment->id;
+  for (auto y = top; y != bottom; ++y) {
+    auto row = std::size_t{y} * frame.width();
+    auto src_depth = reinterpret_cast<const float *>(group[depth_id]) + row;
+    auto dst_depth = reinterpret_cast<float *>(frame[depth_id]) + row;
+
+    // 先按合成前的深度选择颜色，最后再更新深度
+    std::for_each_n(subpass.color_attachments, subpass.color_attachments_count, [&](auto &ref) {
+      if (!group[ref.id]) {
+        return;
+      }
+      auto pixel_size = format_size(ref.format);
+      auto src = group[ref.id] + row * pixel_size;
+      auto dst = frame[ref.id] + row * pixel_size;
+      auto src_words = reinterpret_cast<const std::uint32_t *>(src);
+      auto dst_words = reinterpret_cast<std::uint32_t *>(dst);
+      switch (pixel_size) {
+      case 4:
+        select_nearer<1>(dst_words, src_words, dst_depth, src_depth, left_, right_);
+        break;
+      case 8:
+        select_nearer<2>(dst_words, src_words, dst_depth, src_depth, left_, right_);
+        break;
+      case 12:
+        select_nearer<3>(dst_words, src_words, dst_depth, src_depth, left_, right_);
+        break;
+      case 16:
+        select_nearer<4>(dst_words, src_words, dst_depth, src_depth, left_, right_);
+        break;
+      default:
+        for (auto x = left_; x != right_; ++x) {
+          if (src_depth[x] < dst_depth[x]) {
+            std::memcpy(dst + x * pixel_size, src + x * pixel_size, pixel_size);
+          }
+        }
+        break;
+      }
+    });
+    for (auto x = left_; x != right_; ++x) {
+      dst_depth[x] = src_depth[x] < dst_depth[x] ? src_depth[x] : dst_depth[x];
+    }
+  }
+}
@@ -0,0 +1,109 @@
+#pragma once
+#ifndef PLAID_SORT_LAST_RENDERER_H_
+#define PLAID_SORT_LAST_RENDERER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <plaid/pipeline.h>
+#include <plaid/render_pass.h>
+#include <plaid/shader.h>
+#include <plaid/vec.h>
+
+namespace plaid {
+
+/// sort-last 并行渲染器
+/// 子通道内的绘制只记录参数与绑定，子通道结束时按提交顺序把绘制连续地分成几组，
+/// 每组在一个线程上完整渲染，第一组直接写入帧缓冲区，其余各组写入各自私有的颜色与深度附件，
+/// 最后按组的顺序逐像素比较深度，把更近的像素合成到帧缓冲区。深度相同时保留先提交的绘制，
+/// 结果与依次渲染完全一致
+class sort_last_renderer {
+public:
+
+  /// @param state 渲染通道状态，当前子通道有深度附件
+  explicit sort_last_renderer(render_pass::state &state);
+
+  sort_last_renderer(const sort_last_renderer &) = delete;
+
+  ~sort_last_renderer();
+
+  /// 记录一次绘制，绑定与动态状态取自渲染通道状态的当前值
+  /// @param pipeline 执行绘制的管道，复制句柄保存，调用者的句柄不必保持到子通道结束
+  /// @param indexed 是否为索引绘制
+  /// @param commands 第一组绘制参数的地址
+  /// @param draws_count 绘制参数的组数
+  /// @param stride 相邻两组参数之间的字节数
+  /// @param area 绘制允许写入的区域
+  void record(
+      const graphics_pipeline &pipeline, bool indexed, const std::byte *commands, std::uint32_t draws_count,
+      std::uint32_t stride, const rect2d &area
+  );
+
+  /// 分组渲染所有记录的绘制并合成到帧缓冲区
+  void flush();
+
+private:
+
+  /// 一次绘制的记录
+  struct draw_record {
+    /// 持有管道的引用，绘制时传入的可能是临时的句柄
+    graphics_pipeline pipeline;
+    bool indexed;
+    /// 绘制参数在 [commands_] 中的偏移，参数紧密排列
+    std::uint32_t commands;
+    std::uint32_t draws_count;
+    /// 描述符集与顶点缓冲区快照编号
+    std::uint32_t descriptor_set;
+    std::uint32_t vertex_buffer;
+    const std::byte *index_buffer;
+    plaid::index_type index_type;
+    const std::byte *instance_bounds;
+    std::uint32_t instance_bounds_stride;
+    vec4 instance_planes[6];
+    std::uint8_t dynamic_state;
+    plaid::viewport viewport;
+    rect2d scissor;
+    plaid::cull_mode cull_mode;
+    plaid::depth_bias depth_bias;
+    /// 估计的工作量，即所有绘制参数的顶点数乘实例数之和
+    std::uint64_t cost;
+#ifdef PLAID_PIPELINE_STATISTICS
+    /// 绘制统计在渲染通道状态中的编号
+    std::uint32_t statistics;
+#endif
+  };
+
+  /// 绑定快照
+  struct bindings_snapshot {
+    const_memory_array<1 << 8> bindings;
+  };
+
+  /// 在 target 上依次重新提交 [first, last) 之间的绘制
+  void replay(render_pass::state &target, std::uint32_t first, std::uint32_t last) const;
+
+  /// 把一组私有附件中更近的像素合成到帧缓冲区
+  /// @param group 私有附件所在的帧缓冲区
+  /// @param top 第一行
+  /// @param bottom 最后一行之后的一行
+  void composite(const frame_buffer &group, std::uint32_t top, std::uint32_t bottom) const;
+
+  render_pass::state &state_;
+
+  std::vector<draw_record> draws_;
+  /// 所有绘制参数
+  std::vector<std::byte> commands_;
+  /// 描述符集快照，相邻绘制的描述符集相同时共用一份
+  std::vector<bindings_snapshot> descriptor_sets_;
+  /// 顶点缓冲区快照，相邻绘制的顶点缓冲区相同时共用一份
+  std::vector<bindings_snapshot> vertex_buffers_;
+  /// 所有绘制允许写入的区域的并集，合成时只处理这些行与列
+  std::uint32_t left_, top_, right_, bottom_;
+
+  /// 除第一组之外各组私有附件的内存，在进程内复用
+  std::vector<std::vector<std::byte>> memory_;
+};
+
+} // namespace plaid
+
+#endif // PLAID_SORT_LAST_RENDERER_H_
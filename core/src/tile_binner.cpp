@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#include <plaid/frame_buffer.h>
+#include <plaid/trace.h>
+
+#include "graphics_pipeline_cache.h"
+#include "pipeline_context.h"
+#include "render_target.h"
+#include "tile_binner.h"
+
+using namespace plaid;
+
+struct tile_binner::memory {
+  std::vector<draw_record> draws;
+  std::vector<descriptor_set_snapshot> descriptor_sets;
+  std::vector<std::byte> triangles;
+  std::vector<std::vector<std::uint32_t>> bins;
+};
+
+namespace {
+
+/// 记录的空闲内存，连续渲染多帧时不需要重新分配内存以及触发缺页
+std::mutex free_memory_mutex;
+std::vector<tile_binner::memory> free_memory;
+
+} // namespace
+
+tile_binner::tile_binner(const render_pass::state &state, std::uint8_t first, std::uint8_t last)
+    : state_(state), first_(first), last_(last), triangles_size_(0) {
+  auto &frame = *state.frame_buffer_;
+  tiles_x_ = (frame.width() + tile_size - 1) / tile_size;
+  tiles_y_ = (frame.height() + tile_size - 1) / tile_size;
+  {
+    std::lock_guard lock(free_memory_mutex);
+    if (!free_memory.empty()) {
+      auto &reuse = free_memory.back();
+      draws_ = std::move(reuse.draws);
+      descriptor_sets_ = std::move(reuse.descriptor_sets);
+      triangles_ = std::move(reuse.triangles);
+      bins_ = std::move(reuse.bins);
+      free_memory.pop_back();
+    }
+  }
+  for (auto &bin : bins_) {
+    bin.clear();
+  }
+  bins_.resize(tiles_x_ * tiles_y_);
+}
+
+tile_binner::~tile_binner() {
+  // 绘制记录持有的管道在这里释放，只保留内存
+  draws_.clear();
+  descriptor_sets_.clear();
+  std::lock_guard lock(free_memory_mutex);
+  free_memory.push_back({std::move(draws_), std::move(descriptor_sets_), std::move(triangles_), std::move(bins_)});
+}
+
+void tile_binner::begin_draw(
+    const graphics_pipeline &pipeline, const const_memory_array<1 << 8> &descriptor_set,
+    const viewport &viewport, const rect2d &scissor
+) {
+  // 描述符集没有变化时沿用上一份快照
+  if (descriptor_sets_.empty() ||
+      !std::equal(std::begin(descriptor_set), std::end(descriptor_set), descriptor_sets_.back().bindings)) {
+    auto &snapshot = descriptor_sets_.emplace_back();
+    std::copy(std::begin(descriptor_set), std::end(descriptor_set), snapshot.bindings);
+  }
+
+  draws_.push_back({
+      .pipeline = pipeline,
+      .descriptor_set = static_cast<std::uint32_t>(descriptor_sets_.size() - 1),
+      .viewport = viewport,
+      .scissor = scissor,
+      .subpass = static_cast<std::uint8_t>(state_.current_subpass_ - state_.first_subpass_),
+#ifdef PLAID_PIPELINE_STATISTICS
+      .statistics = static_cast<std::uint32_t>(state_.draw_statistics_.size() - 1),
+#endif
+  });
+}
+
+void tile_binner::bin_triangle(
+    const vec4 *const (&clip_coord)[3], const std::byte *payload, std::uint32_t payload_size
+) {
+  PLAID_TRACE_DETAIL_ZONE("bin");
+  auto &draw = draws_.back();
+
+  // 计算三角形在屏幕上覆盖的分块范围，只记录到裁剪矩形之内的分块
+  auto p0 = viewport_transform(draw.viewport, *clip_coord[0]);
+  float l = p0.x, t = p0.y, r = p0.x, b = p0.y;
+  for (int i = 1; i != 3; ++i) {
+    auto p = viewport_transform(draw.viewport, *clip_coord[i]);
+    l = (std::min)(l, p.x);
+    t = (std::min)(t, p.y);
+    r = (std::max)(r, p.x);
+    b = (std::max)(b, p.y);
+  }
+  auto &scissor = draw.scissor;
+  auto right = scissor.offset.x + scissor.extent.width;
+  auto bottom = scissor.offset.y + scissor.extent.height;
+  l = (std::max)(l, static_cast<float>(scissor.offset.x));
+  t = (std::max)(t, static_cast<float>(scissor.offset.y));
+  r = (std::min)(r, static_cast<float>(right));
+  b = (std::min)(b, static_cast<float>(bottom));
+  [[unlikely]] if (r < l || b < t) {
+    return;
+  }
+  // 与光栅化的包围盒一致，取整后限制在裁剪矩形的最后一个像素
+  auto tl = (std::min)(static_cast<std::uint32_t>(l), right - 1) / tile_size;
+  auto tt = (std::min)(static_cast<std::uint32_t>(t), bottom - 1) / tile_size;
+  auto tr = (std::min)(static_cast<std::uint32_t>(r), right - 1) / tile_size;
+  auto tb = (std::min)(static_cast<std::uint32_t>(b), bottom - 1) / tile_size;
+
+  // 记录大小保持 16 字节对齐
+  auto record_size = (sizeof(triangle_record) + payload_size + 15) / 16 * 16;
+  // 已经使用的部分之后的内存可能来自之前的分块渲染，按倍数增长，复用时不需要再次清零
+  auto offset = static_cast<std::uint32_t>(triangles_size_);
+  triangles_size_ += record_size;
+  if (triangles_.size() < triangles_size_) {
+    triangles_.resize((std::max)(triangles_size_, triangles_.size() * 2));
+  }
+
+  auto &record = *reinterpret_cast<triangle_record *>(triangles_.data() + offset);
+  for (int i = 0; i != 3; ++i) {
+    record.clip_coord[i] = *clip_coord[i];
+  }
+  record.draw = static_cast<std::uint32_t>(draws_.size() - 1);
+  std::memcpy(triangles_.data() + offset + sizeof(triangle_record), payload, payload_size);
+
+  for (auto y = tt; y <= tb; ++y) {
+    for (auto x = tl; x <= tr; ++x) {
+      bins_[y * tiles_x_ + x].push_back(offset);
+    }
+  }
+}
+
+void tile_binner::flush() {
+  PLAID_TRACE_ZONE("flush tiles");
+  auto &frame = *state_.frame_buffer_;
+  auto &pass = *state_.render_pass_;
+  auto width = frame.width();
+  auto height = frame.height();
+  [[unlikely]] if (!width || !height) {
+    return;
+  }
+
+  // 找出只需要停留在分块内存中的附件，并确定它们的像素大小
+  std::uint32_t resident_stride[1 << 8]{};
+  for (auto s = first_; s <= last_; ++s) {
+    auto &subpass = pass.subpass(s);
+    auto visit = [&](const attachment_reference &ref) {
+      if (pass.tile_resident(ref.id, first_, last_)) {
+        resident_stride[ref.id] = (std::max)(resident_stride[ref.id], format_size(ref.format));
+      }
+    };
+    std::for_each_n(subpass.input_attachments, subpass.input_attachments_count, visit);
+    std::for_each_n(subpass.color_attachments, subpass.color_attachments_count, visit);
+    if (subpass.depth_stencil_attachment) {
+      visit(*subpass.depth_stencil_attachment);
+    }
+  }
+
+  std::uint32_t resident_offset[1 << 8];
+  std::uint32_t scratch_size = 0;
+  for (std::uint8_t i = 0; i != pass.attachments_count_; ++i) {
+    resident_offset[i] = scratch_size;
+    scratch_size += resident_stride[i] * tile_size * tile_size;
+  }
+  // 分块内存对所有的附件共用，大小只与分块尺寸有关
+  std::vector<std::byte> scratch(scratch_size);
+
+  // 绘制时使用的执行上下文，分块渲染时也由它执行
+  auto &context = *state_.context_;
+  attachment_view views[1 << 8];
+  for (std::uint32_t ty = 0; ty != tiles_y_; ++ty) {
+    for (std::uint32_t tx = 0; tx != tiles_x_; ++tx) {
+      PLAID_TRACE_ZONE("tile");
+      auto x0 = tx * tile_size, y0 = ty * tile_size;
+      rect2d area{
+          {static_cast<std::int32_t>(x0), static_cast<std::int32_t>(y0)},
+          {(std::min)(tile_size, width - x0), (std::min)(tile_size, height - y0)},
+      };
+
+      for (std::uint8_t i = 0; i != pass.attachments_count_; ++i) {
+        if (resident_stride[i]) {
+          views[i] = {scratch.data() + resident_offset[i], tile_size, x0, y0};
+        } else {
+          views[i] = {frame[i], width, 0, 0};
+        }
+      }
+
+      auto &bin = bins_[ty * tiles_x_ + tx];
+      auto it = bin.begin(), ed = bin.end();
+      for (auto s = first_; s <= last_; ++s) {
+        state_.clear_attachments(s, views, area);
+
+        render_target target{
+            .views = views,
+            .subpass = &pass.subpass(s),
+        };
+        // 同一次绘制的三角形在分块中相邻，绘制改变时才需要更新视口与写入区域
+        const draw_record *current = nullptr;
+        for (; it != ed; ++it) {
+          auto record = triangles_.data() + *it;
+          auto &triangle = *reinterpret_cast<const triangle_record *>(record);
+          auto &draw = draws_[triangle.draw];
+          if (draw.subpass != s) {
+            break;
+          }
+          if (current != &draw) {
+            current = &draw;
+            target.viewport = draw.viewport;
+            target.area = intersect(area, draw.scissor);
+            target.descriptor_set = &descriptor_sets_[draw.descriptor_set].bindings;
+          }
+#ifdef PLAID_PIPELINE_STATISTICS
+          context.statistics = &state_.draw_statistics_[draw.statistics];
+#endif
+          draw.pipeline.cache().rasterize_binned(context, target, triangle.clip_coord, record + sizeof(triangle_record));
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,104 @@
+#pragma once
+#ifndef PLAID_TILE_BINNER_H_
+#define PLAID_TILE_BINNER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <plaid/pipeline.h>
+#include <plaid/render_pass.h>
+#include <plaid/shader.h>
+#include <plaid/vec.h>
+
+namespace plaid {
+
+/// 合并子通道组的分块渲染器
+/// 子通道组内的绘制只执行到顶点处理与裁剪为止，得到的三角形按屏幕范围放入分块，
+/// 组结束时逐个分块依次执行组内所有子通道，使子通道之间传递的附件停留在分块内存中
+class tile_binner {
+public:
+
+  /// 分块边长
+  static constexpr std::uint32_t tile_size = 32;
+
+  /// @param state 渲染通道状态
+  /// @param first 子通道组的第一个子通道编号
+  /// @param last 子通道组的最后一个子通道编号
+  tile_binner(const render_pass::state &state, std::uint8_t first, std::uint8_t last);
+
+  tile_binner(const tile_binner &) = delete;
+
+  /// 记录使用的内存留给之后的分块渲染复用
+  ~tile_binner();
+
+  /// 在进程内复用的记录内存，定义在实现中
+  struct memory;
+
+  /// 开始记录一次绘制，之后记录的三角形都属于这次绘制
+  /// @param pipeline 执行绘制的管道，记录中保存一份副本，调用者的管道可以在组结束之前销毁
+  /// @param descriptor_set 绘制时绑定的描述符集
+  /// @param viewport 绘制使用的视口
+  /// @param scissor 绘制使用的裁剪矩形，位于帧缓冲区之内
+  void begin_draw(
+      const graphics_pipeline &pipeline, const const_memory_array<1 << 8> &descriptor_set,
+      const viewport &viewport, const rect2d &scissor
+  );
+
+  /// 记录一个裁剪后的三角形
+  /// @param clip_coord 三角形裁剪空间坐标
+  /// @param payload 三角形光栅化所需的额外数据，在渲染时原样交还管道
+  /// @param payload_size 额外数据的字节数
+  void bin_triangle(const vec4 *const (&clip_coord)[3], const std::byte *payload, std::uint32_t payload_size);
+
+  /// 逐个分块渲染子通道组，所有分块内存中的附件在此之后被丢弃
+  void flush();
+
+private:
+
+  /// 一次绘制的记录
+  struct draw_record {
+    /// 管道的副本，使编译结果在组结束之前保持有效
+    graphics_pipeline pipeline;
+    /// 描述符集快照编号
+    std::uint32_t descriptor_set;
+    plaid::viewport viewport;
+    rect2d scissor;
+    /// 子通道编号
+    std::uint8_t subpass;
+#ifdef PLAID_PIPELINE_STATISTICS
+    /// 绘制统计在渲染通道状态中的编号
+    std::uint32_t statistics;
+#endif
+  };
+
+  /// 描述符集快照
+  struct descriptor_set_snapshot {
+    const_memory_array<1 << 8> bindings;
+  };
+
+  /// 三角形记录头，紧随其后的是额外数据
+  struct alignas(16) triangle_record {
+    vec4 clip_coord[3];
+    std::uint32_t draw;
+  };
+
+  const render_pass::state &state_;
+  std::uint8_t first_;
+  std::uint8_t last_;
+  std::uint32_t tiles_x_;
+  std::uint32_t tiles_y_;
+
+  std::vector<draw_record> draws_;
+  /// 描述符集快照，相邻绘制的描述符集相同时共用一份
+  std::vector<descriptor_set_snapshot> descriptor_sets_;
+  /// 所有三角形记录，只有前 [triangles_size_] 字节有效
+  std::vector<std::byte> triangles_;
+  std::size_t triangles_size_;
+  /// 每个分块按顺序记录覆盖到它的三角形在 [triangles_] 中的偏移
+  std::vector<std::vector<std::uint32_t>> bins_;
+};
+
+} // namespace plaid
+
+#endif // PLAID_TILE_BINNER_H_
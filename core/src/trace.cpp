@@ -0,0 +1,161 @@
+#ifdef PLAID_TRACE
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <plaid/trace.h>
+
+using namespace plaid;
+
+namespace {
+
+/// 环形缓冲区中的一个区间，导出线程可能与写入同时读取，所以每个成员都是原子的
+struct trace_slot {
+  std::atomic<const char *> name;
+  std::atomic<std::uint64_t> begin;
+  std::atomic<std::uint64_t> end;
+};
+
+/// 单个线程的环形缓冲区，只有所属线程写入，无需加锁
+struct trace_ring {
+  static constexpr std::uint64_t capacity = 1 << 16;
+
+  explicit trace_ring(std::uint32_t thread) noexcept : thread(thread) {}
+
+  std::uint32_t thread;
+  /// 已经写入的区间总数
+  std::atomic<std::uint64_t> head = 0;
+  /// 导出的起点，clear_trace 之前的区间不再导出
+  std::atomic<std::uint64_t> tail = 0;
+  trace_slot slots[capacity];
+};
+
+/// 所有线程的缓冲区，只在线程第一次记录和导出时加锁
+struct trace_registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<trace_ring>> rings;
+};
+
+trace_registry &registry() {
+  static trace_registry instance;
+  return instance;
+}
+
+thread_local trace_ring *local_ring = nullptr;
+
+trace_ring *register_thread() {
+  auto &reg = registry();
+  std::lock_guard lock(reg.mutex);
+  auto thread = static_cast<std::uint32_t>(reg.rings.size() + 1);
+  local_ring = reg.rings.emplace_back(std::make_unique<trace_ring>(thread)).get();
+  return local_ring;
+}
+
+struct trace_event {
+  const char *name;
+  std::uint64_t begin;
+  std::uint64_t end;
+  std::uint32_t thread;
+};
+
+void write_string(std::ostream &os, const char *str) {
+  os << '"';
+  for (; *str; ++str) {
+    if (*str == '"' || *str == '\\') {
+      os << '\\';
+    }
+    os << *str;
+  }
+  os << '"';
+}
+
+} // namespace
+
+void plaid::trace_record(const char *name, std::uint64_t begin, std::uint64_t end) noexcept {
+  auto ring = local_ring;
+  [[unlikely]] if (!ring) {
+    ring = register_thread();
+  }
+  auto head = ring->head.load(std::memory_order_relaxed);
+  auto &slot = ring->slots[head % trace_ring::capacity];
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.begin.store(begin, std::memory_order_relaxed);
+  slot.end.store(end, std::memory_order_relaxed);
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void plaid::write_chrome_trace(std::ostream &os) {
+  std::vector<trace_event> events;
+  std::vector<std::uint32_t> threads;
+  {
+    auto &reg = registry();
+    std::lock_guard lock(reg.mutex);
+    for (auto &ring : reg.rings) {
+      threads.push_back(ring->thread);
+      auto head = ring->head.load(std::memory_order_acquire);
+      auto first = (std::max)(ring->tail.load(std::memory_order_relaxed),
+                              head > trace_ring::capacity ? head - trace_ring::capacity : 0);
+      auto start = events.size();
+      for (auto i = first; i != head; ++i) {
+        auto &slot = ring->slots[i % trace_ring::capacity];
+        events.push_back({
+            slot.name.load(std::memory_order_relaxed),
+            slot.begin.load(std::memory_order_relaxed),
+            slot.end.load(std::memory_order_relaxed),
+            ring->thread,
+        });
+      }
+      // 复制期间所属线程可能继续写入，被覆盖的区间不可信。所属线程在发布 now + 1 之前
+      // 就开始写入第 now 个事件的槽位，即第 now - capacity 个事件，它也可能只写了一半
+      auto now = ring->head.load(std::memory_order_acquire);
+      auto stale = now + 1 > trace_ring::capacity ? now + 1 - trace_ring::capacity : 0;
+      if (stale > first) {
+        auto overwritten = (std::min)(stale - first, head - first);
+        events.erase(events.begin() + start, events.begin() + start + overwritten);
+      }
+    }
+  }
+
+  std::uint64_t origin = ~std::uint64_t(0);
+  for (auto &event : events) {
+    origin = (std::min)(origin, event.begin);
+  }
+
+  // 时间单位为微秒，保留到纳秒
+  auto flags = os.flags();
+  auto precision = os.precision();
+  os << std::fixed << std::setprecision(3);
+  os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  for (auto thread : threads) {
+    os << (first ? "" : ",")
+       << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread
+       << ",\"args\":{\"name\":\"plaid thread " << thread << "\"}}";
+    first = false;
+  }
+  for (auto &event : events) {
+    os << (first ? "" : ",") << "{\"name\":";
+    write_string(os, event.name);
+    os << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+       << ",\"ts\":" << (event.begin - origin) / 1000.
+       << ",\"dur\":" << (event.end - event.begin) / 1000. << '}';
+    first = false;
+  }
+  os << "]}\n";
+  os.flags(flags);
+  os.precision(precision);
+}
+
+void plaid::clear_trace() noexcept {
+  auto &reg = registry();
+  std::lock_guard lock(reg.mutex);
+  for (auto &ring : reg.rings) {
+    ring->tail.store(ring->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+  }
+}
+
+#endif
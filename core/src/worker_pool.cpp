@@ -0,0 +1,115 @@
+#include <algorithm>
+
+#include "worker_pool.h"
+
+using namespace plaid;
+
+namespace {
+
+/// 当前线程是否正在执行线程池的任务，任务中再次调用 run 时不能再等待线程池
+thread_local bool running_task = false;
+
+/// 在作用域内把当前线程标记为正在执行任务，任务抛出异常时同样恢复
+struct running_task_scope {
+  running_task_scope() noexcept { running_task = true; }
+  ~running_task_scope() { running_task = false; }
+};
+
+} // namespace
+
+worker_pool &worker_pool::instance() {
+  static worker_pool pool((std::max)(std::thread::hardware_concurrency(), 1u) - 1);
+  return pool;
+}
+
+worker_pool::worker_pool(std::uint32_t threads) {
+  threads_.reserve(threads);
+  for (std::uint32_t i = 0; i != threads; ++i) {
+    threads_.emplace_back(&worker_pool::work, this, i + 1);
+  }
+}
+
+worker_pool::~worker_pool() {
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+std::uint32_t worker_pool::run(const std::function<void(std::uint32_t)> &task) {
+  if (running_task) {
+    task(0);
+    return 1;
+  }
+  std::unique_lock run_lock(run_mutex_, std::try_to_lock);
+  if (!run_lock || threads_.empty()) {
+    task(0);
+    return 1;
+  }
+
+  {
+    std::lock_guard lock(mutex_);
+    task_ = &task;
+    pending_ = static_cast<std::uint32_t>(threads_.size());
+    ++generation_;
+  }
+  start_.notify_all();
+  // 调用线程上的异常也要等所有工作线程返回之后才能抛出，否则它们仍在使用调用者栈上的任务
+  std::exception_ptr error;
+  {
+    running_task_scope scope;
+    try {
+      task(0);
+    } catch (...) {
+      error = std::current_exception();
+    }
+  }
+
+  std::unique_lock lock(mutex_);
+  finish_.wait(lock, [this] { return !pending_; });
+  task_ = nullptr;
+  if (!error) {
+    error = error_;
+  }
+  error_ = nullptr;
+  lock.unlock();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return concurrency();
+}
+
+void worker_pool::work(std::uint32_t worker) {
+  running_task = true;
+  std::uint64_t seen = 0;
+  while (true) {
+    const std::function<void(std::uint32_t)> *task;
+    {
+      std::unique_lock lock(mutex_);
+      start_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+      task = task_;
+    }
+    std::exception_ptr error;
+    try {
+      (*task)(worker);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    {
+      std::lock_guard lock(mutex_);
+      if (error && !error_) {
+        error_ = error;
+      }
+      --pending_;
+    }
+    finish_.notify_one();
+  }
+}
@@ -0,0 +1,66 @@
+#pragma once
+#ifndef PLAID_WORKER_POOL_H_
+#define PLAID_WORKER_POOL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace plaid {
+
+/// 进程内共享的工作线程池，一次只执行一个任务，任务在所有线程上同时运行
+/// 线程在第一次使用时创建，数目取硬件线程数
+class worker_pool {
+public:
+
+  /// 获取共享的线程池
+  static worker_pool &instance();
+
+  worker_pool(const worker_pool &) = delete;
+
+  ~worker_pool();
+
+  /// 参与执行任务的线程数，包括调用 [run] 的线程
+  [[nodiscard]] std::uint32_t concurrency() const noexcept {
+    return static_cast<std::uint32_t>(threads_.size() + 1);
+  }
+
+  /// 在每个线程上执行一次 task(worker)，全部返回之后才返回，调用线程以编号 0 参与
+  /// 在任务中再次调用，或者其他线程正在使用线程池时，只在调用线程上执行 task(0)
+  /// 任务抛出的异常在所有线程都返回之后重新抛出，多个线程都抛出时调用线程的优先，其余的丢弃
+  /// @return 实际参与执行的线程数
+  std::uint32_t run(const std::function<void(std::uint32_t)> &task);
+
+private:
+
+  explicit worker_pool(std::uint32_t threads);
+
+  /// 工作线程的主循环
+  /// @param worker 线程编号，从 1 开始
+  void work(std::uint32_t worker);
+
+  /// 保证同一时刻只有一个任务
+  std::mutex run_mutex_;
+
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable finish_;
+  const std::function<void(std::uint32_t)> *task_ = nullptr;
+  /// 每提交一个任务加一，工作线程据此判断是否有新任务
+  std::uint64_t generation_ = 0;
+  /// 尚未完成当前任务的工作线程数
+  std::uint32_t pending_ = 0;
+  /// 工作线程在当前任务中抛出的第一个异常
+  std::exception_ptr error_;
+  bool stop_ = false;
+
+  std::vector<std::thread> threads_;
+};
+
+} // namespace plaid
+
+#endif // PLAID_WORKER_POOL_H_
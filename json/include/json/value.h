@@ -4,6 +4,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 #include <span>
 #include <stdexcept>
@@ -121,7 +122,7 @@ struct member {
   friend constexpr bool operator==(const member &, const member &) noexcept;
 
   key key;
-  value value;
+  plaid::json::value value;
 };
 
 constexpr value::value() noexcept
@@ -0,0 +1,38 @@
+/// 把索引网格分成网格簇 (meshlet)，绘制时用 render_pass::state::draw_clusters 整簇剔除
+
+#pragma once
+#ifndef PLAID_MESH_CLUSTER_H_
+#define PLAID_MESH_CLUSTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <plaid/render_pass.h>
+
+namespace plaid::mesh {
+
+struct cluster_options {
+  /// 一个簇引用的顶点数上限
+  std::uint32_t max_vertices = 64;
+  /// 一个簇的三角形数上限
+  std::uint32_t max_triangles = 124;
+  /// 三角形法线与簇平均法线的夹角余弦小于此值时开始新的簇，使法线锥足够窄以便背面剔除
+  float min_normal_cos = .5f;
+};
+
+/// 按顺序把三角形分成网格簇并计算包围球与法线锥
+/// 三角形的顺序保持不变，每个簇是索引缓冲区中连续的一段，应当在 [optimize] 之后调用
+/// @param indices 三角形列表的索引
+/// @param positions 第一个顶点位置 (3 个 float) 的地址
+/// @param stride 相邻两个顶点位置之间的字节数
+/// @param vertices_count 顶点数，所有索引都小于此值
+std::vector<cluster> build_clusters(
+    const std::uint32_t *indices, std::uint32_t indices_count,
+    const std::byte *positions, std::uint32_t stride, std::uint32_t vertices_count,
+    const cluster_options & = {}
+);
+
+} // namespace plaid::mesh
+
+#endif // PLAID_MESH_CLUSTER_H_
@@ -0,0 +1,116 @@
+/// 索引网格的加载期优化
+/// 按顺序执行：去除退化三角形、按顶点缓存重排三角形 (Tipsify)、按遮挡关系重排三角形簇、
+/// 按第一次使用的顺序重排顶点。前三步只改变索引，最后一步同时改变顶点与索引
+
+#pragma once
+#ifndef PLAID_MESH_OPTIMIZE_H_
+#define PLAID_MESH_OPTIMIZE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace plaid::mesh {
+
+/// 模拟的顶点缓存大小，与常见硬件的后变换缓存相当
+constexpr std::uint32_t default_cache_size = 16;
+
+/// 按遮挡关系重排时，簇内的 ACMR 不超过整个网格的 ACMR 乘以此值时才把簇继续拆小
+constexpr float default_overdraw_threshold = 1.05f;
+
+/// 用先进先出的顶点缓存模拟得到的统计
+struct vertex_cache_statistics {
+  /// 缓存未命中，需要执行顶点着色器的次数
+  std::uint32_t vertices_transformed;
+  /// 平均每个三角形执行顶点着色器的次数 (ACMR)，取值 0.5 ~ 3，越小越好
+  float acmr;
+  /// 平均每个被引用的顶点执行顶点着色器的次数 (ATVR)，最优为 1
+  float atvr;
+};
+
+/// 统计索引缓冲区在先进先出顶点缓存上的表现
+/// @param indices 三角形列表的索引
+/// @param indices_count 索引数，是 3 的倍数
+/// @param vertices_count 顶点数，所有索引都小于此值
+/// @param cache_size 缓存可以保存的顶点数
+vertex_cache_statistics analyze_vertex_cache(
+    const std::uint32_t *indices, std::uint32_t indices_count, std::uint32_t vertices_count,
+    std::uint32_t cache_size = default_cache_size
+);
+
+/// 原地去除有两个顶点索引相同或者面积为零的三角形，其余三角形保持原有顺序
+/// @param positions 第一个顶点位置 (3 个 float) 的地址，为空时只比较索引
+/// @param stride 相邻两个顶点位置之间的字节数
+/// @return 剩下的索引数
+std::uint32_t remove_degenerate_triangles(
+    std::uint32_t *indices, std::uint32_t indices_count, const std::byte *positions, std::uint32_t stride
+);
+
+/// 用 Tipsify 算法重排三角形，使相邻三角形尽量共用仍在顶点缓存中的顶点
+/// @param dst 接收重排后的索引，不能与 indices 相同
+/// @param cache_size 目标顶点缓存的大小
+void optimize_vertex_cache(
+    std::uint32_t *dst, const std::uint32_t *indices, std::uint32_t indices_count, std::uint32_t vertices_count,
+    std::uint32_t cache_size = default_cache_size
+);
+
+/// 把已经按顶点缓存排好的三角形分成簇，朝向网格外侧的簇先绘制，
+/// 使后绘制的三角形更多地被深度测试提前拒绝，同时尽量保持簇内的顶点缓存命中
+/// @param dst 接收重排后的索引，不能与 indices 相同
+/// @param positions 第一个顶点位置 (3 个 float) 的地址
+/// @param stride 相邻两个顶点位置之间的字节数
+/// @param threshold 见 [default_overdraw_threshold]，越大簇越小、遮挡顺序越好、缓存命中越差
+void optimize_overdraw(
+    std::uint32_t *dst, const std::uint32_t *indices, std::uint32_t indices_count,
+    const std::byte *positions, std::uint32_t stride, std::uint32_t vertices_count,
+    std::uint32_t cache_size = default_cache_size, float threshold = default_overdraw_threshold
+);
+
+/// 按索引中第一次出现的顺序重排顶点，使顶点读取尽量顺序访问内存，没有被引用的顶点被丢弃
+/// @param dst 接收重排后的顶点，不能与 vertices 重叠，至少能容纳 vertices_count 个顶点
+/// @param indices 原地改写为新顶点的编号
+/// @param vertex_size 每个顶点的字节数
+/// @return 重排后的顶点数
+std::uint32_t optimize_vertex_fetch(
+    std::byte *dst, std::uint32_t *indices, std::uint32_t indices_count,
+    const std::byte *vertices, std::uint32_t vertices_count, std::uint32_t vertex_size
+);
+
+/// 交错存放的索引网格，优化时原地改写
+struct indexed_mesh {
+  /// 顶点数据，每个顶点在 position_offset 处是 3 个 float 的位置
+  std::byte *vertices;
+  std::uint32_t vertex_size;
+  std::uint32_t position_offset;
+  /// 优化后更新为剩下的顶点数
+  std::uint32_t vertices_count;
+  /// 三角形列表的索引，优化后更新为剩下的索引数
+  std::uint32_t *indices;
+  std::uint32_t indices_count;
+};
+
+struct optimize_options {
+  std::uint32_t cache_size = default_cache_size;
+  float overdraw_threshold = default_overdraw_threshold;
+  /// 超过此三角形数的网格被切成多段分别重排三角形，各段可以在不同线程上同时处理
+  std::uint32_t chunk_triangles = 1 << 16;
+};
+
+/// 一个网格优化前后的统计
+struct optimize_report {
+  vertex_cache_statistics before;
+  vertex_cache_statistics after;
+  /// 被去除的退化三角形数
+  std::uint32_t degenerate_triangles;
+  /// 没有被引用而被丢弃的顶点数
+  std::uint32_t unused_vertices;
+};
+
+/// 依次执行全部优化，多个网格以及大网格的各段在多个线程上同时处理
+/// @param meshes 网格数组
+/// @param reports 接收每个网格的统计，可以为空
+/// @param count 网格个数
+void optimize(indexed_mesh *meshes, optimize_report *reports, std::size_t count, const optimize_options & = {});
+
+} // namespace plaid::mesh
+
+#endif // PLAID_MESH_OPTIMIZE_H_
@@ -0,0 +1,79 @@
+/// 基于二次误差度量 (QEM) 的网格简化与 LOD 链
+/// 简化只把顶点合并到已有的顶点上，所有 LOD 共用同一个顶点缓冲区，只有索引不同
+
+#pragma once
+#ifndef PLAID_MESH_SIMPLIFY_H_
+#define PLAID_MESH_SIMPLIFY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <plaid/mat.h>
+#include <plaid/render_pass.h>
+
+#include "optimize.h"
+
+namespace plaid::mesh {
+
+/// 用边折叠简化三角形列表，直到索引数不超过目标或者继续折叠的误差超过上限
+/// 位置相同的多个顶点 (属性接缝) 与开放边界上的顶点不会被折叠掉
+/// @param dst 接收简化后的索引，至少能容纳 indices_count 个，不能与 indices 相同
+/// @param positions 第一个顶点位置 (3 个 float) 的地址
+/// @param stride 相邻两个顶点位置之间的字节数
+/// @param target_indices_count 目标索引数
+/// @param max_error 允许的误差上限，与顶点位置同单位
+/// @param result_error 接收实际的误差，可以为空
+/// @return 简化后的索引数
+std::uint32_t simplify(
+    std::uint32_t *dst, const std::uint32_t *indices, std::uint32_t indices_count,
+    const std::byte *positions, std::uint32_t stride, std::uint32_t vertices_count,
+    std::uint32_t target_indices_count, float max_error, float *result_error = nullptr
+);
+
+/// LOD 链中的一级，是共享索引缓冲区中连续的一段
+struct lod {
+  std::uint32_t first_index;
+  std::uint32_t indices_count;
+  /// 相对原网格的误差，与顶点位置同单位
+  float error;
+};
+
+struct lod_options {
+  /// 每一级相对上一级保留的三角形比例
+  float ratio = .5f;
+  /// 三角形数少于此值时不再生成下一级
+  std::uint32_t min_triangles = 64;
+  /// 包括原网格在内的最大级数
+  std::uint32_t max_levels = 8;
+  /// 每一级生成后按此大小的顶点缓存重排三角形
+  std::uint32_t cache_size = default_cache_size;
+};
+
+/// 生成 LOD 链，第 0 级是原网格，之后每一级由上一级简化得到
+/// @param indices 原网格的索引，各级的索引依次追加在后面
+/// @param positions 第一个顶点位置 (3 个 float) 的地址
+/// @param stride 相邻两个顶点位置之间的字节数
+std::vector<lod> build_lod_chain(
+    std::vector<std::uint32_t> &indices, const std::byte *positions, std::uint32_t stride,
+    std::uint32_t vertices_count, const lod_options & = {}
+);
+
+/// 选择投影到屏幕上的误差不超过 max_error_pixels 的最粗糙的一级
+/// @param center 网格中心，与顶点位置在同一个空间
+/// @param clip_transform 把顶点位置变换到裁剪空间的矩阵
+/// @param viewport_height 视口高度 (像素)
+[[nodiscard]] const lod &select_lod(
+    const std::vector<lod> &lods, const vec3 &center, const mat4 &clip_transform,
+    float viewport_height, float max_error_pixels = 1
+);
+
+/// 按 [select_lod] 选择一级并绘制，索引缓冲区应当已经绑定为 build_lod_chain 得到的索引
+void draw_lod(
+    render_pass::state &, const graphics_pipeline &, const std::vector<lod> &lods,
+    const vec3 &center, const mat4 &clip_transform, float viewport_height, float max_error_pixels = 1
+);
+
+} // namespace plaid::mesh
+
+#endif // PLAID_MESH_SIMPLIFY_H_
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cstring>
+
+#include <mesh/cluster.h>
+
+using namespace plaid;
+using namespace plaid::mesh;
+
+namespace {
+
+/// 由簇中的三角形计算包围球与法线锥
+void compute_bounds(
+    cluster &c, const std::uint32_t *indices, const std::byte *positions, std::uint32_t stride
+) {
+  auto position = [&](std::uint32_t vertex) {
+    vec3 res;
+    std::memcpy(&res, positions + std::size_t{stride} * vertex, sizeof(res));
+    return res;
+  };
+  auto first = indices + c.first_index, last = first + c.indices_count;
+
+  // 包围盒中心为球心，半径取到最远顶点的距离
+  vec3 lower = position(*first), upper = lower;
+  for (auto it = first; it != last; ++it) {
+    auto p = position(*it);
+    for (int k = 0; k != 3; ++k) {
+      lower[k] = (std::min)(lower[k], p[k]);
+      upper[k] = (std::max)(upper[k], p[k]);
+    }
+  }
+  c.center = (lower + upper) * .5f;
+  float radius2 = 0;
+  for (auto it = first; it != last; ++it) {
+    auto d = position(*it) - c.center;
+    radius2 = (std::max)(radius2, dot(d, d));
+  }
+  c.radius = std::sqrt(radius2);
+
+  // 以单位法线之和为轴，夹角最大的法线决定圆锥的半角
+  vec3 normals_sum{0, 0, 0};
+  for (auto it = first; it != last; it += 3) {
+    auto a = position(it[0]);
+    auto n = cross(position(it[1]) - a, position(it[2]) - a);
+    auto length = abs(n);
+    if (length > 0) {
+      normals_sum += n / length;
+    }
+  }
+  auto axis_length = abs(normals_sum);
+  c.cone_cos = -1;
+  if (axis_length <= 0) {
+    c.cone_axis = {0, 0, 1};
+    return;
+  }
+  c.cone_axis = normals_sum / axis_length;
+  float min_cos = 1;
+  for (auto it = first; it != last; it += 3) {
+    auto a = position(it[0]);
+    auto n = cross(position(it[1]) - a, position(it[2]) - a);
+    auto length = abs(n);
+    if (length > 0) {
+      min_cos = (std::min)(min_cos, dot(n, c.cone_axis) / length);
+    }
+  }
+  c.cone_cos = min_cos;
+}
+
+} // namespace
+
+std::vector<cluster> plaid::mesh::build_clusters(
+    const std::uint32_t *indices, std::uint32_t indices_count,
+    const std::byte *positions, std::uint32_t stride, std::uint32_t vertices_count,
+    const cluster_options &options
+) {
+  std::vector<cluster> clusters;
+  // 顶点最后一次被计入的簇编号加一，用来统计簇引用的不同顶点数
+  std::vector<std::uint32_t> owner(vertices_count, 0);
+  std::uint32_t vertices = 0;
+  vec3 normals_sum{0, 0, 0};
+
+  auto position = [&](std::uint32_t vertex) {
+    vec3 res;
+    std::memcpy(&res, positions + std::size_t{stride} * vertex, sizeof(res));
+    return res;
+  };
+
+  for (std::uint32_t i = 0; i + 3 <= indices_count; i += 3) {
+    auto triangle = indices + i;
+    auto a = position(triangle[0]);
+    auto n = cross(position(triangle[1]) - a, position(triangle[2]) - a);
+    auto length = abs(n);
+    if (length > 0) {
+      n = n / length;
+    }
+
+    auto split = clusters.empty();
+    if (!split) {
+      auto id = static_cast<std::uint32_t>(clusters.size());
+      std::uint32_t added = 0;
+      for (int k = 0; k != 3; ++k) {
+        added += owner[triangle[k]] != id && std::find(triangle, triangle + k, triangle[k]) == triangle + k;
+      }
+      auto sum_length = abs(normals_sum);
+      split = vertices + added > options.max_vertices ||
+              clusters.back().indices_count / 3 >= options.max_triangles ||
+              (length > 0 && sum_length > 0 && dot(n, normals_sum) < options.min_normal_cos * sum_length);
+    }
+    if (split) {
+      clusters.push_back({.first_index = i, .indices_count = 0});
+      vertices = 0;
+      normals_sum = {0, 0, 0};
+    }
+
+    auto id = static_cast<std::uint32_t>(clusters.size());
+    for (int k = 0; k != 3; ++k) {
+      if (owner[triangle[k]] != id) {
+        owner[triangle[k]] = id;
+        ++vertices;
+      }
+    }
+    if (length > 0) {
+      normals_sum += n;
+    }
+    clusters.back().indices_count += 3;
+  }
+
+  for (auto &c : clusters) {
+    compute_bounds(c, indices, positions, stride);
+  }
+  return clusters;
+}
@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <mesh/optimize.h>
+#include <plaid/vec.h>
+
+#include "parallel.h"
+
+using namespace plaid;
+using namespace plaid::mesh;
+
+std::uint32_t plaid::mesh::remove_degenerate_triangles(
+    std::uint32_t *indices, std::uint32_t indices_count, const std::byte *positions, std::uint32_t stride
+) {
+  auto out = indices;
+  for (auto it = indices, ed = indices + indices_count / 3 * 3; it != ed; it += 3) {
+    auto a = it[0], b = it[1], c = it[2];
+    if (a == b || b == c || c == a) {
+      continue;
+    }
+    if (positions) {
+      vec3 p[3];
+      for (int i = 0; i != 3; ++i) {
+        std::memcpy(&p[i], positions + std::size_t{stride} * it[i], sizeof(vec3));
+      }
+      auto n = cross(p[1] - p[0], p[2] - p[0]);
+      if (n.x == 0 && n.y == 0 && n.z == 0) {
+        continue;
+      }
+    }
+    out[0] = a, out[1] = b, out[2] = c;
+    out += 3;
+  }
+  return static_cast<std::uint32_t>(out - indices);
+}
+
+namespace {
+
+/// 把 10 位整数的各位间隔两位展开
+std::uint32_t spread_bits(std::uint32_t x) {
+  x = (x | (x << 16)) & 0x030000FF;
+  x = (x | (x << 8)) & 0x0300F00F;
+  x = (x | (x << 4)) & 0x030C30C3;
+  x = (x | (x << 2)) & 0x09249249;
+  return x;
+}
+
+/// 按三角形中心的 Morton 码重排三角形，使切分得到的每一段在空间上都是连续的一块，
+/// 否则文件中三角形的顺序杂乱时，每一段内几乎没有共用顶点
+void sort_triangles_spatially(indexed_mesh &mesh) {
+  auto positions = mesh.vertices + mesh.position_offset;
+  auto position = [&](std::uint32_t vertex) {
+    vec3 res;
+    std::memcpy(&res, positions + std::size_t{mesh.vertex_size} * vertex, sizeof(res));
+    return res;
+  };
+
+  vec3 lower = position(mesh.indices[0]), upper = lower;
+  for (std::uint32_t i = 0; i != mesh.indices_count; ++i) {
+    auto p = position(mesh.indices[i]);
+    for (int k = 0; k != 3; ++k) {
+      lower[k] = (std::min)(lower[k], p[k]);
+      upper[k] = (std::max)(upper[k], p[k]);
+    }
+  }
+
+  auto triangles_count = mesh.indices_count / 3;
+  std::vector<std::uint64_t> keys(triangles_count);
+  for (std::uint32_t t = 0; t != triangles_count; ++t) {
+    auto center = (position(mesh.indices[t * 3]) + position(mesh.indices[t * 3 + 1]) +
+                   position(mesh.indices[t * 3 + 2])) / 3.f;
+    std::uint32_t code = 0;
+    for (int k = 0; k != 3; ++k) {
+      auto extent = upper[k] - lower[k];
+      auto q = extent > 0 ? static_cast<std::uint32_t>((center[k] - lower[k]) / extent * 1023.f + .5f) : 0;
+      code |= spread_bits((std::min)(q, 1023u)) << k;
+    }
+    // 高 32 位是 Morton 码，低 32 位是三角形编号，排序结果是确定的
+    keys[t] = std::uint64_t{code} << 32 | t;
+  }
+  std::sort(keys.begin(), keys.end());
+
+  std::vector<std::uint32_t> sorted(mesh.indices_count);
+  for (std::uint32_t i = 0; i != triangles_count; ++i) {
+    auto t = static_cast<std::uint32_t>(keys[i]);
+    std::copy_n(mesh.indices + t * 3, 3, sorted.data() + i * 3);
+  }
+  std::copy(sorted.begin(), sorted.end(), mesh.indices);
+}
+
+/// 一个网格中连续的一段三角形
+struct mesh_chunk {
+  std::size_t mesh;
+  std::uint32_t first_index;
+  std::uint32_t indices_count;
+};
+
+/// 重排一段三角形的顺序
+/// 网格被切成多段时，先把这一段引用的顶点重新编号为 [0, n)，使临时数组的大小只与这一段有关
+void optimize_chunk(const indexed_mesh &mesh, const mesh_chunk &chunk, bool whole, const optimize_options &options) {
+  auto indices = mesh.indices + chunk.first_index;
+  auto count = chunk.indices_count;
+  const std::byte *positions = mesh.vertices + mesh.position_offset;
+  auto stride = mesh.vertex_size;
+  auto vertices_count = mesh.vertices_count;
+
+  std::vector<std::uint32_t> local;
+  std::vector<std::uint32_t> local_indices;
+  std::vector<vec3> local_positions;
+  if (!whole) {
+    // 按 (顶点编号, 位置) 排序后顺序扫描，相同的顶点编号得到相同的局部编号
+    std::vector<std::uint64_t> keys(count);
+    for (std::uint32_t i = 0; i != count; ++i) {
+      keys[i] = std::uint64_t{indices[i]} << 32 | i;
+    }
+    std::sort(keys.begin(), keys.end());
+    local_indices.resize(count);
+    for (auto key : keys) {
+      auto vertex = static_cast<std::uint32_t>(key >> 32);
+      if (local.empty() || local.back() != vertex) {
+        local.push_back(vertex);
+      }
+      local_indices[static_cast<std::uint32_t>(key)] = static_cast<std::uint32_t>(local.size() - 1);
+    }
+    local_positions.resize(local.size());
+    for (std::size_t i = 0; i != local.size(); ++i) {
+      std::memcpy(&local_positions[i], positions + std::size_t{stride} * local[i], sizeof(vec3));
+    }
+    indices = local_indices.data();
+    positions = reinterpret_cast<const std::byte *>(local_positions.data());
+    stride = sizeof(vec3);
+    vertices_count = static_cast<std::uint32_t>(local.size());
+  }
+
+  std::vector<std::uint32_t> ordered(count);
+  optimize_vertex_cache(ordered.data(), indices, count, vertices_count, options.cache_size);
+  optimize_overdraw(
+      indices, ordered.data(), count, positions, stride, vertices_count, options.cache_size, options.overdraw_threshold
+  );
+
+  if (!whole) {
+    auto out = mesh.indices + chunk.first_index;
+    for (std::uint32_t i = 0; i != count; ++i) {
+      out[i] = local[local_indices[i]];
+    }
+  }
+}
+
+} // namespace
+
+void plaid::mesh::optimize(
+    indexed_mesh *meshes, optimize_report *reports, std::size_t count, const optimize_options &options
+) {
+  std::vector<optimize_report> local_reports;
+  if (!reports) {
+    local_reports.resize(count);
+    reports = local_reports.data();
+  }
+
+  auto chunk_triangles = (std::max)(options.chunk_triangles, 1u);
+
+  // 统计优化前的缓存表现，去除退化三角形，需要切分的网格先按空间位置排序
+  parallel_for(static_cast<std::uint32_t>(count), [&](std::uint32_t i) {
+    auto &mesh = meshes[i];
+    auto &report = reports[i];
+    report.before = analyze_vertex_cache(mesh.indices, mesh.indices_count, mesh.vertices_count, options.cache_size);
+    auto remaining = remove_degenerate_triangles(
+        mesh.indices, mesh.indices_count, mesh.vertices + mesh.position_offset, mesh.vertex_size
+    );
+    report.degenerate_triangles = (mesh.indices_count - remaining) / 3;
+    mesh.indices_count = remaining;
+    if (remaining / 3 > chunk_triangles) {
+      sort_triangles_spatially(mesh);
+    }
+  });
+
+  // 各段分别重排三角形，段之间的接缝处损失少量缓存命中
+  std::vector<mesh_chunk> chunks;
+  auto chunk_indices = chunk_triangles * 3;
+  for (std::size_t i = 0; i != count; ++i) {
+    for (std::uint32_t first = 0; first < meshes[i].indices_count; first += chunk_indices) {
+      chunks.push_back({i, first, (std::min)(chunk_indices, meshes[i].indices_count - first)});
+    }
+  }
+  parallel_for(static_cast<std::uint32_t>(chunks.size()), [&](std::uint32_t i) {
+    auto &chunk = chunks[i];
+    auto &mesh = meshes[chunk.mesh];
+    optimize_chunk(mesh, chunk, chunk.indices_count == mesh.indices_count, options);
+  });
+
+  // 按最终的三角形顺序重排顶点
+  parallel_for(static_cast<std::uint32_t>(count), [&](std::uint32_t i) {
+    auto &mesh = meshes[i];
+    auto &report = reports[i];
+    std::vector<std::byte> vertices(std::size_t{mesh.vertex_size} * mesh.vertices_count);
+    auto remaining = optimize_vertex_fetch(
+        vertices.data(), mesh.indices, mesh.indices_count, mesh.vertices, mesh.vertices_count, mesh.vertex_size
+    );
+    std::memcpy(mesh.vertices, vertices.data(), std::size_t{mesh.vertex_size} * remaining);
+    report.unused_vertices = mesh.vertices_count - remaining;
+    mesh.vertices_count = remaining;
+    report.after = analyze_vertex_cache(mesh.indices, mesh.indices_count, mesh.vertices_count, options.cache_size);
+  });
+}
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cstring>
+
+#include <mesh/optimize.h>
+#include <plaid/vec.h>
+
+#include "vertex_cache.h"
+
+using namespace plaid;
+using namespace plaid::mesh;
+
+namespace {
+
+vec3 load_position(const std::byte *positions, std::uint32_t stride, std::uint32_t vertex) {
+  vec3 res;
+  std::memcpy(&res, positions + std::size_t{stride} * vertex, sizeof(res));
+  return res;
+}
+
+/// 连续的一段三角形
+struct cluster {
+  std::uint32_t first;
+  std::uint32_t last;
+  /// 越大越应该先绘制
+  float sort_key;
+};
+
+} // namespace
+
+void plaid::mesh::optimize_overdraw(
+    std::uint32_t *dst, const std::uint32_t *indices, std::uint32_t indices_count,
+    const std::byte *positions, std::uint32_t stride, std::uint32_t vertices_count,
+    std::uint32_t cache_size, float threshold
+) {
+  // Sander, Nehab, Barczak. Fast Triangle Reordering for Vertex Locality and Reduced Overdraw. 2007
+  auto triangles_count = indices_count / 3;
+  if (!triangles_count) {
+    return;
+  }
+
+  // 三个顶点都未命中的三角形是 Tipsify 回溯的位置，以此为硬边界，簇之间交换顺序不影响簇内的缓存命中
+  std::vector<cluster> hard;
+  std::uint32_t total_misses = 0;
+  {
+    fifo_cache cache(vertices_count, cache_size);
+    for (std::uint32_t t = 0; t != triangles_count; ++t) {
+      auto misses = cache.access_triangle(indices + t * 3);
+      total_misses += misses;
+      if (misses == 3 || !t) {
+        hard.push_back({t, t, 0});
+      }
+      hard.back().last = t + 1;
+    }
+  }
+
+  // 簇越小越容易排出好的遮挡顺序，在簇内 ACMR 已经足够低的位置继续切分，
+  // 切分后的簇从空缓存开始，阈值控制缓存命中率的损失
+  auto limit = threshold * static_cast<float>(total_misses) / static_cast<float>(triangles_count);
+  std::vector<cluster> clusters;
+  {
+    fifo_cache cache(vertices_count, cache_size);
+    for (auto &h : hard) {
+      cache.clear();
+      auto first = h.first;
+      std::uint32_t misses = 0;
+      for (auto t = h.first; t != h.last; ++t) {
+        misses += cache.access_triangle(indices + t * 3);
+        if (t + 1 != h.last && static_cast<float>(misses) <= limit * static_cast<float>(t + 1 - first)) {
+          clusters.push_back({first, t + 1, 0});
+          cache.clear();
+          first = t + 1;
+          misses = 0;
+        }
+      }
+      clusters.push_back({first, h.last, 0});
+    }
+  }
+
+  // 以面积加权的簇中心相对网格中心的位置在簇平均法线上的投影排序，
+  // 朝外的簇位于网格外侧，先绘制时更有可能遮挡其余的簇
+  vec3 mesh_center{0, 0, 0};
+  float mesh_area = 0;
+  std::vector<vec3> centers(clusters.size()), normals(clusters.size());
+  for (std::size_t c = 0; c != clusters.size(); ++c) {
+    vec3 center{0, 0, 0}, normal{0, 0, 0};
+    float area = 0;
+    for (auto t = clusters[c].first; t != clusters[c].last; ++t) {
+      auto a = load_position(positions, stride, indices[t * 3]);
+      auto b = load_position(positions, stride, indices[t * 3 + 1]);
+      auto p = load_position(positions, stride, indices[t * 3 + 2]);
+      auto n = cross(b - a, p - a);
+      auto s = abs(n);
+      center += (a + b + p) * (s / 3);
+      normal += n;
+      area += s;
+    }
+    mesh_center += center;
+    mesh_area += area;
+    centers[c] = area > 0 ? center / area : center;
+    normals[c] = normal;
+  }
+  if (mesh_area > 0) {
+    mesh_center = mesh_center / mesh_area;
+  }
+  for (std::size_t c = 0; c != clusters.size(); ++c) {
+    auto length = abs(normals[c]);
+    clusters[c].sort_key = length > 0 ? dot(centers[c] - mesh_center, normals[c]) / length : 0;
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(), [](const cluster &a, const cluster &b) {
+    return a.sort_key > b.sort_key;
+  });
+  for (auto &c : clusters) {
+    dst = std::copy(indices + c.first * 3, indices + c.last * 3, dst);
+  }
+}
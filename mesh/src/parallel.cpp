@@ -0,0 +1,29 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "parallel.h"
+
+using namespace plaid::mesh;
+
+void plaid::mesh::parallel_for(std::uint32_t count, const std::function<void(std::uint32_t)> &task) {
+  auto threads_count = (std::min)(count, (std::max)(std::thread::hardware_concurrency(), 1u));
+  std::atomic<std::uint32_t> next{0};
+  auto work = [&] {
+    for (auto i = next.fetch_add(1, std::memory_order_relaxed); i < count;
+         i = next.fetch_add(1, std::memory_order_relaxed)) {
+      task(i);
+    }
+  };
+
+  // 调用线程也参与执行
+  std::vector<std::thread> threads;
+  for (std::uint32_t i = 1; i < threads_count; ++i) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
@@ -0,0 +1,16 @@
+#pragma once
+#ifndef PLAID_MESH_PARALLEL_H_
+#define PLAID_MESH_PARALLEL_H_
+
+#include <cstdint>
+#include <functional>
+
+namespace plaid::mesh {
+
+/// 对 [0, count) 中的每个 i 执行一次 task(i)，任务在多个线程之间动态分配，全部完成后才返回
+/// 加载期使用，每次调用临时创建线程
+void parallel_for(std::uint32_t count, const std::function<void(std::uint32_t)> &task);
+
+} // namespace plaid::mesh
+
+#endif // PLAID_MESH_PARALLEL_H_
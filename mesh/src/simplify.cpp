@@ -0,0 +1,314 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+#include <mesh/simplify.h>
+
+using namespace plaid;
+using namespace plaid::mesh;
+
+namespace {
+
+/// 折叠之后周围三角形的法线与原法线的夹角余弦不能低于此值
+constexpr float max_normal_change = .25f;
+
+/// 对称的二次误差矩阵，Q(p) = pᵀAp + 2bᵀp + c，以三角形面积加权
+struct quadric {
+  double a00, a01, a02, a11, a12, a22;
+  double b0, b1, b2;
+  double c;
+  /// 所有平面的权重之和，误差除以它得到距离的平方
+  double weight;
+
+  /// 加入平面 dot(n, p) + d = 0，n 为单位向量
+  void add_plane(const vec3 &n, double d, double w) {
+    a00 += w * n.x * n.x, a01 += w * n.x * n.y, a02 += w * n.x * n.z;
+    a11 += w * n.y * n.y, a12 += w * n.y * n.z, a22 += w * n.z * n.z;
+    b0 += w * n.x * d, b1 += w * n.y * d, b2 += w * n.z * d;
+    c += w * d * d;
+    weight += w;
+  }
+
+  quadric &operator+=(const quadric &q) {
+    a00 += q.a00, a01 += q.a01, a02 += q.a02, a11 += q.a11, a12 += q.a12, a22 += q.a22;
+    b0 += q.b0, b1 += q.b1, b2 += q.b2;
+    c += q.c;
+    weight += q.weight;
+    return *this;
+  }
+
+  /// 点到所有平面的距离平方的加权平均
+  [[nodiscard]] double error(const vec3 &p) const {
+    double x = p.x, y = p.y, z = p.z;
+    auto e = a00 * x * x + a11 * y * y + a22 * z * z + 2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+             2 * (b0 * x + b1 * y + b2 * z) + c;
+    return weight > 0 ? (std::max)(e, 0.) / weight : 0;
+  }
+};
+
+/// 候选的边折叠：把顶点 from 合并到顶点 to 上
+struct collapse {
+  std::uint32_t from;
+  std::uint32_t to;
+  double cost;
+};
+
+} // namespace
+
+std::uint32_t plaid::mesh::simplify(
+    std::uint32_t *dst, const std::uint32_t *indices, std::uint32_t indices_count,
+    const std::byte *positions, std::uint32_t stride, std::uint32_t vertices_count,
+    std::uint32_t target_indices_count, float max_error, float *result_error
+) {
+  std::vector<vec3> position(vertices_count);
+  for (std::uint32_t v = 0; v != vertices_count; ++v) {
+    std::memcpy(&position[v], positions + std::size_t{stride} * v, sizeof(vec3));
+  }
+
+  // 位置相同的顶点焊接到同一个代表顶点上，拓扑关系都用代表顶点表示；
+  // 这样的顶点在属性上不连续，合并掉会撕开接缝，因此锁定
+  std::vector<std::uint32_t> welded(vertices_count);
+  std::vector<bool> locked(vertices_count);
+  {
+    std::vector<std::uint32_t> order(vertices_count);
+    std::iota(order.begin(), order.end(), 0);
+    auto less = [&](std::uint32_t a, std::uint32_t b) {
+      auto &p = position[a], &q = position[b];
+      return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+    };
+    std::sort(order.begin(), order.end(), less);
+    for (std::uint32_t i = 0; i != vertices_count;) {
+      auto j = i + 1;
+      while (j != vertices_count && !less(order[i], order[j])) {
+        ++j;
+      }
+      for (auto k = i; k != j; ++k) {
+        welded[order[k]] = order[i];
+      }
+      locked[order[i]] = j - i > 1;
+      i = j;
+    }
+  }
+
+  std::vector<std::uint32_t> current(indices, indices + indices_count / 3 * 3);
+  std::vector<quadric> quadrics(vertices_count);
+  for (std::size_t i = 0; i != current.size(); i += 3) {
+    auto &p0 = position[current[i]], &p1 = position[current[i + 1]], &p2 = position[current[i + 2]];
+    auto n = cross(p1 - p0, p2 - p0);
+    auto length = abs(n);
+    if (length <= 0) {
+      continue;
+    }
+    n = n / length;
+    auto d = -static_cast<double>(dot(n, p0));
+    for (auto v : {current[i], current[i + 1], current[i + 2]}) {
+      quadrics[welded[v]].add_plane(n, d, length * .5);
+    }
+  }
+
+  auto max_cost = static_cast<double>(max_error) * max_error;
+  double result = 0;
+  constexpr auto none = ~std::uint32_t{};
+  std::vector<bool> border(vertices_count), touched(vertices_count);
+  std::vector<std::uint32_t> offsets(vertices_count + 1), adjacency, collapse_to(vertices_count, none);
+  std::vector<std::uint64_t> edges;
+  std::vector<collapse> candidates;
+
+  // 每一轮按代价从小到大折叠互不相邻的边，然后重建三角形，直到达到目标或者无边可折
+  while (current.size() > target_indices_count) {
+    auto triangles_count = static_cast<std::uint32_t>(current.size() / 3);
+
+    // 只属于一个三角形的边是开放边界，边界上的顶点锁定，网格的轮廓因此保持不变
+    edges.clear();
+    for (std::size_t i = 0; i != current.size(); i += 3) {
+      for (int k = 0; k != 3; ++k) {
+        auto a = welded[current[i + k]], b = welded[current[i + (k + 1) % 3]];
+        edges.push_back(std::uint64_t{(std::min)(a, b)} << 32 | (std::max)(a, b));
+      }
+    }
+    std::sort(edges.begin(), edges.end());
+    std::fill(border.begin(), border.end(), false);
+    for (std::size_t i = 0; i != edges.size();) {
+      auto j = i + 1;
+      while (j != edges.size() && edges[j] == edges[i]) {
+        ++j;
+      }
+      if (j - i == 1) {
+        border[edges[i] >> 32] = border[edges[i] & 0xFFFFFFFF] = true;
+      }
+      i = j;
+    }
+
+    // 代表顶点到三角形的邻接表
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (auto v : current) {
+      ++offsets[welded[v] + 1];
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    adjacency.resize(current.size());
+    {
+      auto cursor = offsets;
+      for (std::size_t i = 0; i != current.size(); ++i) {
+        adjacency[cursor[welded[current[i]]]++] = static_cast<std::uint32_t>(i / 3);
+      }
+    }
+
+    // 合并到 to 的位置上，代价是两个顶点误差矩阵之和在该位置的值
+    candidates.clear();
+    for (std::size_t i = 0; i != current.size(); i += 3) {
+      for (int k = 0; k != 3; ++k) {
+        for (auto [from, to] : {std::pair{current[i + k], current[i + (k + 1) % 3]},
+                                std::pair{current[i + (k + 1) % 3], current[i + k]}}) {
+          auto a = welded[from], b = welded[to];
+          if (a == b || locked[a] || border[a]) {
+            continue;
+          }
+          auto q = quadrics[a];
+          q += quadrics[b];
+          candidates.push_back({a, to, q.error(position[to])});
+        }
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const collapse &x, const collapse &y) {
+      return x.cost < y.cost;
+    });
+
+    std::fill(touched.begin(), touched.end(), false);
+    auto target_triangles = target_indices_count / 3;
+    std::uint32_t collapsed = 0;
+    for (auto &candidate : candidates) {
+      if (candidate.cost > max_cost || triangles_count <= target_triangles) {
+        break;
+      }
+      auto a = candidate.from, b = welded[candidate.to];
+      if (touched[a] || touched[b]) {
+        continue;
+      }
+
+      // 周围不含 b 的三角形在合并之后不能翻转，法线的变化也不能太大，否则会产生细长的三角形
+      auto &target = position[candidate.to];
+      auto flipped = false;
+      for (auto it = offsets[a]; it != offsets[a + 1] && !flipped; ++it) {
+        auto t = current.data() + adjacency[it] * 3;
+        if (welded[t[0]] == b || welded[t[1]] == b || welded[t[2]] == b) {
+          continue;
+        }
+        vec3 before[3], after[3];
+        for (int k = 0; k != 3; ++k) {
+          before[k] = position[t[k]];
+          after[k] = welded[t[k]] == a ? target : before[k];
+        }
+        auto n0 = cross(before[1] - before[0], before[2] - before[0]);
+        auto n1 = cross(after[1] - after[0], after[2] - after[0]);
+        flipped = dot(n0, n1) <= max_normal_change * abs(n0) * abs(n1);
+      }
+      if (flipped) {
+        continue;
+      }
+
+      // 参与本轮折叠的三角形上的顶点都不再参与本轮折叠，之后的翻转检查才不会用到过时的位置
+      collapse_to[a] = candidate.to;
+      quadrics[b] += quadrics[a];
+      result = (std::max)(result, candidate.cost);
+      for (auto it = offsets[a]; it != offsets[a + 1]; ++it) {
+        auto t = current.data() + adjacency[it] * 3;
+        touched[welded[t[0]]] = touched[welded[t[1]]] = touched[welded[t[2]]] = true;
+      }
+      touched[b] = true;
+      // 内部的边折叠去掉两个三角形
+      triangles_count -= (std::min)(triangles_count, 2u);
+      ++collapsed;
+    }
+    if (!collapsed) {
+      break;
+    }
+
+    // 没有被锁定的顶点是自己的代表顶点，按代表顶点改写索引，去掉退化的三角形
+    std::size_t out = 0;
+    for (std::size_t i = 0; i != current.size(); i += 3) {
+      std::uint32_t t[3];
+      for (int k = 0; k != 3; ++k) {
+        auto v = current[i + k];
+        t[k] = collapse_to[welded[v]] != none ? collapse_to[welded[v]] : v;
+      }
+      if (welded[t[0]] == welded[t[1]] || welded[t[1]] == welded[t[2]] || welded[t[0]] == welded[t[2]]) {
+        continue;
+      }
+      std::copy_n(t, 3, current.data() + out);
+      out += 3;
+    }
+    current.resize(out);
+    for (auto &candidate : candidates) {
+      collapse_to[candidate.from] = none;
+    }
+  }
+
+  std::copy(current.begin(), current.end(), dst);
+  if (result_error) {
+    *result_error = static_cast<float>(std::sqrt(result));
+  }
+  return static_cast<std::uint32_t>(current.size());
+}
+
+std::vector<lod> plaid::mesh::build_lod_chain(
+    std::vector<std::uint32_t> &indices, const std::byte *positions, std::uint32_t stride,
+    std::uint32_t vertices_count, const lod_options &options
+) {
+  std::vector<lod> lods{{0, static_cast<std::uint32_t>(indices.size()), 0}};
+  std::vector<std::uint32_t> level(indices), simplified(indices.size()), ordered;
+  auto error = 0.f;
+  while (lods.size() < options.max_levels) {
+    auto count = lods.back().indices_count;
+    if (count / 3 <= options.min_triangles) {
+      break;
+    }
+    auto target = (std::max)(static_cast<std::uint32_t>(count / 3 * options.ratio), options.min_triangles) * 3;
+    float level_error;
+    auto simplified_count = simplify(
+        simplified.data(), level.data(), count, positions, stride, vertices_count, target,
+        std::numeric_limits<float>::max(), &level_error
+    );
+    // 锁定的顶点太多时简化不再有效果
+    if (!simplified_count || simplified_count > count - count / 16) {
+      break;
+    }
+
+    // 每一级都从上一级简化得到，误差按级累加，是相对原网格误差的上界
+    error += level_error;
+    ordered.resize(simplified_count);
+    optimize_vertex_cache(ordered.data(), simplified.data(), simplified_count, vertices_count, options.cache_size);
+    lods.push_back({static_cast<std::uint32_t>(indices.size()), simplified_count, error});
+    indices.insert(indices.end(), ordered.begin(), ordered.end());
+    level.assign(ordered.begin(), ordered.end());
+  }
+  return lods;
+}
+
+const lod &plaid::mesh::select_lod(
+    const std::vector<lod> &lods, const vec3 &center, const mat4 &clip_transform,
+    float viewport_height, float max_error_pixels
+) {
+  // 长度为 e 的误差在裁剪空间的 y 方向上约为 e * |第 1 行|，除以 w 再乘以半个视口高度得到像素数
+  auto &m = clip_transform;
+  auto w = m(3, 0) * center.x + m(3, 1) * center.y + m(3, 2) * center.z + m(3, 3);
+  if (w <= 0) {
+    return lods.front();
+  }
+  auto scale = abs(vec3{m(1, 0), m(1, 1), m(1, 2)}) * viewport_height * .5f / w;
+  for (auto it = lods.rbegin(); it != lods.rend(); ++it) {
+    if (it->error * scale <= max_error_pixels) {
+      return *it;
+    }
+  }
+  return lods.front();
+}
+
+void plaid::mesh::draw_lod(
+    render_pass::state &state, const graphics_pipeline &pipeline, const std::vector<lod> &lods,
+    const vec3 &center, const mat4 &clip_transform, float viewport_height, float max_error_pixels
+) {
+  auto &level = select_lod(lods, center, clip_transform, viewport_height, max_error_pixels);
+  state.draw_indexed(pipeline, level.indices_count, 1, level.first_index, 0, 0);
+}
@@ -0,0 +1,126 @@
+#include <mesh/optimize.h>
+
+#include "vertex_cache.h"
+
+using namespace plaid::mesh;
+
+vertex_cache_statistics plaid::mesh::analyze_vertex_cache(
+    const std::uint32_t *indices, std::uint32_t indices_count, std::uint32_t vertices_count,
+    std::uint32_t cache_size
+) {
+  fifo_cache cache(vertices_count, cache_size);
+  std::vector<bool> referenced(vertices_count);
+  std::uint32_t transformed = 0, unique = 0;
+  for (auto it = indices, ed = indices + indices_count; it != ed; ++it) {
+    transformed += cache.access(*it);
+    if (!referenced[*it]) {
+      referenced[*it] = true;
+      ++unique;
+    }
+  }
+
+  vertex_cache_statistics res{.vertices_transformed = transformed};
+  if (indices_count) {
+    res.acmr = static_cast<float>(transformed) / static_cast<float>(indices_count / 3);
+    res.atvr = static_cast<float>(transformed) / static_cast<float>(unique);
+  }
+  return res;
+}
+
+void plaid::mesh::optimize_vertex_cache(
+    std::uint32_t *dst, const std::uint32_t *indices, std::uint32_t indices_count, std::uint32_t vertices_count,
+    std::uint32_t cache_size
+) {
+  // Sander, Nehab, Barczak. Fast Triangle Reordering for Vertex Locality and Reduced Overdraw. 2007
+  // 每次选定一个扇心顶点并输出它周围所有尚未输出的三角形，
+  // 下一个扇心优先取仍在缓存中、并且输出剩余三角形之后不会被挤出缓存的顶点
+  auto triangles_count = indices_count / 3;
+
+  // 顶点到三角形的邻接表，live 是每个顶点尚未输出的三角形数
+  std::vector<std::uint32_t> live(vertices_count);
+  for (auto it = indices, ed = indices + indices_count; it != ed; ++it) {
+    ++live[*it];
+  }
+  std::vector<std::uint32_t> offsets(vertices_count + 1);
+  for (std::uint32_t v = 0; v != vertices_count; ++v) {
+    offsets[v + 1] = offsets[v] + live[v];
+  }
+  std::vector<std::uint32_t> adjacency(indices_count);
+  {
+    auto cursor = offsets;
+    for (std::uint32_t i = 0; i != indices_count; ++i) {
+      adjacency[cursor[indices[i]]++] = i / 3;
+    }
+  }
+
+  // 时间戳的含义与 [fifo_cache] 相同
+  std::vector<std::uint32_t> stamps(vertices_count, 0);
+  std::uint32_t time = cache_size + 1;
+  std::vector<bool> emitted(triangles_count);
+  // 最近输出过的顶点，扇心附近没有可选的顶点时从这里回溯
+  std::vector<std::uint32_t> dead_end;
+  dead_end.reserve(indices_count);
+  std::vector<std::uint32_t> candidates;
+  // 回溯也失败时按编号顺序寻找还有剩余三角形的顶点
+  std::uint32_t cursor = 0;
+
+  constexpr auto none = ~std::uint32_t{};
+  auto fanning = triangles_count ? indices[0] : none;
+  auto out = dst;
+  while (fanning != none) {
+    candidates.clear();
+    for (auto i = offsets[fanning], ed = offsets[fanning + 1]; i != ed; ++i) {
+      auto triangle = adjacency[i];
+      if (emitted[triangle]) {
+        continue;
+      }
+      emitted[triangle] = true;
+      for (auto v : {indices[triangle * 3], indices[triangle * 3 + 1], indices[triangle * 3 + 2]}) {
+        *out++ = v;
+        dead_end.push_back(v);
+        candidates.push_back(v);
+        --live[v];
+        if (time - stamps[v] > cache_size) {
+          stamps[v] = time++;
+        }
+      }
+    }
+
+    // 在缓存中停留得越久越好，但要保证输出它的剩余三角形 (最多 2 * live 个新顶点) 时它不会被挤出
+    fanning = none;
+    std::int64_t best = -1;
+    for (auto v : candidates) {
+      if (!live[v]) {
+        continue;
+      }
+      std::int64_t priority = 0;
+      if (time - stamps[v] + 2 * live[v] <= cache_size) {
+        priority = time - stamps[v];
+      }
+      if (priority > best) {
+        best = priority;
+        fanning = v;
+      }
+    }
+    if (fanning != none) {
+      continue;
+    }
+    while (!dead_end.empty()) {
+      auto v = dead_end.back();
+      dead_end.pop_back();
+      if (live[v]) {
+        fanning = v;
+        break;
+      }
+    }
+    if (fanning != none) {
+      continue;
+    }
+    while (cursor != vertices_count && !live[cursor]) {
+      ++cursor;
+    }
+    if (cursor != vertices_count) {
+      fanning = cursor;
+    }
+  }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#ifndef PLAID_MESH_VERTEX_CACHE_H_
+#define PLAID_MESH_VERTEX_CACHE_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace plaid::mesh {
+
+/// 用时间戳模拟的先进先出顶点缓存
+/// 每次未命中时间加一，顶点放入缓存时记下当时的时间，之后又有 size 个顶点放入时被挤出
+class fifo_cache {
+public:
+
+  fifo_cache(std::uint32_t vertices_count, std::uint32_t size)
+      : stamps_(vertices_count, 0), time_(size + 1), size_(size) {}
+
+  /// 访问顶点，未命中时把顶点放入缓存
+  /// @return 是否未命中
+  bool access(std::uint32_t vertex) {
+    if (time_ - stamps_[vertex] > size_) {
+      stamps_[vertex] = time_++;
+      return true;
+    }
+    return false;
+  }
+
+  /// 访问三角形的三个顶点
+  /// @return 未命中的顶点数
+  std::uint32_t access_triangle(const std::uint32_t *triangle) {
+    return access(triangle[0]) + access(triangle[1]) + access(triangle[2]);
+  }
+
+  /// 清空缓存
+  void clear() noexcept {
+    time_ += size_ + 1;
+  }
+
+private:
+  std::vector<std::uint32_t> stamps_;
+  std::uint32_t time_;
+  std::uint32_t size_;
+};
+
+} // namespace plaid::mesh
+
+#endif // PLAID_MESH_VERTEX_CACHE_H_
@@ -0,0 +1,24 @@
+#include <cstring>
+#include <vector>
+
+#include <mesh/optimize.h>
+
+using namespace plaid::mesh;
+
+std::uint32_t plaid::mesh::optimize_vertex_fetch(
+    std::byte *dst, std::uint32_t *indices, std::uint32_t indices_count,
+    const std::byte *vertices, std::uint32_t vertices_count, std::uint32_t vertex_size
+) {
+  constexpr auto unused = ~std::uint32_t{};
+  std::vector<std::uint32_t> remap(vertices_count, unused);
+  std::uint32_t next = 0;
+  for (auto it = indices, ed = indices + indices_count; it != ed; ++it) {
+    auto &target = remap[*it];
+    if (target == unused) {
+      std::memcpy(dst + std::size_t{vertex_size} * next, vertices + std::size_t{vertex_size} * *it, vertex_size);
+      target = next++;
+    }
+    *it = target;
+  }
+  return next;
+}
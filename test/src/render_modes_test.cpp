@@ -0,0 +1,307 @@
+/// 渲染路径的一致性测试：基准负载在立即、分块与 sort-last 渲染以及逐个、按通道执行下得到逐位相同的颜色与深度，
+/// 共享边的网格中每个像素恰好被着色一次
+/// 每项检查失败时输出位置与说明，有任何失败时以非零值退出
+
+#include <cstring>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <plaid.h>
+#include <plaid/shader.h>
+
+#include "workload.h"
+
+namespace {
+
+int failures = 0;
+
+#define PLAID_CHECK(cond)                                                                          \
+  do {                                                                                             \
+    if (!(cond)) {                                                                                 \
+      std::cerr << __FILE__ << ':' << __LINE__ << ": check failed: " #cond "\n";                   \
+      ++failures;                                                                                  \
+    }                                                                                              \
+  } while (false)
+
+constexpr std::uint32_t width = 320, height = 200;
+
+/// 一种渲染方式
+struct configuration {
+  const char *name;
+  plaid::render_mode mode;
+  bool tiled;
+  bool lanes;
+};
+
+constexpr configuration configurations[]{
+    {"immediate/scalar", plaid::render_mode::immediate, false, false},
+    {"immediate/lanes", plaid::render_mode::immediate, false, true},
+    {"tiled/scalar", plaid::render_mode::immediate, true, false},
+    {"tiled/lanes", plaid::render_mode::immediate, true, true},
+    {"sort_last/scalar", plaid::render_mode::sort_last, false, false},
+    {"sort_last/lanes", plaid::render_mode::sort_last, false, true},
+};
+
+/// 颜色附件加上可选的深度附件，颜色与深度都写回以便比较
+struct test_target {
+  plaid::render_pass render_pass;
+  plaid::frame_buffer frame_buffer;
+  std::vector<std::uint32_t> color;
+  std::vector<float> depth;
+  std::uint8_t attachments_count = 0;
+};
+
+/// @param tiled 为真时子通道再使用一个不写回的瞬态颜色附件，使渲染走分块路径，而深度仍然写回
+void initialize_target(test_target &target, bool depth, bool tiled) {
+  std::uint8_t depth_id = 1, transient_id = depth ? 2 : 1;
+  plaid::attachment_reference color_refs[]{{0, plaid::format::BGRA8u}, {transient_id, plaid::format::BGRA8u}};
+  plaid::attachment_reference depth_ref{depth_id, plaid::format::R32f};
+  plaid::subpass_description subpass{
+      .color_attachments_count = static_cast<std::uint8_t>(tiled ? 2 : 1),
+      .color_attachments = color_refs,
+      .depth_stencil_attachment = depth ? &depth_ref : nullptr,
+  };
+  std::vector<plaid::attachment_description> attachments{{
+      .load_op = plaid::attachment_load_op::clear,
+      .store_op = plaid::attachment_store_op::store,
+  }};
+  if (depth) {
+    attachments.push_back({
+        .stencil_load_op = plaid::attachment_load_op::clear,
+        .stencil_store_op = plaid::attachment_store_op::store,
+    });
+  }
+  if (tiled) {
+    attachments.push_back({
+        .load_op = plaid::attachment_load_op::clear,
+        .store_op = plaid::attachment_store_op::dont_care,
+    });
+  }
+  target.attachments_count = static_cast<std::uint8_t>(attachments.size());
+  target.render_pass = plaid::render_pass(plaid::render_pass::create_info{
+      .attachments_count = target.attachments_count,
+      .subpasses_count = 1,
+      .attachments = attachments.data(),
+      .subpasses = &subpass,
+  });
+
+  target.color.assign(width * height, 0);
+  target.depth.assign(depth ? width * height : 0, 0);
+  std::byte *addresses[]{
+      reinterpret_cast<std::byte *>(target.color.data()),
+      depth ? reinterpret_cast<std::byte *>(target.depth.data()) : nullptr,
+      nullptr,
+  };
+  target.frame_buffer = plaid::frame_buffer(target.attachments_count, addresses, width, height);
+}
+
+/// 开始渲染通道，交给 submit 提交绘制之后显式结束
+template <class Submit>
+void render(test_target &target, plaid::render_mode mode, Submit &&submit) {
+  static constexpr plaid::clear_value clear_values[]{
+      {.color{.u{0, 0, 0, 0}}},
+      {.depth_stencil{.depth = 1.f}},
+      {.color{.u{0, 0, 0, 0}}},
+  };
+  plaid::render_pass::state state({
+      .render_pass = target.render_pass,
+      .frame_buffer = target.frame_buffer,
+      .clear_values_count = target.attachments_count,
+      .clear_values = clear_values,
+      .mode = mode,
+  });
+  submit(state);
+  state.end();
+}
+
+template <class Tp>
+std::size_t count_differences(const std::vector<Tp> &a, const std::vector<Tp> &b) {
+  std::size_t count = 0;
+  for (std::size_t i = 0; i != a.size(); ++i) {
+    count += std::memcmp(&a[i], &b[i], sizeof(Tp)) != 0;
+  }
+  return count;
+}
+
+/// 每个负载渲染两帧，所有渲染方式的颜色与深度都与第一种逐位相同
+void test_workloads() {
+  struct frame_result {
+    std::vector<std::uint32_t> color;
+    std::vector<float> depth;
+  };
+  std::vector<std::string> names;
+  std::vector<frame_result> reference;
+  for (auto &config : configurations) {
+    test_target target;
+    initialize_target(target, true, config.tiled);
+    auto workloads = create_workloads(target.render_pass, float(width) / height, config.lanes);
+    std::size_t index = 0;
+    for (auto &load : workloads) {
+      for (std::uint32_t frame = 0; frame != 2; ++frame, ++index) {
+        render(target, config.mode, [&](plaid::render_pass::state &state) { load->render(state, frame); });
+        if (&config == configurations) {
+          names.push_back(std::string(load->name()) + " frame " + std::to_string(frame));
+          reference.push_back({target.color, target.depth});
+          continue;
+        }
+        auto colors = count_differences(target.color, reference[index].color);
+        auto depths = count_differences(target.depth, reference[index].depth);
+        if (colors || depths) {
+          std::cerr << names[index] << ", " << config.name << " differs from " << configurations[0].name << " in "
+                    << colors << " color and " << depths << " depth pixel(s)\n";
+        }
+        PLAID_CHECK(colors == 0 && depths == 0);
+      }
+    }
+  }
+}
+
+/// 每个像素被着色的次数
+std::vector<std::uint32_t> shaded(width * height);
+
+struct position_vert : plaid::vertex_shader {
+
+  location<0>::in<plaid::vec4> pos;
+
+  void main() { *gl_position = get(pos); }
+};
+
+/// 记录每个有效通道的片元坐标，以 float 或 floatx8 实例化
+template <class Float>
+struct counting_frag : plaid::fragment_shader {
+
+  location<0>::out<plaid::vec<Float, 4>> final_color;
+
+  void main() {
+    auto &coord = frag_coord<Float>();
+    if constexpr (std::is_same_v<Float, float>) {
+      ++shaded[static_cast<std::uint32_t>(coord.y) * width + static_cast<std::uint32_t>(coord.x)];
+    } else {
+      for (std::uint32_t i = 0; i != plaid::lanes_count; ++i) {
+        if (gl_lane_mask >> i & 1) {
+          ++shaded[static_cast<std::uint32_t>(coord.y[i]) * width + static_cast<std::uint32_t>(coord.x[i])];
+        }
+      }
+    }
+    get(final_color) = {};
+  }
+};
+
+/// 分隔线位于 [-8, size + 8] 之间，间距在小于一个像素到几十个像素之间变化，
+/// 落在像素中心与像素边界上的分隔线检查共享边上的覆盖规则
+std::vector<float> grid_lines(std::uint32_t size) {
+  constexpr float steps[]{1.5f, .75f, 3.25f, 9, 30.5f, 1, 4.5f, .5f, 17.25f};
+  std::vector<float> lines{-8};
+  for (std::size_t i = 0; lines.back() < static_cast<float>(size + 8); ++i) {
+    lines.push_back(lines.back() + steps[i % std::size(steps)]);
+  }
+  return lines;
+}
+
+/// 盖满整个屏幕的网格，顶点在间距的 15% 之内抖动，每格的对角线方向随机，
+/// 相邻三角形使用完全相同的顶点，任何渲染方式下每个像素都恰好被着色一次
+void test_shared_edges() {
+  auto xs = grid_lines(width), ys = grid_lines(height);
+  std::uint32_t seed = 12345;
+  auto next = [&] {
+    seed = seed * 1664525u + 1013904223u;
+    return static_cast<float>(seed >> 8) / (1u << 24);
+  };
+  // 抖动量取 1/8 像素的整数倍，使许多顶点与边恰好经过像素中心
+  auto jitter = [&](const std::vector<float> &lines, std::size_t i) {
+    if (i == 0 || i + 1 == lines.size()) {
+      return lines[i];
+    }
+    auto room = .15f * (std::min)(lines[i] - lines[i - 1], lines[i + 1] - lines[i]);
+    return lines[i] + static_cast<float>(static_cast<int>((next() * 2 - 1) * room * 8)) / 8;
+  };
+  std::vector<plaid::vec4> grid;
+  for (std::size_t j = 0; j != ys.size(); ++j) {
+    for (std::size_t i = 0; i != xs.size(); ++i) {
+      auto x = jitter(xs, i), y = jitter(ys, j);
+      grid.push_back({x / width * 2 - 1, y / height * 2 - 1, .5f, 1});
+    }
+  }
+  std::vector<plaid::vec4> vertices;
+  for (std::size_t j = 0; j + 1 != ys.size(); ++j) {
+    for (std::size_t i = 0; i + 1 != xs.size(); ++i) {
+      auto &p00 = grid[j * xs.size() + i], &p10 = grid[j * xs.size() + i + 1];
+      auto &p01 = grid[(j + 1) * xs.size() + i], &p11 = grid[(j + 1) * xs.size() + i + 1];
+      if (next() < .5f) {
+        vertices.insert(vertices.end(), {p00, p10, p11, p00, p11, p01});
+      } else {
+        vertices.insert(vertices.end(), {p00, p10, p01, p10, p11, p01});
+      }
+    }
+  }
+
+  constexpr plaid::vertex_input_binding_description binding{
+      .binding = 0,
+      .input_rate = plaid::vertex_input_rate::vertex,
+      .stride = sizeof(plaid::vec4),
+  };
+  constexpr plaid::vertex_input_attribute_description attribute{
+      .location = 0,
+      .binding = 0,
+      .offset = 0,
+  };
+  for (auto &config : configurations) {
+    // 没有深度附件时 sort-last 与立即渲染相同
+    if (config.mode == plaid::render_mode::sort_last) {
+      continue;
+    }
+    test_target target;
+    initialize_target(target, false, config.tiled);
+    plaid::graphics_pipeline pipeline(plaid::graphics_pipeline::create_info{
+        .vertex_input_state{
+            .bindings_count = 1,
+            .attributes_count = 1,
+            .bindings = &binding,
+            .attributes = &attribute,
+        },
+        .input_assembly_state{
+            .topology = plaid::primitive_topology::triangle_list,
+        },
+        .shader_stage{
+            .vertex_shader = plaid::dsl_shader_module::load<&position_vert::main>(),
+            .fragment_shader = config.lanes ? plaid::dsl_shader_module::load<counting_frag>()
+                                            : plaid::dsl_shader_module::load<&counting_frag<float>::main>(),
+        },
+        .rasterization_state{
+            .cull_mode = plaid::cull_modes::none,
+        },
+        .render_pass = target.render_pass,
+    });
+    std::fill(shaded.begin(), shaded.end(), 0);
+    render(target, config.mode, [&](plaid::render_pass::state &state) {
+      state.bind_vertex_buffer(0, reinterpret_cast<const std::byte *>(vertices.data()));
+      state.draw(pipeline, static_cast<std::uint32_t>(vertices.size()), 1, 0, 0);
+    });
+    std::size_t missed = 0, repeated = 0;
+    for (auto count : shaded) {
+      missed += count == 0;
+      repeated += count > 1;
+    }
+    if (missed || repeated) {
+      std::cerr << config.name << ": " << missed << " pixel(s) not shaded, " << repeated
+                << " pixel(s) shaded more than once\n";
+    }
+    PLAID_CHECK(missed == 0 && repeated == 0);
+  }
+}
+
+} // namespace
+
+int main() {
+  test_workloads();
+  test_shared_edges();
+  if (failures) {
+    std::cerr << failures << " check(s) failed\n";
+    return 1;
+  }
+  return 0;
+}
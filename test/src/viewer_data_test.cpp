@@ -0,0 +1,379 @@
+/// viewer 加载期预处理的回归测试：OBJ 分段解析、顶点合并、网格优化与简化、预处理缓存的失效
+/// 每项检查失败时输出位置与说明，有任何失败时以非零值退出
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <mesh/optimize.h>
+#include <mesh/simplify.h>
+
+#include "mesh_asset.h"
+#include "obj_model.h"
+
+namespace {
+
+int failures = 0;
+
+#define PLAID_CHECK(cond)                                                                          \
+  do {                                                                                             \
+    if (!(cond)) {                                                                                 \
+      std::cerr << __FILE__ << ':' << __LINE__ << ": check failed: " #cond "\n";                   \
+      ++failures;                                                                                  \
+    }                                                                                              \
+  } while (false)
+
+/// 测试使用的临时目录，结束时删除
+struct temp_directory {
+  std::filesystem::path path;
+
+  temp_directory() {
+    path = std::filesystem::temp_directory_path() /
+           ("plaid_viewer_data_test_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+    std::filesystem::create_directories(path);
+  }
+
+  ~temp_directory() {
+    std::error_code ec;
+    std::filesystem::remove_all(path, ec);
+  }
+};
+
+void write_file(const std::filesystem::path &path, const std::string &content) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out << content;
+}
+
+bool same_floats(const float *a, const float *b, std::size_t n) {
+  return std::memcmp(a, b, n * sizeof(float)) == 0;
+}
+
+/// 生成的 OBJ 文件与其中每个三角形顶点期望的 (位置, 纹理坐标, 法线) 编号
+struct generated_obj {
+  std::string text;
+  std::vector<std::array<std::uint32_t, 3>> expected;
+  std::uint32_t positions = 0, uvs = 0, normals = 0;
+};
+
+/// 分块重复的顶点与面，面混用绝对与负数 (相对) 编号以及 v、v/vt、v//vn、v/vt/vn 写法，
+/// 负数编号经常引用更早的块，使分段解析时跨段的相对编号得到检查
+generated_obj generate_obj(std::uint32_t blocks) {
+  generated_obj obj;
+  std::ostringstream out;
+  constexpr auto none = obj_model::none;
+  // 面的编号已经写入 out，这里结束这一行并记录拆分后的三角形
+  auto end_face = [&](std::initializer_list<std::array<std::uint32_t, 3>> corners) {
+    out << (obj.expected.size() % 5 == 0 ? "\r\n" : "\n");
+    std::vector<std::array<std::uint32_t, 3>> polygon(corners);
+    for (std::size_t i = 2; i != polygon.size(); ++i) {
+      obj.expected.push_back(polygon[0]);
+      obj.expected.push_back(polygon[i - 1]);
+      obj.expected.push_back(polygon[i]);
+    }
+  };
+  // 编号在文件中的写法
+  auto absolute = [](std::uint32_t index) { return std::to_string(index + 1); };
+  auto relative = [](std::uint32_t index, std::uint32_t count) {
+    return std::to_string(static_cast<std::int64_t>(index) - count);
+  };
+
+  for (std::uint32_t b = 0; b != blocks; ++b) {
+    out << "# block " << b << "\n\n";
+    for (int k = 0; k != 4; ++k) {
+      out << "v " << b * .5f << ' ' << (k & 1) << ' ' << (k >> 1) + .25f * b << '\n';
+      out << "vt " << k * .25f << ' ' << b * .125f << '\n';
+    }
+    for (int k = 0; k != 2; ++k) {
+      out << "vn " << k << " 1 " << b % 3 << '\n';
+    }
+    auto p = obj.positions += 4, t = obj.uvs += 4, n = obj.normals += 2;
+    auto p0 = p - 4, t0 = t - 4, n0 = n - 2;
+
+    out << "f " << relative(p0, p) << ' ' << relative(p0 + 1, p) << ' ' << relative(p0 + 2, p);
+    end_face({{p0, none, none}, {p0 + 1, none, none}, {p0 + 2, none, none}});
+    out << "f " << relative(p0 + 1, p) << "//" << relative(n0, n) << ' ' << relative(p0 + 2, p) << "//"
+        << relative(n0 + 1, n) << ' ' << relative(p0 + 3, p) << "//" << relative(n0 + 1, n);
+    end_face({{p0 + 1, none, n0}, {p0 + 2, none, n0 + 1}, {p0 + 3, none, n0 + 1}});
+    out << "f " << relative(p0, p) << '/' << relative(t0, t) << ' ' << absolute(p0 + 1) << '/' << absolute(t0 + 1)
+        << ' ' << relative(p0 + 3, p) << '/' << relative(t0 + 3, t) << ' ' << absolute(p0 + 2) << '/'
+        << relative(t0 + 2, t);
+    end_face({{p0, t0, none}, {p0 + 1, t0 + 1, none}, {p0 + 3, t0 + 3, none}, {p0 + 2, t0 + 2, none}});
+    if (b) {
+      // 引用前一块甚至更早的顶点
+      auto q = p0 - 4 * (std::min)(1 + b % 3, b);
+      out << "f " << relative(q, p) << '/' << relative(t0, t) << '/' << absolute(n0) << "  " << absolute(p0 + 1)
+          << '/' << absolute(t0 + 2) << '/' << relative(n0 + 1, n) << '\t' << relative(q + 2, p) << '/'
+          << relative(t0 - 1, t) << '/' << relative(n0 - 1, n);
+      end_face({{q, t0, n0}, {p0 + 1, t0 + 2, n0 + 1}, {q + 2, t0 - 1, n0 - 1}});
+    }
+  }
+  obj.text = out.str();
+  return obj;
+}
+
+std::vector<std::array<std::uint32_t, 3>> model_vertices(const obj_model &model) {
+  std::vector<std::array<std::uint32_t, 3>> result;
+  for (std::uint32_t i = 0; i != model.size(); ++i) {
+    auto &v = model.vertices()[i];
+    result.push_back({v.pos_index, v.uv_index, v.norm_index});
+  }
+  return result;
+}
+
+/// OBJ 按不同段数解析的结果都与期望的编号以及单段解析完全一致
+void test_obj_chunks(const std::filesystem::path &dir) {
+  auto obj = generate_obj(300);
+  auto path = (dir / "chunks.obj").string();
+  write_file(path, obj.text);
+
+  obj_model single(path.c_str(), 1);
+  PLAID_CHECK(single.positions_count() == obj.positions);
+  PLAID_CHECK(single.uvs_count() == obj.uvs);
+  PLAID_CHECK(single.normals_count() == obj.normals);
+  PLAID_CHECK(model_vertices(single) == obj.expected);
+
+  for (std::size_t chunks : {2, 3, 7, 16, 1000}) {
+    obj_model split(path.c_str(), chunks);
+    PLAID_CHECK(split.positions_count() == single.positions_count());
+    PLAID_CHECK(split.uvs_count() == single.uvs_count());
+    PLAID_CHECK(split.normals_count() == single.normals_count());
+    PLAID_CHECK(same_floats(&split.positions()->x, &single.positions()->x, single.positions_count() * 3));
+    PLAID_CHECK(same_floats(&split.uvs()->x, &single.uvs()->x, single.uvs_count() * 2));
+    PLAID_CHECK(same_floats(&split.normals()->x, &single.normals()->x, single.normals_count() * 3));
+    PLAID_CHECK(model_vertices(split) == obj.expected);
+  }
+
+  // 越界的相对编号在任何段数下都被拒绝
+  write_file(path, "v 0 0 0\nv 1 0 0\nv 0 1 0\nf -1 -2 -4\n");
+  for (std::size_t chunks : {1, 3}) {
+    auto rejected = false;
+    try {
+      obj_model bad(path.c_str(), chunks);
+    } catch (const std::logic_error &) {
+      rejected = true;
+    }
+    PLAID_CHECK(rejected);
+  }
+}
+
+/// 合并后的每个三角形顶点的属性与合并前一致，编号相同的面顶点只保留一份
+void test_indexed_mesh(const std::filesystem::path &dir) {
+  // 12 个面顶点中有 10 种不同的编号组合，位置相同而纹理坐标或法线不同的不能合并
+  auto path = (dir / "indexed.obj").string();
+  write_file(
+      path,
+      "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\n"
+      "vt 0 0\nvt 1 0\nvt 0 1\n"
+      "vn 0 0 1\nvn 0 0 -1\n"
+      "f 1/1/1 2/2/1 3/3/1\n"
+      "f 2/2/1 4/1/1 3/3/1\n"
+      "f 1//2 3//2 2//2\n"
+      "f 4 2 3\n"
+  );
+  obj_model model(path.c_str());
+  auto mesh = model.build_indexed_mesh();
+
+  PLAID_CHECK(mesh.indices.size() == model.size());
+  std::map<std::array<std::uint32_t, 3>, std::uint32_t> unique;
+  for (std::uint32_t i = 0; i != model.size(); ++i) {
+    auto &v = model.vertices()[i];
+    auto index = mesh.indices[i];
+    PLAID_CHECK(index < mesh.vertices.size());
+    auto [it, inserted] = unique.emplace(std::array{v.pos_index, v.uv_index, v.norm_index}, index);
+    PLAID_CHECK(it->second == index);
+
+    auto &dst = mesh.vertices[index];
+    PLAID_CHECK(same_floats(&dst.position.x, &model.positions()[v.pos_index].x, 3));
+    plaid::vec2 uv{};
+    if (v.uv_index != obj_model::none) {
+      uv = model.uvs()[v.uv_index];
+    }
+    PLAID_CHECK(same_floats(&dst.uv.x, &uv.x, 2));
+    if (v.norm_index != obj_model::none) {
+      PLAID_CHECK(same_floats(&dst.normal.x, &model.normals()[v.norm_index].x, 3));
+    }
+  }
+  PLAID_CHECK(unique.size() == mesh.vertices.size());
+  PLAID_CHECK(mesh.vertices.size() == 10);
+}
+
+/// 按行排列的规则网格，顶点高度不规则起伏，内部顶点都不与周围的三角形共面
+void grid_mesh(std::uint32_t side, std::vector<plaid::vec3> &positions, std::vector<std::uint32_t> &indices) {
+  for (std::uint32_t y = 0; y <= side; ++y) {
+    for (std::uint32_t x = 0; x <= side; ++x) {
+      positions.push_back({float(x), float(y), .1f * float((x * x * 7 + y * y * 3 + x * y) % 11)});
+    }
+  }
+  for (std::uint32_t y = 0; y != side; ++y) {
+    for (std::uint32_t x = 0; x != side; ++x) {
+      auto i = y * (side + 1) + x;
+      indices.insert(indices.end(), {i, i + 1, i + side + 2, i, i + side + 2, i + side + 1});
+    }
+  }
+}
+
+/// 三角形按位置比较，旋转到最小的顶点在前以保留环绕方向，之后排序
+std::vector<std::array<std::tuple<float, float, float>, 3>>
+triangle_set(const std::vector<plaid::vec3> &positions, const std::uint32_t *indices, std::uint32_t count) {
+  std::vector<std::array<std::tuple<float, float, float>, 3>> result;
+  for (std::uint32_t i = 0; i + 2 < count; i += 3) {
+    std::array<std::tuple<float, float, float>, 3> t;
+    for (int k = 0; k != 3; ++k) {
+      auto &p = positions[indices[i + k]];
+      t[k] = {p.x, p.y, p.z};
+    }
+    std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+    result.push_back(t);
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+/// 优化只改变三角形与顶点的顺序、去掉退化三角形与未使用的顶点，并且不会降低顶点缓存命中
+void test_optimize() {
+  std::vector<plaid::vec3> positions;
+  std::vector<std::uint32_t> indices;
+  grid_mesh(48, positions, indices);
+  // 打乱三角形的顺序，使顶点缓存命中有优化的余地
+  std::uint32_t seed = 1;
+  for (auto i = indices.size() / 3; i > 1; --i) {
+    seed = seed * 1664525u + 1013904223u;
+    auto it = indices.begin();
+    std::swap_ranges(it + (i - 1) * 3, it + i * 3, it + seed % i * 3);
+  }
+  auto expected = triangle_set(positions, indices.data(), static_cast<std::uint32_t>(indices.size()));
+  // 一个退化三角形与一个未被引用的顶点
+  indices.insert(indices.end(), {0, 0, 1});
+  positions.push_back({-1, -1, -1});
+
+  plaid::mesh::indexed_mesh mesh{
+      .vertices = reinterpret_cast<std::byte *>(positions.data()),
+      .vertex_size = sizeof(plaid::vec3),
+      .position_offset = 0,
+      .vertices_count = static_cast<std::uint32_t>(positions.size()),
+      .indices = indices.data(),
+      .indices_count = static_cast<std::uint32_t>(indices.size()),
+  };
+  plaid::mesh::optimize_report report;
+  plaid::mesh::optimize_options options;
+  options.chunk_triangles = 1000;
+  plaid::mesh::optimize(&mesh, &report, 1, options);
+
+  PLAID_CHECK(report.degenerate_triangles == 1);
+  PLAID_CHECK(report.unused_vertices == 1);
+  PLAID_CHECK(mesh.vertices_count == positions.size() - 1);
+  PLAID_CHECK(report.after.acmr <= report.before.acmr);
+  positions.resize(mesh.vertices_count);
+  PLAID_CHECK(std::all_of(indices.begin(), indices.begin() + mesh.indices_count, [&](std::uint32_t i) {
+    return i < mesh.vertices_count;
+  }));
+  PLAID_CHECK(triangle_set(positions, indices.data(), mesh.indices_count) == expected);
+}
+
+/// 简化得到的索引都有效并且不多于目标，LOD 链逐级变粗、误差不减
+void test_simplify() {
+  std::vector<plaid::vec3> positions;
+  std::vector<std::uint32_t> indices;
+  grid_mesh(32, positions, indices);
+  auto positions_bytes = reinterpret_cast<const std::byte *>(positions.data());
+  auto vertices_count = static_cast<std::uint32_t>(positions.size());
+  auto indices_count = static_cast<std::uint32_t>(indices.size());
+
+  std::vector<std::uint32_t> simplified(indices.size());
+  float error = -1;
+  auto count = plaid::mesh::simplify(
+      simplified.data(), indices.data(), indices_count, positions_bytes, sizeof(plaid::vec3), vertices_count,
+      indices_count / 4, 1e9f, &error
+  );
+  PLAID_CHECK(count % 3 == 0);
+  PLAID_CHECK(count <= indices_count / 4);
+  PLAID_CHECK(count > 0);
+  PLAID_CHECK(error >= 0);
+  PLAID_CHECK(std::all_of(simplified.begin(), simplified.begin() + count, [&](std::uint32_t i) {
+    return i < vertices_count;
+  }));
+
+  // 误差上限为 0 时平面以外的顶点不能被折叠掉，网格保持不变
+  count = plaid::mesh::simplify(
+      simplified.data(), indices.data(), indices_count, positions_bytes, sizeof(plaid::vec3), vertices_count,
+      0, 0, &error
+  );
+  PLAID_CHECK(error == 0);
+  PLAID_CHECK(count == indices_count);
+  PLAID_CHECK(triangle_set(positions, simplified.data(), count) == triangle_set(positions, indices.data(), indices_count));
+
+  auto lods = plaid::mesh::build_lod_chain(indices, positions_bytes, sizeof(plaid::vec3), vertices_count);
+  PLAID_CHECK(!lods.empty());
+  PLAID_CHECK(lods.front().first_index == 0 && lods.front().indices_count == indices_count);
+  for (std::size_t i = 1; i < lods.size(); ++i) {
+    PLAID_CHECK(lods[i].indices_count < lods[i - 1].indices_count);
+    PLAID_CHECK(lods[i].error >= lods[i - 1].error);
+    PLAID_CHECK(lods[i].first_index + lods[i].indices_count <= indices.size());
+  }
+}
+
+/// 缓存只在源文件内容改变时失效：只改变修改时间时仍然使用缓存，大小相同而内容不同时重新生成
+void test_cache(const std::filesystem::path &dir) {
+  auto source = dir / "cached.obj";
+  auto cache = (dir / "cached.plaidmesh").string();
+  std::string text = "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\nf 1 2 3\nf 2 4 3\n";
+  write_file(source, text);
+  auto source_path = source.string();
+
+  auto first = mesh_asset::load(source_path.c_str(), cache.c_str());
+  PLAID_CHECK(!first.cached());
+  auto second = mesh_asset::load(source_path.c_str(), cache.c_str());
+  PLAID_CHECK(second.cached());
+  PLAID_CHECK(second.vertices_count() == first.vertices_count());
+  PLAID_CHECK(second.indices_count() == first.indices_count());
+  PLAID_CHECK(std::equal(first.indices(), first.indices() + first.indices_count(), second.indices()));
+  PLAID_CHECK(second.lods().size() == first.lods().size());
+
+  // 内容相同，只有修改时间不同
+  auto mtime = std::filesystem::last_write_time(source);
+  write_file(source, text);
+  std::filesystem::last_write_time(source, mtime + std::chrono::seconds(10));
+  PLAID_CHECK(mesh_asset::load(source_path.c_str(), cache.c_str()).cached());
+
+  // 大小相同，内容不同
+  auto changed = text;
+  changed[changed.find("v 0") + 2] = '9';
+  write_file(source, changed);
+  std::filesystem::last_write_time(source, mtime + std::chrono::seconds(20));
+  PLAID_CHECK(!mesh_asset::load(source_path.c_str(), cache.c_str()).cached());
+  PLAID_CHECK(mesh_asset::load(source_path.c_str(), cache.c_str()).cached());
+
+  // 大小改变，修改时间相同
+  write_file(source, changed + "v 1 2 3\n");
+  std::filesystem::last_write_time(source, mtime + std::chrono::seconds(20));
+  PLAID_CHECK(!mesh_asset::load(source_path.c_str(), cache.c_str()).cached());
+
+  // 损坏的缓存被当作过期
+  write_file(cache, "PLAIDMSH");
+  PLAID_CHECK(!mesh_asset::load(source_path.c_str(), cache.c_str()).cached());
+}
+
+} // namespace
+
+int main() {
+  temp_directory dir;
+  test_obj_chunks(dir.path);
+  test_indexed_mesh(dir.path);
+  test_optimize();
+  test_simplify();
+  test_cache(dir.path);
+  if (failures) {
+    std::cerr << failures << " check(s) failed\n";
+    return 1;
+  }
+  return 0;
+}
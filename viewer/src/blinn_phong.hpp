@@ -4,30 +4,36 @@ namespace blinn_phong {
 
 struct vert : plaid::vertex_shader {
 
-  binding<0>::uniform<plaid::vec3[]> positions;
-  binding<1>::uniform<plaid::vec3[]> normals;
   binding<2>::uniform<plaid::mat4> mvp;
 
-  location<0>::in<std::int32_t> pos_index;
+  location<0>::in<plaid::vec3> position;
+  location<1>::in<plaid::vec3> vertex_normal;
 
   location<1>::out<plaid::vec3> normal;
 
   void main() {
-    auto i = get(pos_index);
-    auto pos = get(positions)[i];
+    auto pos = get(position);
     *gl_position = get(mvp) * plaid::vec4{pos.x, pos.y, pos.z, 1};
 
-    get(normal) = get(normals)[i];
+    get(normal) = get(vertex_normal);
+  }
+
+  /// 只计算位置，三角形通过剔除之后才执行 [main]
+  void position_only() {
+    auto pos = get(position);
+    *gl_position = get(mvp) * plaid::vec4{pos.x, pos.y, pos.z, 1};
   }
 };
 
+/// 以 float 实例化时逐个执行，以 floatx8 实例化时一次处理 8 个片元
+template <class Float>
 struct frag : plaid::fragment_shader {
 
   binding<3>::uniform<plaid::vec3> view;
 
-  location<1>::in<plaid::vec3> normal;
+  location<1>::in<plaid::vec<Float, 3>> normal;
 
-  location<0>::out<plaid::vec3> final_color;
+  location<0>::out<plaid::vec<Float, 3>> final_color;
 
   void main() {
     constexpr plaid::vec3 ambient = {1, 1, 1};
@@ -37,8 +43,8 @@ struct frag : plaid::fragment_shader {
     auto n = plaid::norm(get(normal));
     auto half = plaid::norm(get(view) + n);
 
-    auto diffuse = (std::max)(0.f, dot(n, light)) * light_color;
-    auto specular = (std::max)(0.f, dot(half, light)) * light_color;
+    auto diffuse = (plaid::max)(Float(0), dot(n, light)) * light_color;
+    auto specular = (plaid::max)(Float(0), dot(half, light)) * light_color;
     get(final_color) = ambient / 3 +
                        diffuse / 3 +
                        specular / 3;
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "image.h"
+
+namespace {
+
+struct rgb {
+  std::uint8_t r, g, b;
+
+  friend constexpr bool operator==(const rgb &, const rgb &) noexcept = default;
+};
+
+[[nodiscard]] constexpr rgb unpack(std::uint32_t pixel) noexcept {
+  return {
+      static_cast<std::uint8_t>(pixel >> 16),
+      static_cast<std::uint8_t>(pixel >> 8),
+      static_cast<std::uint8_t>(pixel),
+  };
+}
+
+void put_u32_be(std::vector<std::uint8_t> &out, std::uint32_t v) {
+  out.push_back(v >> 24);
+  out.push_back(v >> 16);
+  out.push_back(v >> 8);
+  out.push_back(v);
+}
+
+void write_bytes(std::ostream &os, const std::vector<std::uint8_t> &bytes) {
+  os.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+}
+
+void write_ppm(std::ostream &os, const std::uint32_t *pixels, std::uint32_t width, std::uint32_t height) {
+  os << "P6\n"
+     << width << ' ' << height << "\n255\n";
+  std::vector<std::uint8_t> row(width * 3);
+  for (std::uint32_t y = 0; y != height; ++y) {
+    auto dst = row.data();
+    for (auto it = pixels + y * width, ed = it + width; it != ed; ++it) {
+      auto [r, g, b] = unpack(*it);
+      *dst++ = r;
+      *dst++ = g;
+      *dst++ = b;
+    }
+    write_bytes(os, row);
+  }
+}
+
+/// 参考 https://qoiformat.org/qoi-specification.pdf
+void write_qoi(std::ostream &os, const std::uint32_t *pixels, std::uint32_t width, std::uint32_t height) {
+  constexpr std::uint8_t op_index = 0x00;
+  constexpr std::uint8_t op_diff = 0x40;
+  constexpr std::uint8_t op_luma = 0x80;
+  constexpr std::uint8_t op_run = 0xc0;
+  constexpr std::uint8_t op_rgb = 0xfe;
+
+  std::vector<std::uint8_t> out{'q', 'o', 'i', 'f'};
+  out.reserve(14 + width * height * 4 + 8);
+  put_u32_be(out, width);
+  put_u32_be(out, height);
+  // 3 通道，sRGB
+  out.push_back(3);
+  out.push_back(0);
+
+  std::array<rgb, 64> index{};
+  rgb prev{0, 0, 0};
+  std::uint8_t run = 0;
+  const auto count = static_cast<std::size_t>(width) * height;
+  for (std::size_t i = 0; i != count; ++i) {
+    auto px = unpack(pixels[i]);
+    if (px == prev) {
+      if (++run == 62 || i + 1 == count) {
+        out.push_back(op_run | (run - 1));
+        run = 0;
+      }
+      continue;
+    }
+    if (run) {
+      out.push_back(op_run | (run - 1));
+      run = 0;
+    }
+
+    // 透明通道恒为 255
+    auto hash = (px.r * 3 + px.g * 5 + px.b * 7 + 255 * 11) % 64;
+    if (index[hash] == px) {
+      out.push_back(op_index | hash);
+    } else {
+      index[hash] = px;
+      auto vr = static_cast<std::int8_t>(px.r - prev.r);
+      auto vg = static_cast<std::int8_t>(px.g - prev.g);
+      auto vb = static_cast<std::int8_t>(px.b - prev.b);
+      auto vg_r = vr - vg;
+      auto vg_b = vb - vg;
+      if (vr >= -2 && vr <= 1 && vg >= -2 && vg <= 1 && vb >= -2 && vb <= 1) {
+        out.push_back(op_diff | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+      } else if (vg >= -32 && vg <= 31 && vg_r >= -8 && vg_r <= 7 && vg_b >= -8 && vg_b <= 7) {
+        out.push_back(op_luma | (vg + 32));
+        out.push_back((vg_r + 8) << 4 | (vg_b + 8));
+      } else {
+        out.push_back(op_rgb);
+        out.push_back(px.r);
+        out.push_back(px.g);
+        out.push_back(px.b);
+      }
+    }
+    prev = px;
+  }
+
+  for (int i = 0; i != 7; ++i) out.push_back(0);
+  out.push_back(1);
+  write_bytes(os, out);
+}
+
+[[nodiscard]] std::uint32_t crc32(const std::uint8_t *first, const std::uint8_t *last) {
+  static const auto table = [] {
+    std::array<std::uint32_t, 256> t;
+    for (std::uint32_t n = 0; n != 256; ++n) {
+      auto c = n;
+      for (int k = 0; k != 8; ++k) {
+        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      }
+      t[n] = c;
+    }
+    return t;
+  }();
+  std::uint32_t c = 0xffffffffu;
+  for (; first != last; ++first) {
+    c = table[(c ^ *first) & 0xff] ^ (c >> 8);
+  }
+  return c ^ 0xffffffffu;
+}
+
+void put_png_chunk(std::vector<std::uint8_t> &out, const char (&type)[5], const std::vector<std::uint8_t> &data) {
+  put_u32_be(out, data.size());
+  auto start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  put_u32_be(out, crc32(out.data() + start, out.data() + out.size()));
+}
+
+/// 使用不压缩的 deflate 块，不依赖 zlib
+void write_png(std::ostream &os, const std::uint32_t *pixels, std::uint32_t width, std::uint32_t height) {
+  // 每行以过滤类型 0 开始
+  std::vector<std::uint8_t> raw;
+  raw.reserve((width * 3 + 1) * height);
+  for (std::uint32_t y = 0; y != height; ++y) {
+    raw.push_back(0);
+    for (auto it = pixels + y * width, ed = it + width; it != ed; ++it) {
+      auto [r, g, b] = unpack(*it);
+      raw.push_back(r);
+      raw.push_back(g);
+      raw.push_back(b);
+    }
+  }
+
+  std::vector<std::uint8_t> zlib{0x78, 0x01};
+  constexpr std::size_t max_block = 0xffff;
+  std::size_t offset = 0;
+  do {
+    auto len = (std::min)(max_block, raw.size() - offset);
+    auto final_block = offset + len == raw.size();
+    zlib.push_back(final_block);
+    zlib.push_back(len);
+    zlib.push_back(len >> 8);
+    zlib.push_back(~len);
+    zlib.push_back(~len >> 8);
+    zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + len);
+    offset += len;
+  } while (offset != raw.size());
+
+  std::uint32_t a = 1, b = 0;
+  for (auto v : raw) {
+    a = (a + v) % 65521;
+    b = (b + a) % 65521;
+  }
+  put_u32_be(zlib, b << 16 | a);
+
+  std::vector<std::uint8_t> header;
+  put_u32_be(header, width);
+  put_u32_be(header, height);
+  // 8 位深度，RGB，标准压缩与过滤方法，无隔行
+  header.insert(header.end(), {8, 2, 0, 0, 0});
+
+  std::vector<std::uint8_t> out{0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  put_png_chunk(out, "IHDR", header);
+  put_png_chunk(out, "IDAT", zlib);
+  put_png_chunk(out, "IEND", {});
+  write_bytes(os, out);
+}
+
+} // namespace
+
+image_format image_format_from_path(std::string_view path) {
+  auto dot = path.rfind('.');
+  if (dot == std::string_view::npos) {
+    return image_format::ppm;
+  }
+  return image_format_from_name(path.substr(dot + 1));
+}
+
+image_format image_format_from_name(std::string_view name) {
+  if (name == "qoi") {
+    return image_format::qoi;
+  } else if (name == "png") {
+    return image_format::png;
+  }
+  return image_format::ppm;
+}
+
+void write_image(
+    std::ostream &os, image_format format,
+    const std::uint32_t *pixels, std::uint32_t width, std::uint32_t height
+) {
+  switch (format) {
+    case image_format::ppm: write_ppm(os, pixels, width, height); break;
+    case image_format::qoi: write_qoi(os, pixels, width, height); break;
+    case image_format::png: write_png(os, pixels, width, height); break;
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+#ifndef PLAID_VIEWER_IMAGE_H_
+#define PLAID_VIEWER_IMAGE_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+/// 图片编码格式
+enum class image_format : std::uint8_t {
+  /// 二进制 PPM (P6)
+  ppm,
+  /// Quite OK Image
+  qoi,
+  /// 不压缩的 PNG
+  png,
+};
+
+/// 根据文件扩展名推断图片格式，无法识别时为 ppm
+/// @param path 文件路径
+[[nodiscard]] image_format image_format_from_path(std::string_view path);
+
+/// 根据名称获取图片格式，无法识别时为 ppm
+/// @param name 格式名称，例如 "qoi"
+[[nodiscard]] image_format image_format_from_name(std::string_view name);
+
+/// 把 BGRA8u 格式的像素编码为图片写入流中，透明通道将被忽略
+/// @param pixels 按行排列的像素
+/// @param width 图片宽度
+/// @param height 图片高度
+void write_image(
+    std::ostream &, image_format,
+    const std::uint32_t *pixels, std::uint32_t width, std::uint32_t height
+);
+
+#endif // PLAID_VIEWER_IMAGE_H_
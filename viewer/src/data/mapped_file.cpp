@@ -0,0 +1,96 @@
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+
+mapped_file::mapped_file(const char *path) {
+  m_file = CreateFileA(
+      path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+  );
+  if (m_file == INVALID_HANDLE_VALUE) {
+    m_file = nullptr;
+    throw std::runtime_error(std::string("Cannot open file: ") + path);
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(m_file, &size)) {
+    CloseHandle(m_file);
+    throw std::runtime_error(std::string("Cannot get file size: ") + path);
+  }
+  m_size = static_cast<std::size_t>(size.QuadPart);
+  // 空文件无法创建映射
+  if (!m_size) {
+    return;
+  }
+  m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (m_mapping) {
+    m_data = static_cast<const char *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  }
+  if (!m_data) {
+    if (m_mapping) {
+      CloseHandle(m_mapping);
+    }
+    CloseHandle(m_file);
+    throw std::runtime_error(std::string("Cannot map file: ") + path);
+  }
+}
+
+mapped_file::~mapped_file() {
+  if (m_data) {
+    UnmapViewOfFile(m_data);
+  }
+  if (m_mapping) {
+    CloseHandle(m_mapping);
+  }
+  if (m_file) {
+    CloseHandle(m_file);
+  }
+}
+
+#else
+
+mapped_file::mapped_file(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error(std::string("Cannot open file: ") + path);
+  }
+  struct stat info {};
+  if (fstat(fd, &info)) {
+    close(fd);
+    throw std::runtime_error(std::string("Cannot get file size: ") + path);
+  }
+  m_size = static_cast<std::size_t>(info.st_size);
+  // 空文件无法创建映射
+  if (m_size) {
+    auto ptr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error(std::string("Cannot map file: ") + path);
+    }
+    m_data = static_cast<const char *>(ptr);
+    // 按顺序读取，提示内核提前读入后续页
+    madvise(ptr, m_size, MADV_SEQUENTIAL);
+  }
+  // 映射建立后文件描述符可以关闭
+  close(fd);
+}
+
+mapped_file::~mapped_file() {
+  if (m_data) {
+    munmap(const_cast<char *>(m_data), m_size);
+  }
+}
+
+#endif
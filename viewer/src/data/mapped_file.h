@@ -0,0 +1,38 @@
+#pragma once
+#ifndef PLAID_VIEWER_MAPPED_FILE_H_
+#define PLAID_VIEWER_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string_view>
+
+/// 只读映射到内存的文件，文件内容由操作系统按需换页读入
+class mapped_file {
+public:
+
+  /// 映射整个文件，文件不存在或者无法映射时抛出 std::runtime_error
+  /// @param path 文件路径
+  explicit mapped_file(const char *path);
+
+  mapped_file(const mapped_file &) = delete;
+
+  mapped_file &operator=(const mapped_file &) = delete;
+
+  ~mapped_file();
+
+  [[nodiscard]] inline const char *data() const noexcept { return m_data; }
+
+  [[nodiscard]] inline std::size_t size() const noexcept { return m_size; }
+
+  [[nodiscard]] inline std::string_view view() const noexcept { return {m_data, m_size}; }
+
+private:
+
+  const char *m_data = nullptr;
+  std::size_t m_size = 0;
+#ifdef _WIN32
+  void *m_file = nullptr;
+  void *m_mapping = nullptr;
+#endif
+};
+
+#endif // PLAID_VIEWER_MAPPED_FILE_H_
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include <mesh/cluster.h>
+#include <mesh/optimize.h>
+
+#include "mesh_asset.h"
+
+namespace {
+
+constexpr char file_magic[8]{'P', 'L', 'A', 'I', 'D', 'M', 'S', 'H'};
+
+/// 各段在文件中的对齐
+constexpr std::uint64_t section_align = 16;
+
+/// 一段数据在文件中的字节偏移与元素个数
+struct section {
+  std::uint64_t offset;
+  std::uint64_t count;
+};
+
+struct header {
+  char magic[8];
+  std::uint32_t version;
+  /// 各结构的字节数，编译器或平台不同导致布局改变时缓存不能使用
+  std::uint32_t vertex_size;
+  std::uint32_t cluster_size;
+  std::uint32_t lod_size;
+  /// 生成缓存时源文件的大小、修改时间与内容哈希值
+  std::uint64_t source_size;
+  std::int64_t source_mtime;
+  std::uint64_t source_hash;
+  mesh_asset::bounding_volume bounds;
+  section vertices;
+  section indices;
+  section clusters;
+  section lods;
+};
+
+/// 按 8 字节一组计算的 64 位哈希值，只用来判断内容是否改变
+std::uint64_t hash_bytes(const char *data, std::size_t size) noexcept {
+  constexpr std::uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+  std::uint64_t hash = size * multiplier;
+  auto mix = [&](std::uint64_t word) {
+    hash = (hash ^ word) * multiplier;
+    hash ^= hash >> 29;
+  };
+  std::size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, data + i, 8);
+    mix(word);
+  }
+  if (i != size) {
+    std::uint64_t word = 0;
+    std::memcpy(&word, data + i, size - i);
+    mix(word);
+  }
+  return hash;
+}
+
+/// 段完整地位于文件之内并且满足对齐
+bool valid_section(const section &s, std::size_t element_size, std::size_t file_size) noexcept {
+  return s.offset % section_align == 0 && s.offset <= file_size && s.count <= UINT32_MAX &&
+         s.count <= (file_size - s.offset) / element_size;
+}
+
+/// @return 文件是当前版本与布局的缓存并且源文件大小相同时返回头部，否则为空
+const header *check_header(const mapped_file &file, std::uint64_t source_size) noexcept {
+  if (file.size() < sizeof(header)) {
+    return nullptr;
+  }
+  auto h = reinterpret_cast<const header *>(file.data());
+  if (std::memcmp(h->magic, file_magic, sizeof(file_magic)) || h->version != mesh_asset::version ||
+      h->vertex_size != sizeof(obj_model::mesh_vertex) || h->cluster_size != sizeof(plaid::cluster) ||
+      h->lod_size != sizeof(plaid::mesh::lod) || h->source_size != source_size) {
+    return nullptr;
+  }
+  if (!valid_section(h->vertices, h->vertex_size, file.size()) ||
+      !valid_section(h->indices, sizeof(std::uint32_t), file.size()) ||
+      !valid_section(h->clusters, h->cluster_size, file.size()) ||
+      !valid_section(h->lods, h->lod_size, file.size())) {
+    return nullptr;
+  }
+  return h;
+}
+
+/// 先写入临时文件再改名，多个进程同时生成同一个缓存时，读取者不会看到写了一半的文件
+void write_cache(const std::string &path, header h, const mesh_asset &asset) {
+  std::uint64_t offset = (sizeof(header) + section_align - 1) / section_align * section_align;
+  auto place = [&](section &s, std::uint64_t count, std::size_t element_size) {
+    s = {offset, count};
+    offset = (offset + count * element_size + section_align - 1) / section_align * section_align;
+  };
+  place(h.vertices, asset.vertices_count(), sizeof(obj_model::mesh_vertex));
+  place(h.indices, asset.indices_count(), sizeof(std::uint32_t));
+  place(h.clusters, asset.clusters_count(), sizeof(plaid::cluster));
+  place(h.lods, asset.lods().size(), sizeof(plaid::mesh::lod));
+
+  auto temp = path + ".tmp" + std::to_string(std::random_device{}());
+  {
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    auto write = [&](const section &s, const void *data, std::size_t element_size) {
+      static constexpr char padding[section_align]{};
+      out.write(padding, static_cast<std::streamsize>(s.offset - out.tellp()));
+      out.write(static_cast<const char *>(data), static_cast<std::streamsize>(s.count * element_size));
+    };
+    out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    write(h.vertices, asset.vertices(), sizeof(obj_model::mesh_vertex));
+    write(h.indices, asset.indices(), sizeof(std::uint32_t));
+    write(h.clusters, asset.clusters(), sizeof(plaid::cluster));
+    write(h.lods, asset.lods().data(), sizeof(plaid::mesh::lod));
+    if (!out.flush()) {
+      out.close();
+      std::error_code ec;
+      std::filesystem::remove(temp, ec);
+      return;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(temp, path, ec);
+  if (ec) {
+    std::filesystem::remove(temp, ec);
+  }
+}
+
+} // namespace
+
+mesh_asset mesh_asset::load(const char *source, const char *cache_path) {
+  auto cache = cache_path ? std::string(cache_path) : std::string(source) + ".plaidmesh";
+
+  std::error_code ec;
+  std::uint64_t source_size = std::filesystem::file_size(source, ec);
+  if (ec) {
+    throw std::runtime_error(std::string("Cannot open file: ") + source);
+  }
+  auto source_mtime = static_cast<std::int64_t>(
+      std::filesystem::last_write_time(source, ec).time_since_epoch().count()
+  );
+
+  // 只有需要时才读取整个源文件计算哈希值
+  std::optional<std::uint64_t> source_hash;
+  auto hash_source = [&] {
+    if (!source_hash) {
+      mapped_file file(source);
+      source_hash = hash_bytes(file.data(), file.size());
+    }
+    return *source_hash;
+  };
+
+  std::unique_ptr<mapped_file> file;
+  try {
+    if (std::filesystem::exists(cache, ec)) {
+      file = std::make_unique<mapped_file>(cache.c_str());
+    }
+  } catch (const std::runtime_error &) {
+    file.reset();
+  }
+  if (file) {
+    auto h = check_header(*file, source_size);
+    if (h && (h->source_mtime == source_mtime || h->source_hash == hash_source())) {
+      if (h->source_mtime != source_mtime) {
+        // 内容没有改变，记录新的修改时间，之后的加载不必再计算哈希值
+        std::fstream out(cache, std::ios::binary | std::ios::in | std::ios::out);
+        out.seekp(offsetof(header, source_mtime));
+        out.write(reinterpret_cast<const char *>(&source_mtime), sizeof(source_mtime));
+      }
+      mesh_asset asset;
+      auto data = file->data();
+      asset.m_vertices = reinterpret_cast<const obj_model::mesh_vertex *>(data + h->vertices.offset);
+      asset.m_vertices_count = static_cast<std::uint32_t>(h->vertices.count);
+      asset.m_indices = reinterpret_cast<const std::uint32_t *>(data + h->indices.offset);
+      asset.m_indices_count = static_cast<std::uint32_t>(h->indices.count);
+      asset.m_clusters = reinterpret_cast<const plaid::cluster *>(data + h->clusters.offset);
+      asset.m_clusters_count = static_cast<std::uint32_t>(h->clusters.count);
+      auto lods = reinterpret_cast<const plaid::mesh::lod *>(data + h->lods.offset);
+      asset.m_lods.assign(lods, lods + h->lods.count);
+      asset.m_bounds = h->bounds;
+      asset.m_file = std::move(file);
+      return asset;
+    }
+    file.reset();
+  }
+
+  // 合并重复的顶点，再按顶点缓存与遮挡关系重排三角形、按使用顺序重排顶点
+  auto mesh = obj_model(source).build_indexed_mesh();
+  plaid::mesh::indexed_mesh optimized{
+      .vertices = reinterpret_cast<std::byte *>(mesh.vertices.data()),
+      .vertex_size = sizeof(obj_model::mesh_vertex),
+      .position_offset = offsetof(obj_model::mesh_vertex, position),
+      .vertices_count = static_cast<std::uint32_t>(mesh.vertices.size()),
+      .indices = mesh.indices.data(),
+      .indices_count = static_cast<std::uint32_t>(mesh.indices.size()),
+  };
+  plaid::mesh::optimize(&optimized, nullptr, 1);
+  mesh.vertices.resize(optimized.vertices_count);
+  mesh.indices.resize(optimized.indices_count);
+
+  mesh_asset asset;
+  auto positions = reinterpret_cast<const std::byte *>(mesh.vertices.data()) + offsetof(obj_model::mesh_vertex, position);
+  auto stride = static_cast<std::uint32_t>(sizeof(obj_model::mesh_vertex));
+  auto vertices_count = static_cast<std::uint32_t>(mesh.vertices.size());
+  // 网格簇只覆盖第 0 级，需要在追加其余各级之前生成
+  asset.m_clusters_storage = plaid::mesh::build_clusters(
+      mesh.indices.data(), static_cast<std::uint32_t>(mesh.indices.size()), positions, stride, vertices_count
+  );
+  asset.m_lods = plaid::mesh::build_lod_chain(mesh.indices, positions, stride, vertices_count);
+
+  auto &b = asset.m_bounds;
+  if (!mesh.vertices.empty()) {
+    b.min = b.max = mesh.vertices.front().position;
+    for (auto &v : mesh.vertices) {
+      for (int k = 0; k != 3; ++k) {
+        b.min[k] = (std::min)(b.min[k], v.position[k]);
+        b.max[k] = (std::max)(b.max[k], v.position[k]);
+      }
+    }
+    b.center = (b.min + b.max) / 2.f;
+    for (auto &v : mesh.vertices) {
+      b.radius = (std::max)(b.radius, plaid::abs(v.position - b.center));
+    }
+  }
+
+  asset.m_vertices_storage = std::move(mesh.vertices);
+  asset.m_indices_storage = std::move(mesh.indices);
+  asset.m_vertices = asset.m_vertices_storage.data();
+  asset.m_vertices_count = static_cast<std::uint32_t>(asset.m_vertices_storage.size());
+  asset.m_indices = asset.m_indices_storage.data();
+  asset.m_indices_count = static_cast<std::uint32_t>(asset.m_indices_storage.size());
+  asset.m_clusters = asset.m_clusters_storage.data();
+  asset.m_clusters_count = static_cast<std::uint32_t>(asset.m_clusters_storage.size());
+
+  header h{};
+  std::memcpy(h.magic, file_magic, sizeof(file_magic));
+  h.version = version;
+  h.vertex_size = sizeof(obj_model::mesh_vertex);
+  h.cluster_size = sizeof(plaid::cluster);
+  h.lod_size = sizeof(plaid::mesh::lod);
+  h.source_size = source_size;
+  h.source_mtime = source_mtime;
+  h.source_hash = hash_source();
+  h.bounds = asset.m_bounds;
+  write_cache(cache, h, asset);
+  return asset;
+}
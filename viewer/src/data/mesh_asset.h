@@ -0,0 +1,85 @@
+#pragma once
+#ifndef PLAID_VIEWER_MESH_ASSET_H_
+#define PLAID_VIEWER_MESH_ASSET_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <mesh/simplify.h>
+#include <plaid/render_pass.h>
+#include <plaid/vec.h>
+
+#include "mapped_file.h"
+#include "obj_model.h"
+
+/// 预处理完成、可以直接绘制的网格：优化过的交错顶点与索引、网格簇、LOD 链以及包围体
+/// 预处理结果保存为二进制缓存文件，之后的加载只映射缓存文件，不逐个解析元素
+///
+/// 缓存文件依次是 [header] 与各段数据，每段按 16 字节对齐，数据按本机字节序与结构布局原样存放，
+/// 头部记录了版本与各结构的大小，不匹配的缓存被视为过期
+class mesh_asset {
+public:
+
+  /// 缓存文件格式版本，格式或者预处理方式改变时递增
+  static constexpr std::uint32_t version = 1;
+
+  /// 包围体，与顶点位置在同一个空间
+  struct bounding_volume {
+    plaid::vec3 min;
+    plaid::vec3 max;
+    plaid::vec3 center;
+    float radius;
+  };
+
+  /// 加载源文件对应的缓存，缓存不存在或者过期时解析源文件、预处理并写入缓存
+  /// 源文件的大小与修改时间都与缓存记录的相同时直接使用缓存；只有修改时间不同时
+  /// (例如文件被重新分发) 再比较内容的哈希值，相同时仍然使用缓存
+  /// 无法写入缓存时不报错，只是下次加载仍需预处理
+  /// @param source OBJ 文件路径，不能为空
+  /// @param cache_path 缓存文件路径，为空时为源文件路径加上 ".plaidmesh"
+  [[nodiscard]] static mesh_asset load(const char *source, const char *cache_path = nullptr);
+
+  [[nodiscard]] inline const obj_model::mesh_vertex *vertices() const noexcept { return m_vertices; }
+
+  [[nodiscard]] inline std::uint32_t vertices_count() const noexcept { return m_vertices_count; }
+
+  /// 第 0 级 LOD 的索引之后依次是其余各级的索引
+  [[nodiscard]] inline const std::uint32_t *indices() const noexcept { return m_indices; }
+
+  [[nodiscard]] inline std::uint32_t indices_count() const noexcept { return m_indices_count; }
+
+  /// 第 0 级 LOD 的网格簇
+  [[nodiscard]] inline const plaid::cluster *clusters() const noexcept { return m_clusters; }
+
+  [[nodiscard]] inline std::uint32_t clusters_count() const noexcept { return m_clusters_count; }
+
+  [[nodiscard]] inline const std::vector<plaid::mesh::lod> &lods() const noexcept { return m_lods; }
+
+  [[nodiscard]] inline const bounding_volume &bounds() const noexcept { return m_bounds; }
+
+  /// 是否来自缓存文件
+  [[nodiscard]] inline bool cached() const noexcept { return m_file != nullptr; }
+
+private:
+
+  mesh_asset() = default;
+
+  /// 从缓存文件加载的数据位于映射的内存中，新生成的数据由以下容器持有
+  std::unique_ptr<mapped_file> m_file;
+  std::vector<obj_model::mesh_vertex> m_vertices_storage;
+  std::vector<std::uint32_t> m_indices_storage;
+  std::vector<plaid::cluster> m_clusters_storage;
+
+  const obj_model::mesh_vertex *m_vertices = nullptr;
+  std::uint32_t m_vertices_count = 0;
+  const std::uint32_t *m_indices = nullptr;
+  std::uint32_t m_indices_count = 0;
+  const plaid::cluster *m_clusters = nullptr;
+  std::uint32_t m_clusters_count = 0;
+  /// 级数很少，从缓存加载时也复制出来，以便直接交给 plaid::mesh::select_lod
+  std::vector<plaid::mesh::lod> m_lods;
+  bounding_volume m_bounds{};
+};
+
+#endif // PLAID_VIEWER_MESH_ASSET_H_
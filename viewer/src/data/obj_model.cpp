@@ -1,52 +1,334 @@
-#include <fstream>
-#include <iosfwd>
-#include <sstream>
-#include <string>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <functional>
 #include <stdexcept>
+#include <thread>
 
+#include "mapped_file.h"
 #include "obj_model.h"
 
-obj_model::obj_model(const char *file) {
-  std::ifstream stream(file);
+namespace {
 
-  std::string line;
-  char trash;
-  while (stream) {
-    std::getline(stream, line);
-    [[unlikely]] if (line.starts_with("s ") || line.starts_with("g ") || line.starts_with('#') || line.starts_with("mtllib ")) {
+/// 小于此大小的文件不再切分，避免线程开销超过解析本身
+constexpr std::size_t min_chunk_size = 1 << 20;
+
+/// 面顶点中省略的编号
+constexpr std::int32_t omitted = INT32_MIN;
+
+/// 解析阶段的面顶点
+/// 正数编号在解析时就能确定，负数编号相对文件中此前的顶点数，而其它段的顶点数要等合并时才知道，
+/// 所以先换算为相对本段开头的编号 (可能为负)，合并时再加上之前各段的数量
+struct face_vertex {
+  std::int32_t index[3];
+  /// 第 i 位表示 index[i] 相对本段开头
+  std::uint8_t relative;
+};
+
+/// 一段文件的解析结果
+struct chunk {
+  std::vector<plaid::vec3> pos;
+  std::vector<plaid::vec2> uv;
+  std::vector<plaid::vec3> norm;
+  std::vector<face_vertex> vertices;
+  std::exception_ptr error;
+};
+
+class chunk_parser {
+public:
+
+  chunk_parser(const char *begin, const char *end, chunk &out) : p_(begin), end_(end), out_(out) {}
+
+  void parse() {
+    while (p_ != end_) {
+      skip_spaces();
+      if (at_line_end()) {
+        next_line();
+        continue;
+      }
+      if (*p_ == 'v') {
+        ++p_;
+        if (p_ == end_) {
+          break;
+        }
+        if (is_space()) {
+          auto &v = out_.pos.emplace_back();
+          read_floats(&v.x, 3);
+        } else if (*p_ == 't' && (++p_, is_space())) {
+          auto &uv = out_.uv.emplace_back();
+          read_floats(&uv.x, 2);
+        } else if (*p_ == 'n' && (++p_, is_space())) {
+          auto &n = out_.norm.emplace_back();
+          read_floats(&n.x, 3);
+        }
+      } else if (*p_ == 'f') {
+        ++p_;
+        if (is_space()) {
+          read_face();
+        }
+      }
+      // 其余的行 (注释、组、材质等) 以及每行多余的内容被忽略
+      next_line();
+    }
+  }
+
+private:
+
+  [[nodiscard]] inline bool is_space() const noexcept { return p_ != end_ && (*p_ == ' ' || *p_ == '\t'); }
+
+  [[nodiscard]] inline bool at_line_end() const noexcept {
+    return p_ == end_ || *p_ == '\n' || *p_ == '\r' || *p_ == '#';
+  }
+
+  inline void skip_spaces() noexcept {
+    while (is_space()) {
+      ++p_;
+    }
+  }
+
+  inline void next_line() noexcept {
+    auto line_end = static_cast<const char *>(std::memchr(p_, '\n', end_ - p_));
+    p_ = line_end ? line_end + 1 : end_;
+  }
+
+  /// 读取至多 n 个数，行内缺少的分量保持为 0
+  void read_floats(float *dst, int n) {
+    for (int i = 0; i != n; ++i) {
+      skip_spaces();
+      if (at_line_end()) {
+        return;
+      }
+      // from_chars 不接受前导的正号
+      if (*p_ == '+') {
+        ++p_;
+      }
+      auto [ptr, ec] = std::from_chars(p_, end_, dst[i]);
+      if (ec != std::errc()) {
+        throw std::logic_error("Invalid number in OBJ file!");
+      }
+      p_ = ptr;
+    }
+  }
+
+  /// 读取一个编号并换算为从 0 开始，负数编号换算为相对本段开头
+  /// @param k 0 为位置、1 为纹理坐标、2 为法线
+  void read_index(face_vertex &v, int k, std::size_t local_count) {
+    std::int32_t value;
+    auto [ptr, ec] = std::from_chars(p_, end_, value);
+    if (ec != std::errc() || !value) {
+      throw std::logic_error("Invalid index in OBJ face!");
+    }
+    p_ = ptr;
+    if (value > 0) {
+      v.index[k] = value - 1;
+    } else {
+      v.index[k] = static_cast<std::int32_t>(local_count) + value;
+      v.relative |= 1 << k;
+    }
+  }
+
+  void read_face() {
+    polygon_.clear();
+    while (true) {
+      skip_spaces();
+      if (at_line_end()) {
+        break;
+      }
+      face_vertex v{{omitted, omitted, omitted}, 0};
+      read_index(v, 0, out_.pos.size());
+      if (p_ != end_ && *p_ == '/') {
+        ++p_;
+        if (p_ != end_ && *p_ != '/') {
+          read_index(v, 1, out_.uv.size());
+        }
+        if (p_ != end_ && *p_ == '/') {
+          ++p_;
+          read_index(v, 2, out_.norm.size());
+        }
+      }
+      polygon_.push_back(v);
+    }
+    if (polygon_.size() < 3) {
+      throw std::logic_error("Not a triangle face!");
+    }
+    // 多边形按扇形拆分
+    for (std::size_t i = 2; i != polygon_.size(); ++i) {
+      out_.vertices.push_back(polygon_[0]);
+      out_.vertices.push_back(polygon_[i - 1]);
+      out_.vertices.push_back(polygon_[i]);
+    }
+  }
+
+  const char *p_;
+  const char *end_;
+  chunk &out_;
+  std::vector<face_vertex> polygon_;
+};
+
+/// 在多个线程上执行 task(0) ~ task(count - 1)，调用线程执行第 0 个，任一任务抛出的异常在全部结束后重新抛出
+void run_parallel(std::size_t count, const std::function<void(std::size_t)> &task, std::vector<chunk> &chunks) {
+  auto guarded = [&](std::size_t i) {
+    try {
+      task(i);
+    } catch (...) {
+      chunks[i].error = std::current_exception();
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(count - 1);
+  for (std::size_t i = 1; i < count; ++i) {
+    threads.emplace_back(guarded, i);
+  }
+  guarded(0);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (auto &c : chunks) {
+    if (c.error) {
+      std::rethrow_exception(c.error);
+    }
+  }
+}
+
+} // namespace
+
+obj_model::obj_model(const char *file, std::size_t chunks_count) {
+  mapped_file mapping(file);
+  auto data = mapping.data();
+  auto size = mapping.size();
+
+  // 按行边界切成若干段，行数少于段数时靠后的段为空
+  std::size_t threads = (std::max)(std::thread::hardware_concurrency(), 1u);
+  if (!chunks_count) {
+    chunks_count = std::clamp<std::size_t>(size / min_chunk_size, 1, threads);
+  }
+  std::vector<std::size_t> bounds(chunks_count + 1, size);
+  bounds[0] = 0;
+  for (std::size_t i = 1; i != chunks_count; ++i) {
+    auto pos = (std::max)(size * i / chunks_count, bounds[i - 1]);
+    auto line_end = pos == size ? nullptr : static_cast<const char *>(std::memchr(data + pos, '\n', size - pos));
+    bounds[i] = line_end ? line_end - data + 1 : size;
+  }
+
+  std::vector<chunk> chunks(chunks_count);
+  run_parallel(chunks_count, [&](std::size_t i) {
+    chunk_parser(data + bounds[i], data + bounds[i + 1], chunks[i]).parse();
+  }, chunks);
+
+  // 各段在合并结果中的起始位置
+  struct offsets {
+    std::size_t pos, uv, norm, vertices;
+  };
+  std::vector<offsets> starts(chunks_count + 1);
+  starts[0] = {};
+  for (std::size_t i = 0; i != chunks_count; ++i) {
+    starts[i + 1] = {
+        starts[i].pos + chunks[i].pos.size(),
+        starts[i].uv + chunks[i].uv.size(),
+        starts[i].norm + chunks[i].norm.size(),
+        starts[i].vertices + chunks[i].vertices.size(),
+    };
+  }
+  auto &total = starts[chunks_count];
+  if (total.pos > none || total.uv > none || total.norm > none || total.vertices > none) {
+    throw std::logic_error("OBJ file is too large!");
+  }
+  m_pos.resize(total.pos);
+  m_uv.resize(total.uv);
+  m_norm.resize(total.norm);
+  m_vertices.resize(total.vertices);
+
+  // 合并，同时把编号换算为全局编号
+  run_parallel(chunks_count, [&](std::size_t i) {
+    auto &c = chunks[i];
+    auto &start = starts[i];
+    std::copy(c.pos.begin(), c.pos.end(), m_pos.begin() + start.pos);
+    std::copy(c.uv.begin(), c.uv.end(), m_uv.begin() + start.uv);
+    std::copy(c.norm.begin(), c.norm.end(), m_norm.begin() + start.norm);
+
+    const std::int64_t bases[3]{
+        static_cast<std::int64_t>(start.pos),
+        static_cast<std::int64_t>(start.uv),
+        static_cast<std::int64_t>(start.norm),
+    };
+    const std::int64_t counts[3]{
+        static_cast<std::int64_t>(total.pos),
+        static_cast<std::int64_t>(total.uv),
+        static_cast<std::int64_t>(total.norm),
+    };
+    auto dst = m_vertices.data() + start.vertices;
+    for (auto &v : c.vertices) {
+      std::uint32_t resolved[3];
+      for (int k = 0; k != 3; ++k) {
+        if (v.index[k] == omitted) {
+          resolved[k] = none;
+          continue;
+        }
+        auto index = v.index[k] + (v.relative >> k & 1 ? bases[k] : 0);
+        if (index < 0 || index >= counts[k]) {
+          throw std::logic_error("Face index out of range!");
+        }
+        resolved[k] = static_cast<std::uint32_t>(index);
+      }
+      *dst++ = {resolved[0], resolved[1], resolved[2]};
+    }
+    // 尽早释放段内的临时数据
+    c = {};
+  }, chunks);
+}
+
+obj_model::indexed_mesh obj_model::build_indexed_mesh() const {
+  indexed_mesh mesh;
+  mesh.indices.resize(m_vertices.size());
+
+  // 只有省略了法线的面顶点才需要，按位置累加面法线 (叉积的长度是面积的两倍)
+  std::vector<plaid::vec3> smooth_normals;
+  for (std::size_t i = 0; i + 2 < m_vertices.size(); i += 3) {
+    auto face = m_vertices.data() + i;
+    if (face[0].norm_index != none && face[1].norm_index != none && face[2].norm_index != none) {
       continue;
     }
+    if (smooth_normals.empty()) {
+      smooth_normals.resize(m_pos.size());
+    }
+    auto &a = m_pos[face[0].pos_index];
+    auto &b = m_pos[face[1].pos_index];
+    auto &c = m_pos[face[2].pos_index];
+    auto n = plaid::cross(b - a, c - a);
+    for (int k = 0; k != 3; ++k) {
+      smooth_normals[face[k].pos_index] += n;
+    }
+  }
+
+  // 位置相同的合并结果用链表串起来，链表通常只有一两个节点
+  std::vector<std::uint32_t> heads(m_pos.size(), none);
+  std::vector<std::uint32_t> next;
+  std::vector<vertex> keys;
+  for (std::size_t i = 0; i != m_vertices.size(); ++i) {
+    auto &v = m_vertices[i];
+    auto found = heads[v.pos_index];
+    while (found != none && (keys[found].uv_index != v.uv_index || keys[found].norm_index != v.norm_index)) {
+      found = next[found];
+    }
+    if (found == none) {
+      found = static_cast<std::uint32_t>(keys.size());
+      keys.push_back(v);
+      next.push_back(heads[v.pos_index]);
+      heads[v.pos_index] = found;
 
-    std::istringstream buf(line.c_str());
-    if (line.starts_with("v ")) {
-      buf >> trash;
-      m_pos.emplace_back();
-      auto &v = m_pos.back();
-      buf >> v.x >> v.y >> v.z;
-    } else if (line.starts_with("vt ")) {
-      buf >> trash >> trash;
-      m_uv.emplace_back();
-      auto &uv_pos = m_uv.back();
-      buf >> uv_pos.x >> uv_pos.y;
-    } else if (line.starts_with("vn ")) {
-      buf >> trash >> trash;
-      m_norm.emplace_back();
-      auto &n = m_norm.back();
-      buf >> n.x >> n.y >> n.z;
-    } else if (line.starts_with("f ")) {
-      buf >> trash;
-      int cnt = 0;
-      vertex v;
-      while (buf >> v.pos_index >> trash >> v.uv_index >> trash >> v.norm_index) {
-        --v.pos_index;
-        --v.uv_index;
-        --v.norm_index;
-        m_vertices.push_back(v);
-        ++cnt;
-      }
-      if (cnt != 3) {
-        throw std::logic_error("Not a triangle face!");
+      auto &dst = mesh.vertices.emplace_back();
+      dst.position = m_pos[v.pos_index];
+      if (v.norm_index != none) {
+        dst.normal = m_norm[v.norm_index];
+      } else {
+        auto &n = smooth_normals[v.pos_index];
+        auto len = plaid::abs(n);
+        dst.normal = len > 0 ? n / len : plaid::vec3{};
       }
+      dst.uv = v.uv_index != none ? m_uv[v.uv_index] : plaid::vec2{};
     }
+    mesh.indices[i] = found;
   }
+  return mesh;
 }
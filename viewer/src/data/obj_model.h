@@ -1,28 +1,65 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 #include <plaid/vec.h>
 
+/// Wavefront OBJ 模型，只读取顶点位置、纹理坐标、法线与面
+/// 文件被映射到内存后按行边界切成多段，在多个线程上同时解析再合并
 class obj_model {
 public:
 
+  /// 面中省略的纹理坐标或法线的编号
+  static constexpr std::uint32_t none = ~std::uint32_t{};
+
   struct vertex {
     std::uint32_t pos_index;
     std::uint32_t uv_index;
     std::uint32_t norm_index;
   };
 
-  obj_model(const char *file);
+  /// 交错存放全部属性的顶点
+  struct mesh_vertex {
+    plaid::vec3 position;
+    plaid::vec3 normal;
+    plaid::vec2 uv;
+  };
+
+  /// 可以直接用于索引绘制的三角形列表
+  struct indexed_mesh {
+    std::vector<mesh_vertex> vertices;
+    std::vector<std::uint32_t> indices;
+  };
+
+  /// 解析文件，支持 v、v/vt、v//vn、v/vt/vn 四种面顶点写法以及负数 (相对) 编号，
+  /// 多边形面按扇形拆成三角形
+  /// 文件无法打开时抛出 std::runtime_error，面的顶点少于 3 个或者编号越界时抛出 std::logic_error
+  /// @param chunks_count 切分的段数，为 0 时按文件大小与硬件线程数决定；段数不影响解析结果
+  explicit obj_model(const char *file, std::size_t chunks_count = 0);
 
   [[nodiscard]] inline const plaid::vec3 *positions() const noexcept { return m_pos.data(); }
 
+  [[nodiscard]] inline const plaid::vec2 *uvs() const noexcept { return m_uv.data(); }
+
   [[nodiscard]] inline const plaid::vec3 *normals() const noexcept { return m_norm.data(); }
 
   [[nodiscard]] inline const vertex *vertices() const noexcept { return m_vertices.data(); }
 
+  [[nodiscard]] inline std::uint32_t positions_count() const noexcept { return m_pos.size(); }
+
+  [[nodiscard]] inline std::uint32_t uvs_count() const noexcept { return m_uv.size(); }
+
+  [[nodiscard]] inline std::uint32_t normals_count() const noexcept { return m_norm.size(); }
+
+  /// 三角形顶点数，每 3 个顶点组成一个三角形
   [[nodiscard]] inline std::uint32_t size() const noexcept { return m_vertices.size(); }
 
+  /// 把位置、纹理坐标、法线编号都相同的面顶点合并为一个交错顶点，生成索引缓冲区
+  /// 省略的纹理坐标为 0，省略的法线用共用该位置的各个面的法线按面积加权平均得到
+  [[nodiscard]] indexed_mesh build_indexed_mesh() const;
+
 private:
 
   std::vector<plaid::vec3> m_pos;
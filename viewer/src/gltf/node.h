@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 #include <span>
 
 namespace plaid::viewer::gltf {
@@ -1,15 +1,17 @@
 #include <ctime>
 
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <numbers>
 #include <optional>
 
 #include <json/dom.h>
+#include <mesh/simplify.h>
 #include <plaid.h>
 
 #include "blinn_phong.hpp"
-#include "data/obj_model.h"
+#include "data/mesh_asset.h"
 #include "gltf/loader.h"
 #include "platform/window.h"
 #include "scene/perspective_camera.h"
@@ -20,7 +22,6 @@ plaid::render_pass viewer_render_pass;
 plaid::graphics_pipeline viewer_pipeline;
 plaid::frame_buffer viewer_frame_buffer;
 std::unique_ptr<float[]> depth_buffer;
-std::uint32_t size;
 
 plaid::viewer::camera viewer_cam({2, 0, -1}, {}, 0.5, 60, std::numbers::pi / 18, 1);
 plaid::mat4 mvp;
@@ -42,7 +43,8 @@ void initialize_render_pass() {
           .store_op = plaid::attachment_store_op::store,
       },
       {
-          // depth attachment
+          // depth attachment，渲染结束后虽然不再需要，但作为瞬态附件会使整帧走分块渲染，
+          // 对于模型这样密集的小三角形，分块记录与回放的开销仍然超过省下的深度缓冲区带宽
           .stencil_load_op = plaid::attachment_load_op::clear,
           .stencil_store_op = plaid::attachment_store_op::store,
       },
@@ -64,7 +66,7 @@ void initialize_pipeline() {
       {
           .binding = 0,
           .input_rate = plaid::vertex_input_rate::vertex,
-          .stride = sizeof(obj_model::vertex),
+          .stride = sizeof(obj_model::mesh_vertex),
       },
   };
 
@@ -72,17 +74,22 @@ void initialize_pipeline() {
       {
           .location = 0,
           .binding = 0,
-          .offset = offsetof(obj_model::vertex, pos_index),
+          .offset = offsetof(obj_model::mesh_vertex, position),
+      },
+      {
+          .location = 1,
+          .binding = 0,
+          .offset = offsetof(obj_model::mesh_vertex, normal),
       },
   };
 
-  const auto vert = plaid::dsl_shader_module::load<&blinn_phong::vert::main>();
-  const auto frag = plaid::dsl_shader_module::load<&blinn_phong::frag::main>();
+  const auto vert = plaid::dsl_shader_module::load<&blinn_phong::vert::main, &blinn_phong::vert::position_only>();
+  const auto frag = plaid::dsl_shader_module::load<blinn_phong::frag>();
 
   plaid::graphics_pipeline::create_info create_info{
       .vertex_input_state{
           .bindings_count = 1,
-          .attributes_count = 1,
+          .attributes_count = 2,
           .bindings = bindings,
           .attributes = attrs,
       },
@@ -112,7 +119,7 @@ void update_mvp() {
 }
 
 void recreate_frame_buffer(std::uint32_t *color, std::uint32_t width, std::uint32_t height) {
-  depth_buffer = std::make_unique<float[]>(size = width * height);
+  depth_buffer = std::make_unique<float[]>(width * height);
   std::byte *attachements[] = {
       reinterpret_cast<std::byte *>(color),
       reinterpret_cast<std::byte *>(depth_buffer.get()),
@@ -124,7 +131,8 @@ void recreate_frame_buffer(std::uint32_t *color, std::uint32_t width, std::uint3
   update_mvp();
 }
 
-void render(const obj_model &model) {
+void render(const mesh_asset &asset) {
+  PLAID_TRACE_ZONE("frame");
   plaid::clear_value clear_values[]{
       {.color{
           .u{127, 127, 255, 0},
@@ -141,13 +149,18 @@ void render(const obj_model &model) {
   };
 
   plaid::render_pass::state state(begin_info);
-  state.bind_descriptor_set(0, reinterpret_cast<const std::byte *>(model.positions()));
-  state.bind_descriptor_set(1, reinterpret_cast<const std::byte *>(model.normals()));
   state.bind_descriptor_set(2, reinterpret_cast<const std::byte *>(&mvp));
   auto view = plaid::norm(viewer_cam.obrit() - viewer_cam.gaze());
   state.bind_descriptor_set(3, reinterpret_cast<const std::byte *>(&view));
-  state.bind_vertex_buffer(0, reinterpret_cast<const std::byte *>(model.vertices()));
-  state.draw(viewer_pipeline, model.size(), 1, 0, 0);
+  state.bind_vertex_buffer(0, reinterpret_cast<const std::byte *>(asset.vertices()));
+  state.bind_index_buffer(reinterpret_cast<const std::byte *>(asset.indices()), plaid::index_type::uint32);
+  // 误差投影到屏幕上不足一个像素的最粗糙的一级，原网格按网格簇剔除后绘制
+  auto &lod = plaid::mesh::select_lod(asset.lods(), asset.bounds().center, mvp, float(viewer_frame_buffer.height()));
+  if (&lod == &asset.lods().front()) {
+    state.draw_clusters(viewer_pipeline, asset.clusters(), asset.clusters_count(), mvp);
+  } else {
+    state.draw_indexed(viewer_pipeline, lod.indices_count, 1, lod.first_index, 0, 0);
+  }
   state.next_subpass();
 }
 
@@ -159,7 +172,8 @@ void print_fps() {
 
   auto tick = clock();
   if (tick - previous_tick >= CLOCKS_PER_SEC) {
-    std::cout << "fps: " << frame_count << '\n';
+    // 无窗口模式可能把帧写入标准输出，统计信息写入标准错误
+    std::cerr << "fps: " << frame_count << '\n';
     frame_count = 0;
     previous_tick = tick;
   }
@@ -228,13 +242,41 @@ int main(int argc, const char *argv[]) {
 
   std::uint32_t user_width = 800, user_height = 600;
   const char *file = nullptr;
-  for (auto it = argv, ed = it + argc; it != ed; ++it) {
+  // 预处理结果的缓存文件，默认位于模型文件旁边
+  const char *cache_file = nullptr;
+#ifdef PLAID_TRACE
+  // 退出时把时间线追踪写入的文件
+  const char *trace_file = nullptr;
+#endif
+#ifdef PLAID_VIEWER_HEADLESS
+  // 无窗口模式下默认只渲染一帧
+  window::headless_output output{.format = image_format::ppm, .frames = 1};
+  const char *output_format = nullptr;
+#endif
+  for (auto it = argv + 1, ed = argv + argc; it != ed; ++it) {
     auto str = *it;
     if (str[0] == '-') {
       if (str[1] == 'w' && str[2] == '=') {
         user_width = std::atoi(str + 3);
       } else if (str[1] == 'h' && str[2] == '=') {
         user_height = std::atoi(str + 3);
+      } else if (str[1] == 'c' && str[2] == '=') {
+        cache_file = str + 3;
+#ifdef PLAID_TRACE
+      } else if (str[1] == 't' && str[2] == '=') {
+        trace_file = str + 3;
+#endif
+#ifdef PLAID_VIEWER_HEADLESS
+      } else if (str[1] == 'o' && str[2] == '=') {
+        // 输出路径，"-" 表示写入标准输出
+        output.path = str + 3;
+      } else if (str[1] == 'n' && str[2] == '=') {
+        // 渲染帧数，0 表示不限制
+        output.frames = std::atoi(str + 3);
+      } else if (str[1] == 'f' && str[2] == '=') {
+        // 输出格式 ppm/qoi/png，默认根据输出路径的扩展名推断
+        output_format = str + 3;
+#endif
       } else {
         std::cerr << "Unknown param: " << str << '\n';
         return 0;
@@ -244,7 +286,12 @@ int main(int argc, const char *argv[]) {
     }
   }
 
-  obj_model model(file);
+  if (!file) {
+    std::cerr << "Usage: plaid_viewer <model.obj> [-w=width] [-h=height] [-c=cache]\n";
+    return 1;
+  }
+
+  auto asset = mesh_asset::load(file, cache_file);
 
   auto window = window::create("plaid", user_width, user_height);
   if (!window.valid()) {
@@ -254,13 +301,21 @@ int main(int argc, const char *argv[]) {
   plaid_viewer_window_events events;
   window.bind(events);
 
+#ifdef PLAID_VIEWER_HEADLESS
+  output.format = output_format ? image_format_from_name(output_format) : image_format_from_path(output.path);
+  window.configure(output);
+#endif
+
   initialize();
 
   window.show();
   [[likely]] while (!window.should_close()) {
     // 渲染帧
-    render(model);
-    window.invalidate();
+    render(asset);
+    {
+      PLAID_TRACE_ZONE("present");
+      window.invalidate();
+    }
     handle_window_input(window);
     print_fps();
     window.poll_events();
@@ -268,5 +323,12 @@ int main(int argc, const char *argv[]) {
 
   window.destroy();
 
+#ifdef PLAID_TRACE
+  if (trace_file) {
+    std::ofstream trace(trace_file);
+    plaid::write_chrome_trace(trace);
+  }
+#endif
+
   return 0;
 }
@@ -2,9 +2,15 @@
 #ifndef PLAID_VIEWER_WINDOW_H_
 #define PLAID_VIEWER_WINDOW_H_
 
+#include <cstdint>
 #include <functional>
+#include <string>
 #include <string_view>
 
+#ifdef PLAID_VIEWER_HEADLESS
+#include "../data/image.h"
+#endif
+
 /// 窗口句柄类
 class window {
 private:
@@ -27,7 +33,8 @@ public:
     virtual void mouse_wheel(window &, std::int16_t distance){};
 
     struct mouse_movement {
-#ifdef PLAID_VIEWER_WIN32
+      // 无窗口模式不会产生输入，沿用 WIN32 的编号
+#if defined(PLAID_VIEWER_WIN32) || defined(PLAID_VIEWER_HEADLESS)
       static constexpr std::uint32_t P_CTRL = 0x8;
       static constexpr std::uint32_t P_LBUTTON = 0x1;
       static constexpr std::uint32_t P_MBUTTON = 0x10;
@@ -51,7 +58,7 @@ public:
   public:
 
     enum : std::uint8_t {
-#ifdef PLAID_VIEWER_WIN32
+#if defined(PLAID_VIEWER_WIN32) || defined(PLAID_VIEWER_HEADLESS)
       W = 0x57,
       A = 0x41,
       S = 0x53,
@@ -124,6 +131,22 @@ public:
   /// 绑定窗口事件回调
   void bind(events &);
 
+#ifdef PLAID_VIEWER_HEADLESS
+  /// 无窗口模式下呈现结果的去向
+  struct headless_output {
+    /// 输出路径，其中的 %d 或 %0Nd (补零到 N 位) 替换为帧编号，%% 表示 %；
+    /// 为 "-" 时依次写入标准输出，为空时不输出
+    std::string path;
+    /// 输出图片格式
+    image_format format;
+    /// 呈现这么多帧之后请求关闭窗口，为 0 时不限制
+    std::uint32_t frames;
+  };
+
+  /// 设置呈现结果的去向
+  void configure(const headless_output &);
+#endif
+
 private:
 
   delegate *m_ptr;
@@ -0,0 +1,138 @@
+#ifdef PLAID_VIEWER_HEADLESS
+
+#include <algorithm>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "window.h"
+
+/// 提供一个默认空回调
+static window::events g_default_events;
+
+/// 把输出路径中的帧编号占位符 (%d 或者 %0Nd) 替换为帧编号，%% 替换为 %，其余字符原样保留
+/// 路径由用户提供，不能直接作为 printf 的格式串
+static std::string frame_path(const std::string &pattern, std::uint32_t frame) {
+  std::string path;
+  for (std::size_t i = 0; i != pattern.size(); ++i) {
+    if (pattern[i] != '%') {
+      path += pattern[i];
+      continue;
+    }
+    if (i + 1 != pattern.size() && pattern[i + 1] == '%') {
+      path += '%';
+      ++i;
+      continue;
+    }
+    // 可选的补零宽度，之后必须是 d
+    auto end = i + 1;
+    std::size_t width = 0;
+    if (end != pattern.size() && pattern[end] == '0') {
+      ++end;
+      while (end != pattern.size() && pattern[end] >= '0' && pattern[end] <= '9') {
+        width = (std::min)(width * 10 + (pattern[end++] - '0'), std::size_t{32});
+      }
+    }
+    if (end == pattern.size() || pattern[end] != 'd') {
+      path += '%';
+      continue;
+    }
+    auto number = std::to_string(frame);
+    if (number.size() < width) {
+      path.append(width - number.size(), '0');
+    }
+    path += number;
+    i = end;
+  }
+  return path;
+}
+
+/// 无窗口实现，渲染到内存中的表面，呈现时把表面编码为图片输出
+class window::delegate {
+public:
+
+  delegate(std::uint32_t width, std::uint32_t height) noexcept
+      : should_close(false), width(width), height(height), frame(0),
+        events(&g_default_events), output{.format = image_format::ppm, .frames = 1}, keys{} {}
+
+  void recreate_surface(window &wnd) {
+    surface.assign(width * height, 0);
+    events->surface_recreate(wnd, width, height);
+  }
+
+  void present() {
+    if (output.path == "-") {
+      write_image(std::cout, output.format, surface.data(), width, height);
+      std::cout.flush();
+    } else if (!output.path.empty()) {
+      auto path = frame_path(output.path, frame);
+      std::ofstream file(path, std::ios::binary);
+      if (!file) {
+        std::cerr << "Cannot write frame to " << path << '\n';
+      } else {
+        write_image(file, output.format, surface.data(), width, height);
+      }
+    }
+
+    ++frame;
+    if (output.frames && frame >= output.frames) {
+      should_close = true;
+    }
+  }
+
+  bool should_close;
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t frame;
+  std::vector<std::uint32_t> surface;
+  window::events *events;
+  headless_output output;
+
+  key_state keys;
+};
+
+window window::create(
+    std::string_view, std::uint32_t width, std::uint32_t height
+) {
+  return new delegate(width, height);
+}
+
+void window::show() {
+  // 没有窗口系统通知尺寸，在显示时创建表面
+  m_ptr->recreate_surface(*this);
+}
+
+bool window::should_close() {
+  return m_ptr->should_close;
+}
+
+std::uint32_t *window::surface() {
+  return m_ptr->surface.data();
+}
+
+void window::invalidate() {
+  m_ptr->present();
+}
+
+void window::poll_events() {}
+
+const window::key_state &window::keys() const {
+  return m_ptr->keys;
+}
+
+void window::destroy() {
+  delete m_ptr;
+  m_ptr = nullptr;
+}
+
+void window::bind(events &target) {
+  m_ptr->events = &target;
+}
+
+void window::configure(const headless_output &output) {
+  m_ptr->output = output;
+}
+
+#endif